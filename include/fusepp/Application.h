@@ -27,29 +27,184 @@ along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
 #include <memory>
 #include <fusepp/Export.h>
 #include <fusepp/FileSystem.h>
+#include <fusepp/InodeTable.h>
+#include <fusepp/Operations.h>
+#include <fusepp/Stats.h>
 
-namespace fusepp_impl { class Hooks; };
+namespace fusepp_impl { class Hooks; class LowLevelHooks; class Workers; class OpenFile; class Snapshots; };
+struct fuse_operations;
+struct fuse_lowlevel_ops;
 
 namespace fusepp
 {
 
+class NamespaceSnapshot;
+
 class FUSEPP_API Application
 {
 public:
+	enum Mode
+	{
+		// Path-based dispatch through fuse_main()
+		HIGH_LEVEL,
+		// Inode-based dispatch through a fuse_session; the Application
+		// owns the inode table
+		LOW_LEVEL,
+	};
+
+	// Binds the operations of 'fs' through its FS_* interfaces. See
+	// StaticApplication to bind them at compile time instead.
 	Application(FileSystemPtr fs);
 	virtual ~Application();
 
 	int run(int argc, char* argv[]);
-	
+
+	inline Mode getMode() const { return _mode; }
+	inline void setMode(Mode mode) { _mode = mode; }
+
+	// Validity, in seconds, of the names and attributes replied to the kernel
+	// in low-level mode
+	void setTimeouts(double entryTimeout, double attrTimeout);
+
+	// Time, in seconds, during which the kernel remembers that a name the
+	// file system reported missing (ENOENT) does not exist, and answers its
+	// lookups itself. 0 (the default) disables it. Names created through the
+	// mount point are never hidden by it.
+	inline double getNegativeTimeout() const { return _negativeTimeout; }
+	inline void setNegativeTimeout(double timeout) { _negativeTimeout = timeout; }
+
+	// Number of threads serving requests. With 0 (the default), libfuse
+	// decides and starts threads as requests come in; otherwise the
+	// Application starts that many workers up front (see FS_worker). The -s
+	// command line option still restricts it to a single thread.
+	inline unsigned int getWorkerCount() const { return _workerCount; }
+	inline void setWorkerCount(unsigned int count) { _workerCount = count; }
+
+	// Records the calls made to the file system and serves the figures in
+	// Stats::STATS_PATH, which hides anything the file system has there.
+	// Must be set before run().
+	inline void setStatsEnabled(bool enabled) { Stats::setEnabled(enabled); }
+
+	// Holds back the writes made to each open file and hands them to the
+	// file system together, as long as they are contiguous, add up to less
+	// than 'maxSize' bytes and the first one is no older than 'window'
+	// seconds. Whatever is pending is written once the window is over, from
+	// a thread of its own, and before a read, flush, fsync or release of the
+	// same handle returns; a failure is reported by the call that wrote the
+	// data, or else by the next write, flush or fsync. Writes through other
+	// handles do not see pending data until it is written.
+	// A 'maxSize' of 0 (the default) disables it. Must be set before run().
+	void setWriteCoalescing(size_t maxSize, double window);
+	inline size_t getWriteCoalescingSize() const { return _writeCoalescingSize; }
+	inline double getWriteCoalescingWindow() const { return _writeCoalescingWindow; }
+
+	// Detects the handles that are read sequentially and reads ahead of
+	// them, on 'threads' background threads, into a window that starts at
+	// twice the size of a read, doubles while prefetched data gets used, up
+	// to 'maxWindow' bytes, and is halved when prefetched data is thrown
+	// away. A read at any other offset, or a write, drops what was
+	// prefetched for the handle. The file system's FS_read must accept calls
+	// from those threads, which run while mounted and have a worker context
+	// like the workers (see FS_worker). See Stats::READAHEAD_HITS and the following
+	// counters. A 'maxWindow' of 0 (the default) disables it. Must be set
+	// before run().
+	void setReadAhead(size_t maxWindow, unsigned int threads = 2);
+	inline size_t getReadAheadWindow() const { return _readAheadWindow; }
+	inline unsigned int getReadAheadThreads() const { return _readAheadThreads; }
+
+	// Tell the kernel, in low-level mode, that what it caches changed behind
+	// its back, so that long timeouts stay safe for file systems modified
+	// from elsewhere. They may be called from any thread, including while
+	// serving a request: invalidations are queued, merged with those still
+	// pending for the same inode or name, and sent by a background thread.
+	// They return false when no low-level session is running.
+	// - invalidateInode: the attributes of 'ino' and its data from 'offset',
+	//   for 'length' bytes (0 up to the end); a negative 'offset' leaves
+	//   the data alone
+	// - invalidateEntry: the name 'name' in directory 'parent'
+	// - invalidatePath: the name and the inode of 'path', if the kernel
+	//   looked it up
+	bool invalidateInode(ino_t ino, off_t offset = 0, off_t length = 0);
+	bool invalidateEntry(ino_t parent, const std::string& name);
+	bool invalidatePath(const std::string& path);
+
+	// Maximum number of invalidations sent to the kernel per second, so that
+	// a burst of changes does not starve the requests (1000 by default).
+	// Must be set before run().
+	inline unsigned int getInvalidationRate() const { return _invalidationRate; }
+	inline void setInvalidationRate(unsigned int perSecond) { _invalidationRate = perSecond; }
+
+	// Keeps the attributes the file system returns, by path, in 'file' (see
+	// NamespaceSnapshot), written every 'interval' seconds (never with 0)
+	// and once unmounted. When mounted again, each entry of the file answers
+	// the first getattr() or lookup of its path, so that a restart does not
+	// send every request to the backend at once; the file system answers
+	// the following calls, which revalidates the entry. In low-level mode,
+	// the answers from the file are replied with a zero timeout, so that
+	// the kernel asks again the next time the entry is used (the high-level
+	// API of libfuse has one timeout for all replies). Names the file
+	// system reports missing, and those invalidated, are dropped from it.
+	// An empty 'file' (the default) disables it. A relative 'file' is taken
+	// from the current directory. Must be set before run().
+	void setSnapshot(const std::string& file, double interval = 300);
+	inline const std::string& getSnapshotFile() const { return _snapshotFile; }
+	inline double getSnapshotInterval() const { return _snapshotInterval; }
+	// NULL when disabled
+	inline NamespaceSnapshot* getSnapshot() const { return _snapshot.get(); }
+
+	inline InodeTable& getInodeTable() { return _inodes; }
+
+	inline const Operations& getOperations() const { return _ops; }
+
+	// The libfuse callbacks registered by run() in each mode, for tools
+	// driving the hooks without mounting anything (see the hooks benchmark)
+	void getFuseOperations(struct fuse_operations* ops) const;
+	void getFuseLowLevelOperations(struct fuse_lowlevel_ops* ops) const;
+
+protected:
+	Application(FileSystemPtr fs, const Operations& ops);
 
 private:
 	static Application* _s_instance;
 	friend class fusepp_impl::Hooks;
+	friend class fusepp_impl::LowLevelHooks;
+	friend class fusepp_impl::Workers;
+	friend class fusepp_impl::OpenFile;
+	friend class fusepp_impl::Snapshots;
 	FileSystemPtr _fs;
+	Operations _ops;
+	Mode _mode;
+	double _entryTimeout, _attrTimeout, _negativeTimeout;
+	unsigned int _workerCount;
+	size_t _writeCoalescingSize;
+	double _writeCoalescingWindow;
+	size_t _readAheadWindow;
+	unsigned int _readAheadThreads;
+	unsigned int _invalidationRate;
+	std::string _snapshotFile;
+	double _snapshotInterval;
+	std::shared_ptr<NamespaceSnapshot> _snapshot;
+	InodeTable _inodes;
+
+	int runHighLevel(int argc, char* argv[]);
+	int runLowLevel(int argc, char* argv[]);
 };
 
 typedef std::shared_ptr<Application> ApplicationPtr;
 
+
+// Application whose operations are bound at compile time to the concrete
+// file system class FS (see Binder): hooks call FS directly instead of going
+// through the virtual FS_* interfaces.
+template <class FS>
+class StaticApplication : public Application
+{
+public:
+	StaticApplication(std::shared_ptr<FS> fs)
+		: Application(fs, Binder<FS>::bind(fs.get()))
+	{}
+};
+
 };
 
 #endif //_FUSEPP_APPLICATION_H
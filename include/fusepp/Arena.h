@@ -0,0 +1,170 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _FUSEPP_ARENA_H
+#define _FUSEPP_ARENA_H
+
+#include <fusepp/Export.h>
+#include <cstddef>
+#include <deque>
+#include <new>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fusepp
+{
+
+// Bump allocator for the memory needed while serving one request. The hooks
+// open an ArenaScope for each request they serve; when the request is done,
+// everything allocated from the arena of the thread is released at once,
+// and its blocks are kept for the next request, so that serving requests
+// stops calling malloc once the threads are warm.
+//
+// Memory of the arena is only valid until the hook returns: asynchronous
+// operations, which reply later, must not keep any.
+class FUSEPP_API Arena
+{
+public:
+	static const size_t BLOCK_SIZE = 64 * 1024;
+	// Memory kept across requests; larger blocks go back to the system
+	static const size_t MAX_RETAINED = 1024 * 1024;
+
+	Arena();
+	~Arena();
+
+	// Throws std::bad_alloc
+	void* allocate(size_t size, size_t align = alignof(std::max_align_t));
+	// Only gives the memory back if it is the last allocation
+	void deallocate(void* p, size_t size);
+	void reset();
+
+	// Bytes allocated since the last reset
+	inline size_t getUsed() const { return _used; }
+
+	// An empty (or 's') std::string owned by the arena, for the interfaces
+	// that require a std::string: its capacity survives reset(), so the
+	// same string serves the next requests without allocating
+	std::string& string();
+	std::string& string(const char* s);
+
+	// Arena of the request served by the calling thread, or NULL outside of
+	// an ArenaScope
+	static Arena* current();
+
+private:
+	struct Block
+	{
+		Block* next;
+		size_t size;
+	};
+
+	Arena(const Arena&);
+	Arena& operator=(const Arena&);
+
+	Block* _first;
+	Block* _current;
+	size_t _offset;
+	size_t _used;
+	std::deque<std::string> _strings;
+	size_t _stringsUsed;
+};
+
+// Makes Arena::current() available to the calling thread for its lifetime.
+// Scopes nest: the outermost one resets the arena when it goes away.
+class FUSEPP_API ArenaScope
+{
+public:
+	ArenaScope();
+	~ArenaScope();
+
+	inline Arena& getArena() const { return *_arena; }
+
+private:
+	ArenaScope(const ArenaScope&);
+	ArenaScope& operator=(const ArenaScope&);
+
+	Arena* _arena;
+};
+
+// Standard allocator drawing from an arena: the current one when built
+// by default, the global heap when there is none
+template <class T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	template <class U> struct rebind { typedef ArenaAllocator<U> other; };
+
+	inline ArenaAllocator() : _arena(Arena::current()) {}
+	inline explicit ArenaAllocator(Arena* arena) : _arena(arena) {}
+	template <class U>
+	inline ArenaAllocator(const ArenaAllocator<U>& other) : _arena(other.getArena()) {}
+
+	inline T* allocate(size_t n)
+	{
+		if (_arena)
+			return static_cast<T*>(_arena->allocate(n * sizeof(T), alignof(T)));
+		return static_cast<T*>(::operator new(n * sizeof(T)));
+	}
+
+	inline void deallocate(T* p, size_t n)
+	{
+		if (_arena)
+			_arena->deallocate(p, n * sizeof(T));
+		else
+			::operator delete(p);
+	}
+
+	template <class U, class... Args>
+	inline void construct(U* p, Args&&... args) { new ((void*)p) U(std::forward<Args>(args)...); }
+	template <class U>
+	inline void destroy(U* p) { p->~U(); }
+
+	inline size_t max_size() const { return (size_t)-1 / sizeof(T); }
+	inline Arena* getArena() const { return _arena; }
+
+private:
+	Arena* _arena;
+};
+
+template <class T, class U>
+inline bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.getArena() == b.getArena(); }
+template <class T, class U>
+inline bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.getArena() != b.getArena(); }
+
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char> > ArenaString;
+typedef std::basic_stringstream<char, std::char_traits<char>, ArenaAllocator<char> > ArenaStringStream;
+template <class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+};
+
+#endif //_FUSEPP_ARENA_H
@@ -0,0 +1,145 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _FUSEPP_ASYNC_H
+#define _FUSEPP_ASYNC_H
+
+#include <fusepp/Export.h>
+#include <fusepp/FileSystem.h>
+#include <memory>
+#include <stdint.h>
+
+struct fuse_req;
+
+namespace fusepp
+{
+
+// Handle on a kernel request that is answered later, possibly from another
+// thread. Copies share the same request, which must be answered once: the
+// first answer wins and the others are ignored. When the last copy goes away
+// without an answer, the request fails with EIO so that the caller is never
+// left hanging.
+// Asynchronous operations are only available in low-level mode.
+class FUSEPP_API Request
+{
+public:
+	struct State;
+
+	Request();
+	explicit Request(std::shared_ptr<State> state);
+	virtual ~Request();
+
+	// Answers with an error ('err' is a positive errno value)
+	virtual void fail(int err);
+
+	bool isPending() const;
+
+	inline const std::shared_ptr<State>& getState() const { return _state; }
+
+protected:
+	// Returns the underlying request, or NULL if it was already answered.
+	// The caller must answer it.
+	struct fuse_req* take();
+
+	std::shared_ptr<State> _state;
+};
+
+// Negative timeouts stand for the Application's default timeouts.
+
+class FUSEPP_API AttrReply : public Request
+{
+public:
+	explicit AttrReply(std::shared_ptr<State> state);
+	void reply(const struct stat& attr, double attrTimeout = -1.0);
+};
+
+class FUSEPP_API EntryReply : public Request
+{
+public:
+	explicit EntryReply(std::shared_ptr<State> state);
+	void reply(const struct stat& attr, double entryTimeout = -1.0, double attrTimeout = -1.0);
+	void fail(int err);
+};
+
+class FUSEPP_API DirectoryReply : public Request
+{
+public:
+	explicit DirectoryReply(std::shared_ptr<State> state);
+	// Entries are added to the filler, then sent with reply()
+	FS_readdir::DirectoryFiller& getFiller();
+	void reply();
+};
+
+class FUSEPP_API ReadReply : public Request
+{
+public:
+	explicit ReadReply(std::shared_ptr<State> state);
+	// The data is put in the buffer, then sent with reply(). Memory referenced
+	// by the buffer must stay valid until reply() returns.
+	ReadBuffer& getBuffer();
+	void reply();
+};
+
+
+
+// Asynchronous variants of the inode-based operations: the implementation
+// returns as soon as the work is under way and answers the request whenever
+// it is done. A few threads can then keep many backend requests in flight.
+// When a file system implements both an asynchronous and a synchronous
+// variant, the asynchronous one is used.
+
+class FUSEPP_API FS_async_lookup : public virtual FileSystem
+{
+public:
+	virtual void lookup(ino_t parent, const std::string& name, ino_t ino, EntryReply reply) = 0;
+	virtual void forget(ino_t ino);
+};
+
+
+
+class FUSEPP_API FS_async_getattr : public virtual FileSystem
+{
+public:
+	virtual void getattr(ino_t ino, AttrReply reply) = 0;
+};
+
+
+
+class FUSEPP_API FS_async_readdir : public virtual FileSystem
+{
+public:
+	virtual void readdir(ino_t ino, DirectoryReply reply) = 0;
+};
+
+
+
+class FUSEPP_API FS_async_read : public virtual FileSystem
+{
+public:
+	// 'handle' is the value set with FileInfo::setHandle() in open()
+	virtual void read(ino_t ino, off_t offset, uint64_t handle, ReadReply reply) = 0;
+};
+
+};
+
+#endif //_FUSEPP_ASYNC_H
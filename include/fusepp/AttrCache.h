@@ -0,0 +1,127 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _FUSEPP_ATTRCACHE_H
+#define _FUSEPP_ATTRCACHE_H
+
+#include <fusepp/Export.h>
+#include <fusepp/FileSystem.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <utility>
+#include <stdint.h>
+
+namespace fusepp
+{
+
+// Fixed-size cache of struct stat keyed by path. Readers never take a lock:
+// every slot is protected by a sequence counter (seqlock), readers copy the
+// slot and retry if a writer touched it meanwhile. Writers lock a single slot.
+// Slots are grouped in small buckets, and a CLOCK-style "referenced" bit picks
+// the victim when a bucket is full, so memory stays bounded. Paths longer than
+// MAX_PATH_LENGTH are not cached.
+// Every bucket counts its invalidations: a value read from the file system
+// is put with the stamp taken before reading it, and dropped if the path was
+// invalidated (or the table cleared) in between.
+class FUSEPP_API AttrCacheTable
+{
+public:
+	static const size_t MAX_PATH_LENGTH = 200;
+	static const size_t WAYS = 4;
+
+	AttrCacheTable(size_t capacity = 16384, double ttl = 1.0);
+	virtual ~AttrCacheTable();
+
+	// Changes the size and time-to-live (in seconds) of the cache, dropping
+	// its content. This is not thread-safe: call it before mounting.
+	void configure(size_t capacity, double ttl);
+
+	bool get(const std::string& path, struct stat* buf) const;
+	uint64_t getStamp(const std::string& path) const;
+	void put(const std::string& path, const struct stat& buf, uint64_t stamp);
+	// Same as above, with the current stamp
+	void put(const std::string& path, const struct stat& buf);
+	void invalidate(const std::string& path);
+	void clear();
+
+	inline size_t getCapacity() const { return _capacity; }
+	inline double getTTL() const { return _ttl; }
+
+private:
+	// Defined in the library
+	struct Slot;
+
+	size_t bucket(uint64_t hash) const;
+
+	std::unique_ptr<Slot[]> _slots;
+	std::unique_ptr<std::atomic<uint8_t>[]> _hands;
+	std::unique_ptr<std::atomic<uint32_t>[]> _invalidations;
+	size_t _capacity, _mask;
+	double _ttl;
+	int64_t _ttlNs;
+	std::atomic<uint32_t> _generation;
+
+	AttrCacheTable(const AttrCacheTable&);
+	AttrCacheTable& operator=(const AttrCacheTable&);
+};
+
+
+// Decorator that puts an AttrCacheTable in front of the getattr() of the file
+// system class FS. Every other operation is inherited from FS untouched, and
+// the constructor arguments are forwarded to FS, e.g.:
+//   FileSystemPtr fs(new AttrCache<MyFileSystem>(arg1, arg2));
+// Only successful lookups are cached.
+template <class FS>
+class AttrCache : public FS
+{
+public:
+	template <class... Args>
+	AttrCache(Args&&... args)
+		: FS(std::forward<Args>(args)...)
+	{}
+
+	using FS::getattr;
+
+	int getattr(const std::string& path, struct stat* buf)
+	{
+		if (_attrCache.get(path, buf))
+			return 0;
+		uint64_t stamp = _attrCache.getStamp(path);
+		int res = FS::getattr(path, buf);
+		if (res == 0)
+			_attrCache.put(path, *buf, stamp);
+		return res;
+	}
+
+	inline AttrCacheTable& getAttrCache() { return _attrCache; }
+
+	inline void invalidate(const std::string& path) { _attrCache.invalidate(path); }
+
+private:
+	AttrCacheTable _attrCache;
+};
+
+};
+
+#endif //_FUSEPP_ATTRCACHE_H
@@ -26,6 +26,9 @@ along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <fusepp/Export.h>
 #include <string>
+#include <memory>
+#include <tuple>
+#include <iosfwd>
 #include <stdarg.h>
 
 namespace fusepp
@@ -33,27 +36,94 @@ namespace fusepp
 
 FUSEPP_API int LastError();
 
+namespace error_detail
+{
+	// Arguments are stored by value, strings by copy: they are formatted
+	// after the throwing scope is gone
+	template <class T> struct Stored
+	{
+		typedef T type;
+		static inline const T& get(const T& value) { return value; }
+	};
+	template <> struct Stored<const char*>
+	{
+		typedef std::string type;
+		static inline const char* get(const std::string& value) { return value.c_str(); }
+	};
+	template <> struct Stored<char*> : public Stored<const char*> {};
+	template <> struct Stored<std::string> : public Stored<const char*> {};
+
+	template <unsigned int...> struct Indices {};
+	template <unsigned int N, unsigned int... Is> struct MakeIndices : public MakeIndices<N - 1, N - 1, Is...> {};
+	template <unsigned int... Is> struct MakeIndices<0, Is...> { typedef Indices<Is...> type; };
+};
+
 class FUSEPP_API Error
 {
 public:
+	// Produces the message of an error when it is first read
+	class FUSEPP_API Formatter
+	{
+	public:
+		virtual ~Formatter();
+		virtual std::string format() const = 0;
+	};
+
 	Error();
 
-	Error(const char* reason, ...);
+	// printf-style message. It is only formatted when it is read (see
+	// getReason()), so errors that are caught and handled cost no
+	// formatting. The format and the arguments are copied.
+	template <class... Args>
+	Error(const char* reason, Args... args)
+		: _formatter(std::make_shared<PrintfFormatter<Args...> >(reason, args...))
+	{
+		traced();
+	}
 
 	static Error System(const std::string& api);
 
 	virtual ~Error();
 
-	inline const std::string& getReason() const { return _reason; }
+	const std::string& getReason() const;
 
 	friend FUSEPP_API std::ostream& operator<<(std::ostream& stream, const Error& err);
 
+	// Formats right away, unlike the constructor
+	static std::string formatString(const char* format, ...);
+
 protected:
 	void set(const char* reason, ...);
 	void format(const char* in, va_list arglist);
+	void setFormatter(std::shared_ptr<const Formatter> formatter);
 
 private:
-	std::string _reason;
+	template <class... Args>
+	class PrintfFormatter : public Formatter
+	{
+	public:
+		PrintfFormatter(const char* format, Args... args)
+			: _format(format), _args(args...)
+		{}
+		std::string format() const
+		{
+			return apply(typename error_detail::MakeIndices<sizeof...(Args)>::type());
+		}
+	private:
+		template <unsigned int... Is>
+		std::string apply(error_detail::Indices<Is...>) const
+		{
+			return formatString(_format.c_str(), error_detail::Stored<Args>::get(std::get<Is>(_args))...);
+		}
+		std::string _format;
+		std::tuple<typename error_detail::Stored<Args>::type...> _args;
+	};
+
+	// Logs the error at debug level
+	void traced() const;
+
+	mutable std::string _reason;
+	mutable std::shared_ptr<const Formatter> _formatter;
 };
 
 FUSEPP_API std::ostream& operator<<(std::ostream& stream, const Error& err);
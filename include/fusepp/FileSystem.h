@@ -27,7 +27,14 @@ along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
 #include <fusepp/Export.h>
 #include <string>
 #include <sys/stat.h>
+#include <sys/types.h>
+#include <stdint.h>
 #include <memory>
+#include <vector>
+#include <utility>
+
+struct fuse_file_info;
+struct fuse_bufvec;
 
 namespace fusepp
 {
@@ -56,17 +63,301 @@ public:
 class FUSEPP_API FS_readdir : public virtual FileSystem
 {
 public:
+	// Receives the entries of a directory. There are two ways to list one:
+	// - call add(name, id) for every entry, in the same order each time; the
+	//   Application takes care of the offsets;
+	// - stream it: call add(name, id, cookie) where 'cookie' is a non-zero value
+	//   of your choice that identifies the position right after the entry.
+	//   When add() returns false the reply is full and the entry was not added:
+	//   stop there. readdir() is called again later with getOffset() set to the
+	//   cookie of the last entry that was added, and should resume after it.
+	// Both ways must not be mixed in the same listing.
+	// When the attributes of the entries are at hand, pass them to add() with
+	// a struct stat: in low-level mode, the lookups and getattr() calls the
+	// kernel issues after listing the directory are then answered from them,
+	// for 'entryTimeout' and 'attrTimeout' seconds respectively (negative
+	// values stand for the Application's timeouts). A zero cookie means the
+	// entry is part of a listing made in one go.
 	class FUSEPP_API DirectoryFiller
 	{
 	public:
 		static const ino_t INVALID_ID = (ino_t)~0;
-		DirectoryFiller();
+		DirectoryFiller(off_t offset = 0);
 		virtual ~DirectoryFiller();
 		virtual void add(const std::string& name, ino_t id = INVALID_ID) = 0;
+		virtual bool add(const std::string& name, ino_t id, off_t cookie) = 0;
+		virtual bool add(const std::string& name, const struct stat& attr, off_t cookie = 0,
+			double entryTimeout = -1.0, double attrTimeout = -1.0) = 0;
+
+		// Cookie to resume the listing from, 0 for the first call
+		inline off_t getOffset() const { return _offset; }
+
+	private:
+		off_t _offset;
 	};
 	virtual int readdir(const std::string& path, DirectoryFiller& filler) = 0;
 };
 
+
+
+// State of an open file, shared with the kernel between open() and release()
+class FUSEPP_API FileInfo
+{
+public:
+	FileInfo(struct fuse_file_info* fi);
+
+	// Flags passed to open(2)
+	int getFlags() const;
+
+	// Value set by the implementation in open(), passed back with every
+	// operation on the file
+	uint64_t getHandle() const;
+	void setHandle(uint64_t handle);
+
+	// How the kernel caches the file, chosen in open(). By default it keeps
+	// the pages it read while the file is open and drops them when the file
+	// is opened again.
+	// - keep cache: the pages survive the next open(), for content that
+	//   never changes;
+	// - direct I/O: the page cache is bypassed, reads and writes reach the
+	//   file system with the size given by the caller, for volatile content;
+	// - non-seekable: the file is a stream, lseek() and pread() fail;
+	// - parallel direct writes: the kernel may send concurrent direct writes
+	//   on the file instead of serializing them. This needs libfuse 3.15:
+	//   with older versions, asking for it returns false and changes nothing.
+	bool getKeepCache() const;
+	void setKeepCache(bool keep);
+	bool getDirectIO() const;
+	void setDirectIO(bool direct);
+	bool getNonSeekable() const;
+	void setNonSeekable(bool nonSeekable);
+	bool setParallelDirectWrites(bool parallel);
+
+	inline struct fuse_file_info* get() const { return _fi; }
+
+private:
+	struct fuse_file_info* _fi;
+};
+
+
+
+// Destination of a read. Implementations fill it with segments, up to
+// getSize() bytes in total; bytes beyond that are ignored. To keep data from
+// being copied through user space, a segment can be taken from a file
+// descriptor (libfuse splices it to /dev/fuse) or from memory the
+// implementation already owns.
+class FUSEPP_API ReadBuffer
+{
+public:
+	struct Segment
+	{
+		void* mem;
+		int fd;
+		off_t pos;
+		size_t size;
+		bool owned;
+	};
+
+	ReadBuffer(size_t size, bool canReference);
+	virtual ~ReadBuffer();
+
+	inline size_t getSize() const { return _size; }
+	inline size_t getFilled() const { return _filled; }
+
+	// Appends a segment that the caller fills in, of 'size' bytes or of the
+	// room left if that is less. 'granted' receives its size. Returns NULL
+	// (and 0 in 'granted') when the buffer is already full.
+	void* allocate(size_t size, size_t& granted);
+
+	// Takes ownership of 'data', which must come from malloc(). Returns the
+	// number of bytes that fit in the buffer; 'data' is freed right away
+	// when none does.
+	size_t adopt(void* data, size_t size);
+
+	// Appends memory kept alive by 'owner'. The memory is referenced directly
+	// in low-level mode; the high-level API of libfuse requires segments it
+	// can free(), so it is copied there.
+	void reference(const void* data, size_t size, std::shared_ptr<const void> owner);
+
+	// Appends 'size' bytes read from 'fd' at position 'pos'. The descriptor
+	// must stay open until the reply was sent.
+	void splice(int fd, off_t pos, size_t size);
+
+	inline const std::vector<Segment>& getSegments() const { return _segments; }
+
+	// Describes the segments in 'bufv', which must have room for
+	// max(1, getSegments().size()) buffers
+	void toBufvec(struct fuse_bufvec* bufv) const;
+
+	// Gives up the ownership of the allocated segments (libfuse frees them
+	// itself in high-level mode)
+	void detach();
+
+private:
+	size_t clamp(size_t size) const;
+
+	size_t _size, _filled;
+	bool _canReference;
+	std::vector<Segment> _segments;
+	std::vector<std::shared_ptr<const void> > _owners;
+
+	ReadBuffer(const ReadBuffer&);
+	ReadBuffer& operator=(const ReadBuffer&);
+};
+
+
+
+// Source of a write. The data may still be in the kernel pipe it was
+// spliced into, so it is only copied when the implementation asks for it.
+class FUSEPP_API WriteBuffer
+{
+public:
+	WriteBuffer(struct fuse_bufvec* bufv);
+
+	// Number of bytes not consumed yet
+	size_t getSize() const;
+
+	// Returns the data if it is held in a single memory segment, NULL
+	// otherwise. This does not consume anything.
+	const void* getData() const;
+
+	// Consumes up to 'size' bytes into 'dst'. Returns the number of bytes
+	// copied or a negative errno.
+	ssize_t copyTo(void* dst, size_t size);
+
+	// Consumes all the data into 'fd' at position 'pos', with splice() when
+	// both ends allow it. Returns the number of bytes written or a negative errno.
+	ssize_t spliceTo(int fd, off_t pos);
+
+private:
+	struct fuse_bufvec* _bufv;
+};
+
+
+
+// open() may choose a handle and the cache policy of the file (see FileInfo)
+class FUSEPP_API FS_open : public virtual FileSystem
+{
+public:
+	virtual int open(const std::string& path, FileInfo& fi) = 0;
+	virtual int release(const std::string& path, FileInfo& fi);
+};
+
+
+
+class FUSEPP_API FS_read : public virtual FileSystem
+{
+public:
+	// Fills 'buf' with the data at 'offset'. Returns 0 or a negative errno;
+	// the number of bytes read is the size of 'buf'.
+	virtual int read(const std::string& path, ReadBuffer& buf, off_t offset, FileInfo& fi) = 0;
+};
+
+
+
+class FUSEPP_API FS_write : public virtual FileSystem
+{
+public:
+	// Writes the content of 'buf' at 'offset'. Returns the number of bytes
+	// written or a negative errno.
+	virtual int write(const std::string& path, WriteBuffer& buf, off_t offset, FileInfo& fi) = 0;
+};
+
+
+
+// Called when a descriptor of the file is closed (flush), which may happen
+// several times per open(), and on fsync(2). Writes the Application held back
+// (see Application::setWriteCoalescing) are done before either is called.
+class FUSEPP_API FS_flush : public virtual FileSystem
+{
+public:
+	virtual int flush(const std::string& path, FileInfo& fi) = 0;
+	// Calls flush() by default
+	virtual int fsync(const std::string& path, bool datasync, FileInfo& fi);
+};
+
+
+
+// Extended attributes (see xattr(7)). Names carry their namespace prefix
+// ("user.", "trusted."...) and values may hold any bytes. An attribute that
+// does not exist is -ENODATA; the Application takes care of the size probes
+// and ERANGE checks of the kernel. XattrCache answers repeated calls from
+// memory.
+class FUSEPP_API FS_getxattr : public virtual FileSystem
+{
+public:
+	virtual int getxattr(const std::string& path, const std::string& name, std::string& value) = 0;
+};
+
+
+
+class FUSEPP_API FS_listxattr : public virtual FileSystem
+{
+public:
+	typedef std::vector<std::pair<std::string, std::string> > Xattrs;
+
+	// Receives the extended attributes of the entries of a directory
+	class FUSEPP_API XattrFiller
+	{
+	public:
+		virtual ~XattrFiller();
+		// All the attributes of entry 'name': those not given do not exist
+		virtual void add(const std::string& name, const Xattrs& xattrs) = 0;
+	};
+
+	virtual int listxattr(const std::string& path, std::vector<std::string>& names) = 0;
+
+	// Gives the attributes of all the entries of directory 'path' at once,
+	// typically from the query that lists it. XattrCache calls it when the
+	// directory is listed, so that the calls tools make on every file
+	// afterwards are answered from memory. Returns -ENOSYS by default.
+	virtual int listxattrs(const std::string& path, XattrFiller& filler);
+};
+
+
+
+class FUSEPP_API FS_setxattr : public virtual FileSystem
+{
+public:
+	// 'flags' is XATTR_CREATE, XATTR_REPLACE or 0
+	virtual int setxattr(const std::string& path, const std::string& name, const std::string& value, int flags) = 0;
+	// Returns -ENOTSUP by default
+	virtual int removexattr(const std::string& path, const std::string& name);
+};
+
+
+
+// The following interfaces are used when the Application runs in low-level
+// mode. Inode numbers are allocated by the Application (see InodeTable) and
+// passed to the implementation instead of paths; when an implementation only
+// provides the path-based interfaces above, the Application rebuilds paths
+// from its inode table instead.
+
+class FUSEPP_API FS_lookup : public virtual FileSystem
+{
+public:
+	// Resolves 'name' in directory 'parent'. 'ino' is the inode number the
+	// Application assigned to the entry; it stays valid until forget(ino).
+	virtual int lookup(ino_t parent, const std::string& name, ino_t ino, struct stat* buf) = 0;
+	virtual void forget(ino_t ino);
+};
+
+
+
+class FUSEPP_API FS_inode_getattr : public virtual FileSystem
+{
+public:
+	virtual int getattr(ino_t ino, struct stat* buf) = 0;
+};
+
+
+
+class FUSEPP_API FS_inode_readdir : public virtual FileSystem
+{
+public:
+	virtual int readdir(ino_t ino, FS_readdir::DirectoryFiller& filler) = 0;
+};
+
 };
 
 #endif //_FUSEPP_FILESYSTEM_H
@@ -0,0 +1,200 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _FUSEPP_HANDLETABLE_H
+#define _FUSEPP_HANDLETABLE_H
+
+#include <fusepp/Export.h>
+#include <fusepp/Error.h>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <stdint.h>
+
+namespace fusepp
+{
+
+// Objects of type T identified by 64-bit handles, meant for the state of
+// open files: open() creates the object and passes its handle to
+// FileInfo::setHandle(), the following operations get() it back, release()
+// destroys it. For example:
+//   fi.setHandle(_files.create(rowId, header));
+//   ...
+//   OpenRow* row = _files.get(fi.getHandle());
+// Objects live in slots allocated by pages of PAGE_SIZE, which are reused
+// and never moved, so get() costs two loads and takes no lock; create() and
+// destroy() lock the table but only allocate when every slot is taken. A
+// handle carries the generation of its slot, so a handle whose object was
+// destroyed is refused (get() returns NULL) even once the slot is reused.
+// get() must not race with the destruction of the same object, which the
+// kernel guarantees by sending release() last.
+// The file system owns its table, the Application keeps one of its own for
+// the files whose writes it coalesces or reads it anticipates: the handles
+// the file system sets are the ones it gets back.
+template <class T>
+class HandleTable
+{
+public:
+	static const size_t PAGE_SIZE = 256;
+	static const size_t MAX_PAGES = 4096;
+
+	HandleTable()
+		: _free(NONE), _used(0), _size(0)
+	{
+		for (size_t i = 0; i < MAX_PAGES; ++i)
+			_pages[i].store(NULL, std::memory_order_relaxed);
+	}
+
+	virtual ~HandleTable()
+	{
+		for (size_t i = 0; i < MAX_PAGES; ++i)
+		{
+			Slot* page = _pages[i].load(std::memory_order_relaxed);
+			if (!page)
+				break;
+			for (size_t j = 0; j < PAGE_SIZE; ++j)
+				if (page[j].generation.load(std::memory_order_relaxed) & 1)
+					page[j].object()->~T();
+			delete[] page;
+		}
+	}
+
+	// Constructs a T from 'args' and returns its handle, which is never 0.
+	// Throws a fusepp::Error when the table is full.
+	template <class... Args>
+	uint64_t create(Args&&... args)
+	{
+		uint32_t index = take();
+		Slot& slot(at(index));
+		try {
+			new (&slot.storage) T(std::forward<Args>(args)...);
+		} catch (...) {
+			give(index);
+			throw;
+		}
+		uint32_t generation = slot.generation.load(std::memory_order_relaxed) + 1;
+		slot.generation.store(generation, std::memory_order_release);
+		return ((uint64_t)generation << 32) | index;
+	}
+
+	// The object of 'handle', or NULL if it was destroyed or never existed
+	inline T* get(uint64_t handle) const
+	{
+		uint32_t index = (uint32_t)handle;
+		if (index >= PAGE_SIZE * MAX_PAGES)
+			return NULL;
+		const Slot* page = _pages[index / PAGE_SIZE].load(std::memory_order_acquire);
+		if (!page)
+			return NULL;
+		const Slot& slot(page[index % PAGE_SIZE]);
+		uint32_t generation = (uint32_t)(handle >> 32);
+		if (!(generation & 1) || slot.generation.load(std::memory_order_acquire) != generation)
+			return NULL;
+		return const_cast<Slot&>(slot).object();
+	}
+
+	// Destroys the object of 'handle'. Returns false if there is none.
+	bool destroy(uint64_t handle)
+	{
+		uint32_t index = (uint32_t)handle;
+		T* object = NULL;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			object = get(handle);
+			if (!object)
+				return false;
+			// From now on, get() refuses the handle
+			at(index).generation.fetch_add(1, std::memory_order_release);
+		}
+		// The destructor may take time: the slot is only reused afterwards
+		object->~T();
+		give(index);
+		return true;
+	}
+
+	// Number of live objects
+	inline size_t getSize() const { return _size.load(std::memory_order_relaxed); }
+
+private:
+	static const uint32_t NONE = 0xffffffff;
+
+	struct Slot
+	{
+		Slot() : generation(0), next(NONE) {}
+		inline T* object() { return reinterpret_cast<T*>(&storage); }
+
+		// Odd while the slot holds an object
+		std::atomic<uint32_t> generation;
+		uint32_t next;
+		typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type storage;
+	};
+
+	inline Slot& at(uint32_t index) const
+	{
+		return _pages[index / PAGE_SIZE].load(std::memory_order_relaxed)[index % PAGE_SIZE];
+	}
+
+	uint32_t take()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_free == NONE)
+		{
+			if (_used == PAGE_SIZE * MAX_PAGES)
+				throw Error("fusepp::HandleTable::create() : too many handles (%u)", (unsigned int)_used);
+			if (_used % PAGE_SIZE == 0)
+				_pages[_used / PAGE_SIZE].store(new Slot[PAGE_SIZE], std::memory_order_release);
+			_free = _used++;
+		}
+		uint32_t index = _free;
+		_free = at(index).next;
+		_size.fetch_add(1, std::memory_order_relaxed);
+		return index;
+	}
+
+	void give(uint32_t index)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		at(index).next = _free;
+		_free = index;
+		_size.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	std::mutex _mutex;
+	uint32_t _free;
+	uint32_t _used;
+	std::atomic<size_t> _size;
+	std::atomic<Slot*> _pages[MAX_PAGES];
+
+	HandleTable(const HandleTable&);
+	HandleTable& operator=(const HandleTable&);
+};
+
+template <class T> const size_t HandleTable<T>::PAGE_SIZE;
+template <class T> const size_t HandleTable<T>::MAX_PAGES;
+template <class T> const uint32_t HandleTable<T>::NONE;
+
+};
+
+#endif //_FUSEPP_HANDLETABLE_H
@@ -0,0 +1,142 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _FUSEPP_INODETABLE_H
+#define _FUSEPP_INODETABLE_H
+
+#include <fusepp/Export.h>
+#include <string>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <mutex>
+#include <unordered_map>
+
+namespace fusepp
+{
+
+// Maps the inode numbers handed to the kernel in low-level mode to the
+// (parent, name) pairs they were looked up with. Inode numbers are allocated
+// by the table and never reused during the lifetime of a mount; an inode is
+// dropped once the kernel has forgotten all of its lookups and it has no
+// remembered children left.
+class FUSEPP_API InodeTable
+{
+public:
+	static const ino_t ROOT = 1;
+
+	InodeTable();
+	virtual ~InodeTable();
+
+	// Returns the inode of 'name' in directory 'parent', creating it if needed,
+	// and increments its lookup count. Returns 0 if 'parent' is unknown.
+	ino_t lookup(ino_t parent, const std::string& name);
+
+	// Decrements the lookup count of 'ino' by 'nlookup'. Returns true when the
+	// inode was dropped from the table as a consequence.
+	bool forget(ino_t ino, uint64_t nlookup);
+
+	// Finds the inode of 'name' in 'parent' without touching its lookup count
+	bool find(ino_t parent, const std::string& name, ino_t& ino) const;
+
+	// Rebuilds the absolute path of 'ino' (e.g. "/a/b"). Returns false if the
+	// inode is unknown.
+	bool path(ino_t ino, std::string& path) const;
+
+	size_t size() const;
+
+	// Remembers the attributes of 'name' in 'parent' obtained ahead of its
+	// lookup, typically while listing 'parent'. They are valid for
+	// 'entryTimeout' seconds and at most MAX_PRIMED entries are kept.
+	void prime(ino_t parent, const std::string& name, const struct stat& attr, double entryTimeout, double attrTimeout);
+
+	// Consumes the primed attributes of 'name' in 'parent', if still valid
+	bool takePrimed(ino_t parent, const std::string& name, struct stat& attr, double& entryTimeout, double& attrTimeout);
+
+	// Attributes of an inode that was looked up from primed attributes, valid
+	// until the attribute timeout given to prime() expires
+	bool getAttr(ino_t ino, struct stat& attr, double& attrTimeout) const;
+
+	// Forgets the primed attributes of 'name' in 'parent', and those
+	// remembered for 'ino', when the file system knows they changed
+	void dropPrimed(ino_t parent, const std::string& name);
+	void dropAttr(ino_t ino);
+
+	static const size_t MAX_PRIMED = 65536;
+
+private:
+	struct Node
+	{
+		Node() : parent(0), nlookup(0), children(0), attrExpires(0) {}
+		ino_t parent;
+		std::string name;
+		uint64_t nlookup;
+		size_t children;
+		struct stat attr;
+		int64_t attrExpires;
+		double attrTimeout;
+	};
+
+	struct NameKey
+	{
+		NameKey(ino_t parent, const std::string& name) : parent(parent), name(name) {}
+		bool operator==(const NameKey& other) const { return parent == other.parent && name == other.name; }
+		ino_t parent;
+		std::string name;
+	};
+
+	struct NameKeyHash
+	{
+		size_t operator()(const NameKey& key) const
+		{
+			return std::hash<std::string>()(key.name) ^ (std::hash<uint64_t>()(key.parent) * 31);
+		}
+	};
+
+	struct Primed
+	{
+		struct stat attr;
+		int64_t expires;
+		double entryTimeout, attrTimeout;
+	};
+
+	typedef std::unordered_map<ino_t,Node> Nodes;
+	typedef std::unordered_map<NameKey,ino_t,NameKeyHash> Names;
+	typedef std::unordered_map<NameKey,Primed,NameKeyHash> PrimedEntries;
+
+	void release(ino_t ino);
+
+	// Key to search the tables with, built in a string of the calling thread
+	// that keeps its capacity, so that searching does not allocate
+	static const NameKey& searchKey(ino_t parent, const std::string& name);
+
+	mutable std::mutex _mutex;
+	Nodes _nodes;
+	Names _names;
+	PrimedEntries _primed;
+	ino_t _next;
+};
+
+};
+
+#endif //_FUSEPP_INODETABLE_H
@@ -0,0 +1,140 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _FUSEPP_LOCKMANAGER_H
+#define _FUSEPP_LOCKMANAGER_H
+
+#include <fusepp/Export.h>
+#include <string>
+#include <sys/types.h>
+#include <stdint.h>
+
+namespace fusepp
+{
+
+// Locks for file systems whose operations run concurrently. Paths are
+// hashed onto a fixed number of stripes, each a reader/writer lock on a
+// cache line of its own: operations on different paths seldom share a
+// stripe, and never share a cache line. Byte ranges of the content of a
+// file are locked in shards of the same kind, so that writes to different
+// files, or to disjoint ranges of a file, do not wait for each other.
+// Locks that have to wait are counted in Stats::LOCK_CONTENDED and
+// Stats::LOCK_WAIT_NANOS. None of them is recursive, and distinct paths may
+// share a stripe: a thread that locks two paths one after the other can
+// deadlock with itself. Lock both at once with lock(a, b) instead.
+class FUSEPP_API LockManager
+{
+public:
+	static const size_t DEFAULT_STRIPES = 256;
+	static const size_t CACHE_LINE = 64;
+
+	// 'stripes' is rounded up to a power of 2
+	LockManager(size_t stripes = DEFAULT_STRIPES);
+	virtual ~LockManager();
+
+	void lock(const std::string& path);
+	void unlock(const std::string& path);
+	void lockShared(const std::string& path);
+	void unlockShared(const std::string& path);
+
+	// Both paths exclusively (e.g. both ends of a rename), in an order that
+	// cannot deadlock with another thread locking them
+	void lock(const std::string& a, const std::string& b);
+	void unlock(const std::string& a, const std::string& b);
+
+	// The bytes of the content of 'path' from 'offset', for 'length' bytes
+	// (0 up to the end of the file). Shared ranges may overlap each other;
+	// an exclusive range waits until no overlapping range is held. Unlocking
+	// takes the same arguments as locking.
+	void lockRange(const std::string& path, off_t offset, off_t length, bool exclusive);
+	void unlockRange(const std::string& path, off_t offset, off_t length, bool exclusive);
+
+	inline size_t getStripes() const { return _mask + 1; }
+
+private:
+	friend class PathLock;
+	struct Stripe;
+	struct RangeShard;
+
+	size_t stripe(const std::string& path) const;
+	void lockStripe(size_t index, bool exclusive);
+	void unlockStripe(size_t index);
+
+	void* _memory;
+	Stripe* _stripes;
+	RangeShard* _ranges;
+	size_t _mask;
+
+	LockManager(const LockManager&);
+	LockManager& operator=(const LockManager&);
+};
+
+// Holds the lock of a path for its lifetime
+class PathLock
+{
+public:
+	inline PathLock(LockManager& manager, const std::string& path, bool exclusive = true)
+		: _manager(manager), _stripe(manager.stripe(path))
+	{
+		manager.lockStripe(_stripe, exclusive);
+	}
+	inline ~PathLock()
+	{
+		_manager.unlockStripe(_stripe);
+	}
+
+private:
+	LockManager& _manager;
+	size_t _stripe;
+
+	PathLock(const PathLock&);
+	PathLock& operator=(const PathLock&);
+};
+
+// Holds a byte range of a file for its lifetime
+class RangeLock
+{
+public:
+	inline RangeLock(LockManager& manager, const std::string& path, off_t offset, off_t length, bool exclusive = true)
+		: _manager(manager), _path(path), _offset(offset), _length(length), _exclusive(exclusive)
+	{
+		manager.lockRange(path, offset, length, exclusive);
+	}
+	inline ~RangeLock()
+	{
+		_manager.unlockRange(_path, _offset, _length, _exclusive);
+	}
+
+private:
+	LockManager& _manager;
+	const std::string _path;
+	off_t _offset, _length;
+	bool _exclusive;
+
+	RangeLock(const RangeLock&);
+	RangeLock& operator=(const RangeLock&);
+};
+
+};
+
+#endif //_FUSEPP_LOCKMANAGER_H
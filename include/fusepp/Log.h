@@ -0,0 +1,91 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _FUSEPP_LOG_H
+#define _FUSEPP_LOG_H
+
+#include <fusepp/Export.h>
+#include <atomic>
+
+namespace fusepp
+{
+
+// Logging facility for code that runs while serving requests. Messages are
+// formatted by the calling thread into a ring buffer of its own, without
+// taking any lock, and written to stderr by a background thread. Messages of
+// a disabled level cost a relaxed load and a comparison: use the FUSEPP_LOG_*
+// macros below, which do not even evaluate the arguments in that case.
+// When a thread logs faster than the messages can be written, the excess is
+// dropped and counted.
+class FUSEPP_API Log
+{
+public:
+	enum Level
+	{
+		LEVEL_DEBUG,
+		LEVEL_INFO,
+		LEVEL_WARNING,
+		LEVEL_ERROR,
+		// Disables logging altogether
+		LEVEL_NONE,
+	};
+
+	// Messages below the current level (LEVEL_INFO by default) are discarded
+	static inline bool isEnabled(Level level) { return level >= _s_level.load(std::memory_order_relaxed); }
+	static inline Level getLevel() { return static_cast<Level>(_s_level.load(std::memory_order_relaxed)); }
+	static void setLevel(Level level);
+
+	// Queues a message (printf-style format). Messages longer than
+	// MAX_MESSAGE_LENGTH are truncated.
+	static void write(Level level, const char* format, ...)
+#ifdef __GNUC__
+		__attribute__((format(printf, 2, 3)))
+#endif
+		;
+
+	// Waits until the messages queued so far have been written
+	static void flush();
+
+	// Number of messages dropped because a ring buffer was full
+	static unsigned long getDropped();
+
+	static const unsigned int MAX_MESSAGE_LENGTH = 240;
+
+private:
+	static std::atomic<int> _s_level;
+};
+
+};
+
+#define FUSEPP_LOG(level, ...) \
+	do { \
+		if (fusepp::Log::isEnabled(level)) \
+			fusepp::Log::write(level, __VA_ARGS__); \
+	} while (0)
+
+#define FUSEPP_LOG_DEBUG(...) FUSEPP_LOG(fusepp::Log::LEVEL_DEBUG, __VA_ARGS__)
+#define FUSEPP_LOG_INFO(...) FUSEPP_LOG(fusepp::Log::LEVEL_INFO, __VA_ARGS__)
+#define FUSEPP_LOG_WARNING(...) FUSEPP_LOG(fusepp::Log::LEVEL_WARNING, __VA_ARGS__)
+#define FUSEPP_LOG_ERROR(...) FUSEPP_LOG(fusepp::Log::LEVEL_ERROR, __VA_ARGS__)
+
+#endif //_FUSEPP_LOG_H
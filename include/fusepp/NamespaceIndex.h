@@ -0,0 +1,121 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _FUSEPP_NAMESPACEINDEX_H
+#define _FUSEPP_NAMESPACEINDEX_H
+
+#include <fusepp/Export.h>
+#include <fusepp/FileSystem.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <stdint.h>
+
+namespace fusepp
+{
+
+// In-memory tree of paths with their attributes, for file systems that keep
+// their namespace (or a copy of it) in memory. Every directory holds its
+// entries in a hash table keyed by name, so that resolving a path costs one
+// probe per component whatever the size of the directories. Probes compare
+// a 7-bit tag of 16 entries at once with SSE2, and names are hashed 8 bytes
+// at a time, with the CRC32 instruction when the CPU has SSE4.2.
+// Lookups take no lock: entries and tables are published with atomic
+// stores and freed only once no reader may still see them (epoch-based
+// reclamation). Changes are serialized by a mutex, which suits namespaces
+// that are read far more often than they change. Up to MAX_READERS threads
+// get a slot of their own to announce their reads in; the others share one,
+// which holds memory back until none of them is reading.
+class FUSEPP_API NamespaceIndex
+{
+public:
+	static const size_t MAX_READERS = 1024;
+
+	// The root exists from the start, as a directory with mode 0755
+	NamespaceIndex();
+	virtual ~NamespaceIndex();
+
+	// Adds 'path' or replaces its attributes; 'data' is a value of the
+	// caller's choice kept along (e.g. a database key). The parent must
+	// exist and be a directory. Returns 0, -ENOENT, -ENOTDIR, -EINVAL for a
+	// relative path, or -ENOTEMPTY when a directory with entries would stop
+	// being one.
+	int insert(const std::string& path, const struct stat& attr, uint64_t data = 0);
+	// Returns 0, -ENOENT, -ENOTEMPTY, or -EBUSY for the root
+	int remove(const std::string& path);
+	// Moves 'from', with everything below it, to 'to', which must not
+	// exist. Readers may see the entry at both paths while it moves.
+	// Returns 0, -ENOENT, -ENOTDIR, -EEXIST, -EINVAL (moving a directory
+	// below itself) or -EBUSY for the root.
+	int rename(const std::string& from, const std::string& to);
+	// Removes everything but the root
+	void clear();
+
+	// Lock-free. Return 0, -ENOENT, or -ENOTDIR when a component of the
+	// path is not a directory.
+	int getattr(const std::string& path, struct stat* buf, uint64_t* data = NULL) const;
+	int lookup(const std::string& parent, const std::string& name, struct stat* buf, uint64_t* data = NULL) const;
+	// Lists the entries of directory 'path' with their attributes, streamed
+	// in the order of the hashes of their names: the cookies stay valid when
+	// the directory changes or its table grows. Two names whose hashes
+	// agree on 62 bits share a cookie, and the second is skipped if a reply
+	// ends between them.
+	int readdir(const std::string& path, FS_readdir::DirectoryFiller& filler) const;
+
+	// Number of entries, the root excluded
+	inline size_t getSize() const { return _size.load(std::memory_order_relaxed); }
+
+private:
+	struct Node;
+	struct Table;
+	struct Retired
+	{
+		void* object;
+		void (*destroy)(void*);
+		uint64_t epoch;
+	};
+
+	// Resolves 'path', up to its last component when 'parent' is set (the
+	// name of the last component is then left in 'name'/'length')
+	int walk(const std::string& path, bool parent, const Node*& node, const char*& name, size_t& length) const;
+
+	// Writer side, with _mutex held
+	void publish(Node* parent, Node* node);
+	void unlink(Node* parent, Node* node);
+	void retire(void* object, void (*destroy)(void*));
+	void reclaim();
+
+	Node* _root;
+	std::mutex _mutex;
+	std::atomic<size_t> _size;
+	std::vector<Retired> _retired;
+
+	NamespaceIndex(const NamespaceIndex&);
+	NamespaceIndex& operator=(const NamespaceIndex&);
+};
+
+};
+
+#endif //_FUSEPP_NAMESPACEINDEX_H
@@ -0,0 +1,139 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _FUSEPP_NEGATIVECACHE_H
+#define _FUSEPP_NEGATIVECACHE_H
+
+#include <fusepp/Export.h>
+#include <fusepp/FileSystem.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <errno.h>
+#include <stdint.h>
+
+namespace fusepp
+{
+
+// Fixed-size, time-bounded set of paths known not to exist. A Bloom filter
+// sits in front of it, so that paths never reported missing are rejected
+// after reading a single word; the others are checked against the exact
+// table, whose slots are protected by sequence counters like those of
+// AttrCacheTable. Bits cannot be removed from the filter, so it is reset
+// (along with the table) once it has seen twice as many paths as the table
+// holds, which keeps its false-positive rate bounded. There are two filters,
+// used by every other generation of the table: the next one is emptied
+// before its generation starts, never while it is being filled. Paths longer
+// than MAX_PATH_LENGTH are not cached.
+// As in AttrCacheTable, a path reported missing is put with the stamp taken
+// before asking the file system, and dropped if it was created meanwhile.
+class FUSEPP_API NegativeCacheTable
+{
+public:
+	static const size_t MAX_PATH_LENGTH = 200;
+	static const size_t WAYS = 4;
+
+	NegativeCacheTable(size_t capacity = 4096, double ttl = 1.0);
+	virtual ~NegativeCacheTable();
+
+	// Changes the size and time-to-live (in seconds) of the cache, dropping
+	// its content. This is not thread-safe: call it before mounting.
+	void configure(size_t capacity, double ttl);
+
+	bool contains(const std::string& path) const;
+	uint64_t getStamp(const std::string& path) const;
+	void put(const std::string& path, uint64_t stamp);
+	// Same as above, with the current stamp
+	void put(const std::string& path);
+	// Must be called when 'path' is created
+	void invalidate(const std::string& path);
+	void clear();
+
+	inline size_t getCapacity() const { return _capacity; }
+	inline double getTTL() const { return _ttl; }
+
+private:
+	// Defined in the library
+	struct Slot;
+
+	bool mayContain(uint64_t hash, uint32_t generation) const;
+	size_t bucket(uint64_t hash) const;
+
+	std::unique_ptr<Slot[]> _slots;
+	std::unique_ptr<std::atomic<uint64_t>[]> _filters[2];
+	std::unique_ptr<std::atomic<uint32_t>[]> _invalidations;
+	size_t _capacity, _mask, _filterMask;
+	double _ttl;
+	int64_t _ttlNs;
+	std::atomic<uint32_t> _generation;
+	std::atomic<size_t> _inserted;
+	std::mutex _clearing;
+
+	NegativeCacheTable(const NegativeCacheTable&);
+	NegativeCacheTable& operator=(const NegativeCacheTable&);
+};
+
+
+// Decorator answering the getattr() of the file system class FS with ENOENT,
+// without calling it, for the paths it recently reported missing. Like
+// AttrCache, it forwards its constructor arguments to FS and can be stacked
+// with it:
+//   FileSystemPtr fs(new NegativeCache<AttrCache<MyFileSystem> >(arg1));
+// In low-level mode, Application::setNegativeTimeout() additionally lets the
+// kernel remember the missing names.
+template <class FS>
+class NegativeCache : public FS
+{
+public:
+	template <class... Args>
+	NegativeCache(Args&&... args)
+		: FS(std::forward<Args>(args)...)
+	{}
+
+	using FS::getattr;
+
+	int getattr(const std::string& path, struct stat* buf)
+	{
+		if (_negativeCache.contains(path))
+			return -ENOENT;
+		uint64_t stamp = _negativeCache.getStamp(path);
+		int res = FS::getattr(path, buf);
+		if (res == -ENOENT)
+			_negativeCache.put(path, stamp);
+		return res;
+	}
+
+	inline NegativeCacheTable& getNegativeCache() { return _negativeCache; }
+
+	// To be called by the file system when it creates 'path'
+	inline void invalidateNegative(const std::string& path) { _negativeCache.invalidate(path); }
+
+private:
+	NegativeCacheTable _negativeCache;
+};
+
+};
+
+#endif //_FUSEPP_NEGATIVECACHE_H
@@ -0,0 +1,206 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _FUSEPP_OPERATIONS_H
+#define _FUSEPP_OPERATIONS_H
+
+#include <fusepp/Export.h>
+#include <fusepp/FileSystem.h>
+#include <fusepp/Async.h>
+#include <fusepp/Worker.h>
+#include <type_traits>
+#include <memory>
+
+namespace fusepp
+{
+
+// Table of the operations implemented by a file system. It is bound once
+// when the Application is created, so that hooks never have to find out
+// which FS_* interfaces are implemented while serving a request. A slot is
+// NULL when the operation is not implemented; otherwise it is called with
+// 'target' as its first argument.
+struct FUSEPP_API Operations
+{
+	Operations();
+
+	void* target;
+
+	int (*getattr)(void* target, const std::string& path, struct stat* buf);
+	int (*readdir)(void* target, const std::string& path, FS_readdir::DirectoryFiller& filler);
+	int (*lookup)(void* target, ino_t parent, const std::string& name, ino_t ino, struct stat* buf);
+	void (*forget)(void* target, ino_t ino);
+	int (*inode_getattr)(void* target, ino_t ino, struct stat* buf);
+	int (*inode_readdir)(void* target, ino_t ino, FS_readdir::DirectoryFiller& filler);
+	int (*open)(void* target, const std::string& path, FileInfo& fi);
+	int (*release)(void* target, const std::string& path, FileInfo& fi);
+	int (*read)(void* target, const std::string& path, ReadBuffer& buf, off_t offset, FileInfo& fi);
+	int (*write)(void* target, const std::string& path, WriteBuffer& buf, off_t offset, FileInfo& fi);
+	int (*flush)(void* target, const std::string& path, FileInfo& fi);
+	int (*fsync)(void* target, const std::string& path, bool datasync, FileInfo& fi);
+	int (*getxattr)(void* target, const std::string& path, const std::string& name, std::string& value);
+	int (*listxattr)(void* target, const std::string& path, std::vector<std::string>& names);
+	int (*setxattr)(void* target, const std::string& path, const std::string& name, const std::string& value, int flags);
+	int (*removexattr)(void* target, const std::string& path, const std::string& name);
+	void (*async_lookup)(void* target, ino_t parent, const std::string& name, ino_t ino, EntryReply reply);
+	void (*async_getattr)(void* target, ino_t ino, AttrReply reply);
+	void (*async_readdir)(void* target, ino_t ino, DirectoryReply reply);
+	void (*async_read)(void* target, ino_t ino, off_t offset, uint64_t handle, ReadReply reply);
+	WorkerContext* (*worker_context)(void* target);
+
+	// Binds the operations through the FS_* interfaces. This costs one
+	// virtual call per operation, and works with any FileSystem.
+	static Operations bindDynamic(FileSystemPtr fs);
+
+	// Keeps 'target' alive as long as the table (used by bindDynamic)
+	std::shared_ptr<void> holder;
+};
+
+
+// Binds the operations of the concrete file system class FS at compile time.
+// Interfaces are detected with type traits and the implementation is called
+// with a qualified name, so the compiler can inline it into the hook. FS must
+// be the most derived class of the object: overrides in subclasses of FS are
+// not seen.
+template <class FS>
+struct Binder
+{
+	static Operations bind(FS* fs);
+};
+
+#define FUSEPP_IMPLEMENTS(iface) std::is_base_of<iface, FS>::value
+
+#define FUSEPP_BIND_OPERATION(name, implemented, ret, proto, args) \
+	template <class FS, bool = (implemented)> \
+	struct Bind_##name \
+	{ \
+		static void bind(Operations& ops) { ops.name = NULL; } \
+	}; \
+	template <class FS> \
+	struct Bind_##name<FS, true> \
+	{ \
+		static ret call proto { return static_cast<FS*>(target)->FS::args; } \
+		static void bind(Operations& ops) { ops.name = &call; } \
+	};
+
+namespace binder
+{
+	FUSEPP_BIND_OPERATION(getattr, FUSEPP_IMPLEMENTS(FS_getattr), int,
+		(void* target, const std::string& path, struct stat* buf),
+		getattr(path, buf))
+	FUSEPP_BIND_OPERATION(readdir, FUSEPP_IMPLEMENTS(FS_readdir), int,
+		(void* target, const std::string& path, FS_readdir::DirectoryFiller& filler),
+		readdir(path, filler))
+	FUSEPP_BIND_OPERATION(lookup, FUSEPP_IMPLEMENTS(FS_lookup), int,
+		(void* target, ino_t parent, const std::string& name, ino_t ino, struct stat* buf),
+		lookup(parent, name, ino, buf))
+	FUSEPP_BIND_OPERATION(forget, FUSEPP_IMPLEMENTS(FS_lookup) || FUSEPP_IMPLEMENTS(FS_async_lookup), void,
+		(void* target, ino_t ino),
+		forget(ino))
+	FUSEPP_BIND_OPERATION(inode_getattr, FUSEPP_IMPLEMENTS(FS_inode_getattr), int,
+		(void* target, ino_t ino, struct stat* buf),
+		getattr(ino, buf))
+	FUSEPP_BIND_OPERATION(inode_readdir, FUSEPP_IMPLEMENTS(FS_inode_readdir), int,
+		(void* target, ino_t ino, FS_readdir::DirectoryFiller& filler),
+		readdir(ino, filler))
+	FUSEPP_BIND_OPERATION(open, FUSEPP_IMPLEMENTS(FS_open), int,
+		(void* target, const std::string& path, FileInfo& fi),
+		open(path, fi))
+	FUSEPP_BIND_OPERATION(release, FUSEPP_IMPLEMENTS(FS_open), int,
+		(void* target, const std::string& path, FileInfo& fi),
+		release(path, fi))
+	FUSEPP_BIND_OPERATION(read, FUSEPP_IMPLEMENTS(FS_read), int,
+		(void* target, const std::string& path, ReadBuffer& buf, off_t offset, FileInfo& fi),
+		read(path, buf, offset, fi))
+	FUSEPP_BIND_OPERATION(write, FUSEPP_IMPLEMENTS(FS_write), int,
+		(void* target, const std::string& path, WriteBuffer& buf, off_t offset, FileInfo& fi),
+		write(path, buf, offset, fi))
+	FUSEPP_BIND_OPERATION(flush, FUSEPP_IMPLEMENTS(FS_flush), int,
+		(void* target, const std::string& path, FileInfo& fi),
+		flush(path, fi))
+	FUSEPP_BIND_OPERATION(fsync, FUSEPP_IMPLEMENTS(FS_flush), int,
+		(void* target, const std::string& path, bool datasync, FileInfo& fi),
+		fsync(path, datasync, fi))
+	FUSEPP_BIND_OPERATION(getxattr, FUSEPP_IMPLEMENTS(FS_getxattr), int,
+		(void* target, const std::string& path, const std::string& name, std::string& value),
+		getxattr(path, name, value))
+	FUSEPP_BIND_OPERATION(listxattr, FUSEPP_IMPLEMENTS(FS_listxattr), int,
+		(void* target, const std::string& path, std::vector<std::string>& names),
+		listxattr(path, names))
+	FUSEPP_BIND_OPERATION(setxattr, FUSEPP_IMPLEMENTS(FS_setxattr), int,
+		(void* target, const std::string& path, const std::string& name, const std::string& value, int flags),
+		setxattr(path, name, value, flags))
+	FUSEPP_BIND_OPERATION(removexattr, FUSEPP_IMPLEMENTS(FS_setxattr), int,
+		(void* target, const std::string& path, const std::string& name),
+		removexattr(path, name))
+	FUSEPP_BIND_OPERATION(async_lookup, FUSEPP_IMPLEMENTS(FS_async_lookup), void,
+		(void* target, ino_t parent, const std::string& name, ino_t ino, EntryReply reply),
+		lookup(parent, name, ino, reply))
+	FUSEPP_BIND_OPERATION(async_getattr, FUSEPP_IMPLEMENTS(FS_async_getattr), void,
+		(void* target, ino_t ino, AttrReply reply),
+		getattr(ino, reply))
+	FUSEPP_BIND_OPERATION(async_readdir, FUSEPP_IMPLEMENTS(FS_async_readdir), void,
+		(void* target, ino_t ino, DirectoryReply reply),
+		readdir(ino, reply))
+	FUSEPP_BIND_OPERATION(async_read, FUSEPP_IMPLEMENTS(FS_async_read), void,
+		(void* target, ino_t ino, off_t offset, uint64_t handle, ReadReply reply),
+		read(ino, offset, handle, reply))
+	FUSEPP_BIND_OPERATION(worker_context, FUSEPP_IMPLEMENTS(FS_worker), WorkerContext*,
+		(void* target),
+		createWorkerContext())
+};
+
+#undef FUSEPP_BIND_OPERATION
+#undef FUSEPP_IMPLEMENTS
+
+template <class FS>
+Operations Binder<FS>::bind(FS* fs)
+{
+	Operations ops;
+	ops.target = fs;
+	binder::Bind_getattr<FS>::bind(ops);
+	binder::Bind_readdir<FS>::bind(ops);
+	binder::Bind_lookup<FS>::bind(ops);
+	binder::Bind_forget<FS>::bind(ops);
+	binder::Bind_inode_getattr<FS>::bind(ops);
+	binder::Bind_inode_readdir<FS>::bind(ops);
+	binder::Bind_open<FS>::bind(ops);
+	binder::Bind_release<FS>::bind(ops);
+	binder::Bind_read<FS>::bind(ops);
+	binder::Bind_write<FS>::bind(ops);
+	binder::Bind_flush<FS>::bind(ops);
+	binder::Bind_fsync<FS>::bind(ops);
+	binder::Bind_getxattr<FS>::bind(ops);
+	binder::Bind_listxattr<FS>::bind(ops);
+	binder::Bind_setxattr<FS>::bind(ops);
+	binder::Bind_removexattr<FS>::bind(ops);
+	binder::Bind_async_lookup<FS>::bind(ops);
+	binder::Bind_async_getattr<FS>::bind(ops);
+	binder::Bind_async_readdir<FS>::bind(ops);
+	binder::Bind_async_read<FS>::bind(ops);
+	binder::Bind_worker_context<FS>::bind(ops);
+	return ops;
+}
+
+};
+
+#endif //_FUSEPP_OPERATIONS_H
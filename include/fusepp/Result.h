@@ -0,0 +1,93 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _FUSEPP_RESULT_H
+#define _FUSEPP_RESULT_H
+
+#include <assert.h>
+
+namespace fusepp
+{
+
+// Failure carrying a (positive) errno value, convertible to any Result
+struct Failure
+{
+	explicit Failure(int err) : err(err) { assert(err > 0); }
+	int err;
+};
+
+// Value of an operation, or the errno value it failed with. Routine failures
+// (a missing entry, a denied access) are reported this way rather than with
+// exceptions, and end up as the negative errno values returned to the hooks:
+//
+//   Result<Row> row = findRow(path);
+//   if (!row)
+//       return row.toStatus();
+//   ...
+//   return Failure(ENOENT);
+template <class T>
+class Result
+{
+public:
+	Result(const T& value) : _err(0), _value(value) {}
+	Result(const Failure& failure) : _err(failure.err), _value() {}
+
+	inline bool ok() const { return _err == 0; }
+	inline explicit operator bool() const { return _err == 0; }
+
+	// 0 on success
+	inline int getErrno() const { return _err; }
+	// 0 on success, otherwise the negative errno value the FS_* interfaces return
+	inline int toStatus() const { return -_err; }
+
+	inline const T& get() const { assert(ok()); return _value; }
+	inline T& get() { assert(ok()); return _value; }
+	inline const T& operator*() const { return get(); }
+	inline T& operator*() { return get(); }
+	inline const T* operator->() const { return &get(); }
+	inline T* operator->() { return &get(); }
+
+private:
+	int _err;
+	T _value;
+};
+
+template <>
+class Result<void>
+{
+public:
+	Result() : _err(0) {}
+	Result(const Failure& failure) : _err(failure.err) {}
+
+	inline bool ok() const { return _err == 0; }
+	inline explicit operator bool() const { return _err == 0; }
+	inline int getErrno() const { return _err; }
+	inline int toStatus() const { return -_err; }
+
+private:
+	int _err;
+};
+
+};
+
+#endif //_FUSEPP_RESULT_H
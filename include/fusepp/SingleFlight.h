@@ -0,0 +1,266 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _FUSEPP_SINGLEFLIGHT_H
+#define _FUSEPP_SINGLEFLIGHT_H
+
+#include <fusepp/FileSystem.h>
+#include <fusepp/Stats.h>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <string.h>
+
+namespace fusepp
+{
+
+// Calls identified by a key, of which only one runs at a time: a call made
+// while another one with the same key is in progress waits for it and
+// returns its result. Waiting is bounded: past the timeout, the call runs
+// on its own. It also does when the call it waited for threw.
+template <class Result>
+class SingleFlightGroup
+{
+public:
+	static const size_t SHARDS = 16;
+
+	explicit SingleFlightGroup(double timeout = 5.0)
+	{
+		setTimeout(timeout);
+	}
+
+	inline void setTimeout(double timeout)
+	{
+		_timeout = std::chrono::nanoseconds((long long)(timeout * 1e9));
+	}
+
+	template <class Call>
+	Result run(const std::string& key, Call call)
+	{
+		Shard& shard(_shards[std::hash<std::string>()(key) % SHARDS]);
+		std::unique_lock<std::mutex> lock(shard.mutex);
+		typename std::unordered_map<std::string, std::shared_ptr<Flight> >::iterator it = shard.flights.find(key);
+		if (it != shard.flights.end())
+		{
+			std::shared_ptr<Flight> flight(it->second);
+			if (flight->done.wait_for(lock, _timeout, [&flight]() { return flight->state != Flight::RUNNING; })
+				&& flight->state == Flight::SUCCEEDED)
+			{
+				Stats::count(Stats::SINGLEFLIGHT_SHARED);
+				return flight->result;
+			}
+			if (flight->state == Flight::RUNNING)
+				Stats::count(Stats::SINGLEFLIGHT_TIMEOUTS);
+			lock.unlock();
+			return call();
+		}
+
+		std::shared_ptr<Flight> flight(std::make_shared<Flight>());
+		shard.flights[key] = flight;
+		lock.unlock();
+		try {
+			Result result(call());
+			lock.lock();
+			flight->result = result;
+			finish(shard, key, flight, Flight::SUCCEEDED);
+			return result;
+		} catch (...) {
+			if (!lock.owns_lock())
+				lock.lock();
+			finish(shard, key, flight, Flight::FAILED);
+			throw;
+		}
+	}
+
+private:
+	struct Flight
+	{
+		enum State { RUNNING, SUCCEEDED, FAILED };
+		Flight() : state(RUNNING) {}
+		State state;
+		Result result;
+		std::condition_variable done;
+	};
+
+	struct Shard
+	{
+		std::mutex mutex;
+		std::unordered_map<std::string, std::shared_ptr<Flight> > flights;
+	};
+
+	// Called with the shard locked
+	static void finish(Shard& shard, const std::string& key, const std::shared_ptr<Flight>& flight, typename Flight::State state)
+	{
+		flight->state = state;
+		shard.flights.erase(key);
+		flight->done.notify_all();
+	}
+
+	Shard _shards[SHARDS];
+	std::chrono::nanoseconds _timeout;
+};
+
+template <class Result> const size_t SingleFlightGroup<Result>::SHARDS;
+
+
+// Layer (see Stack) sharing the result of getattr() and readdir() between
+// identical calls made concurrently, so that a hot path reaches FS once.
+// readdir() calls are identical when they list the same path from the same
+// offset; the entries go to the filler of the call that runs, and are
+// recorded to be replayed into the others. A streamed listing (see
+// FS_readdir::DirectoryFiller) stops where that filler is full: the calls
+// that share it get the same entries at most, and the kernel asks for the
+// rest. Shared calls are counted in Stats::SINGLEFLIGHT_SHARED.
+template <class FS>
+class SingleFlight : public FS
+{
+public:
+	template <class... Args>
+	SingleFlight(Args&&... args)
+		: FS(std::forward<Args>(args)...)
+	{}
+
+	// Longest wait, in seconds, for an identical call in progress
+	inline void setSingleFlightTimeout(double timeout)
+	{
+		_getattrs.setTimeout(timeout);
+		_readdirs.setTimeout(timeout);
+	}
+
+	using FS::getattr;
+	using FS::readdir;
+
+	int getattr(const std::string& path, struct stat* buf)
+	{
+		Attr res = _getattrs.run(path, [this, &path]() {
+			Attr attr;
+			memset(&attr.second, 0, sizeof(attr.second));
+			attr.first = FS::getattr(path, &attr.second);
+			return attr;
+		});
+		memcpy(buf, &res.second, sizeof(*buf));
+		return res.first;
+	}
+
+	int readdir(const std::string& path, FS_readdir::DirectoryFiller& filler)
+	{
+		off_t offset = filler.getOffset();
+		std::string key(path);
+		key.push_back('\0');
+		key.append((const char*)&offset, sizeof(offset));
+		bool ran = false;
+		std::shared_ptr<const Listing> listing = _readdirs.run(key, [this, &path, &filler, &ran]() {
+			ran = true;
+			std::shared_ptr<Listing> recorded(std::make_shared<Listing>(filler));
+			recorded->result = FS::readdir(path, *recorded);
+			recorded->detach();
+			return std::shared_ptr<const Listing>(recorded);
+		});
+		if (!ran && listing->result == 0)
+			listing->replay(filler);
+		return listing->result;
+	}
+
+private:
+	typedef std::pair<int, struct stat> Attr;
+
+	// Passes the entries of a listing to the filler of the call that runs
+	// it, and records those it took
+	class Listing : public FS_readdir::DirectoryFiller
+	{
+	public:
+		Listing(FS_readdir::DirectoryFiller& filler)
+			: FS_readdir::DirectoryFiller(filler.getOffset()), result(0), _filler(&filler)
+		{}
+
+		void add(const std::string& name, ino_t id = INVALID_ID)
+		{
+			_filler->add(name, id);
+			Entry entry = { name, id, 0, false };
+			_entries.push_back(entry);
+		}
+		bool add(const std::string& name, ino_t id, off_t cookie)
+		{
+			if (!_filler->add(name, id, cookie))
+				return false;
+			Entry entry = { name, id, cookie, false };
+			_entries.push_back(entry);
+			return true;
+		}
+		bool add(const std::string& name, const struct stat& attr, off_t cookie, double entryTimeout, double attrTimeout)
+		{
+			if (!_filler->add(name, attr, cookie, entryTimeout, attrTimeout))
+				return false;
+			Entry entry = { name, 0, cookie, true, attr, entryTimeout, attrTimeout };
+			_entries.push_back(entry);
+			return true;
+		}
+
+		// The filler is only valid while the call runs
+		inline void detach() { _filler = NULL; }
+
+		void replay(FS_readdir::DirectoryFiller& filler) const
+		{
+			for (typename std::vector<Entry>::const_iterator it = _entries.begin(); it != _entries.end(); ++it)
+			{
+				if (it->hasAttr)
+				{
+					if (!filler.add(it->name, it->attr, it->cookie, it->entryTimeout, it->attrTimeout))
+						return;
+				}
+				else if (it->cookie == 0)
+					filler.add(it->name, it->id);
+				else if (!filler.add(it->name, it->id, it->cookie))
+					return;
+			}
+		}
+
+		int result;
+
+	private:
+		struct Entry
+		{
+			std::string name;
+			ino_t id;
+			off_t cookie;
+			bool hasAttr;
+			struct stat attr;
+			double entryTimeout, attrTimeout;
+		};
+		FS_readdir::DirectoryFiller* _filler;
+		std::vector<Entry> _entries;
+	};
+
+	SingleFlightGroup<Attr> _getattrs;
+	SingleFlightGroup<std::shared_ptr<const Listing> > _readdirs;
+};
+
+};
+
+#endif //_FUSEPP_SINGLEFLIGHT_H
@@ -0,0 +1,138 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _FUSEPP_SNAPSHOT_H
+#define _FUSEPP_SNAPSHOT_H
+
+#include <fusepp/Export.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdint.h>
+
+namespace fusepp
+{
+
+// Attributes of the namespace of a file system, by path, kept in a file from
+// one mount to the next (see Application::setSnapshot). The file loaded at
+// startup is memory-mapped and searched in place: its entries are sorted by
+// path. What the file system returns while mounted is recorded, and save()
+// writes it merged with what was loaded, then maps the new file in place of
+// the old one: the recorded entries move to the file, and the memory they
+// used is released. The file is in the native byte order: a file from
+// another architecture is ignored.
+class FUSEPP_API NamespaceSnapshot
+{
+public:
+	// Paths recorded between two saves; others are not recorded
+	static const size_t MAX_RECORDED = 1 << 20;
+
+	NamespaceSnapshot();
+	virtual ~NamespaceSnapshot();
+
+	// Maps 'file'. Returns false, leaving the snapshot empty, when the file
+	// does not exist or is not a valid snapshot. Not thread-safe: call it
+	// before serving requests.
+	bool load(const std::string& file);
+
+	// Writes the loaded entries, updated with the recorded ones, to 'file',
+	// replacing it atomically, and serves the entries of the new file from
+	// then on. Entries recorded while it runs go to the next save.
+	bool save(const std::string& file);
+
+	// The attributes of 'path' as loaded, only the first time they are asked
+	// for: the file system answers the following calls, which revalidates
+	// the entry
+	bool take(const std::string& path, struct stat& attr);
+
+	// Remembers the attributes of 'path' for the next save
+	void record(const std::string& path, const struct stat& attr);
+	// Remembers that 'path' is gone, or changed in an unknown way
+	void forget(const std::string& path);
+
+	size_t getLoadedCount() const;
+
+private:
+	struct Record;
+
+	// A snapshot file, mapped
+	struct Mapping
+	{
+		void* map;
+		size_t size;
+		const Record* records;
+		size_t count;
+		const char* strings;
+		size_t stringsSize;
+	};
+
+	struct Recorded
+	{
+		bool gone;
+		struct stat attr;
+	};
+	typedef std::unordered_map<std::string,Recorded> RecordedMap;
+
+	static const size_t SHARDS = 16;
+	struct Shard
+	{
+		std::mutex mutex;
+		RecordedMap entries;
+	};
+
+	// Maps 'file' into 'mapping', which is left empty if it is not valid
+	static bool map(const std::string& file, Mapping& mapping);
+	static void unmap(Mapping& mapping);
+
+	// Index of 'path' in the loaded records, or -1
+	ssize_t find(const std::string& path) const;
+	const char* pathAt(size_t index, size_t& length) const;
+	Shard& shard(const std::string& path);
+	void update(const std::string& path, const struct stat* attr);
+	// Puts back entries taken out of the shards by a save that failed,
+	// unless they were recorded again since
+	void restore(const std::vector<std::pair<std::string,Recorded> >& entries);
+
+	Mapping _base;
+	std::unique_ptr<std::atomic<uint8_t>[]> _taken;
+	// Held for reading while the mapping is used, for writing by save()
+	// when it replaces it (std::shared_mutex is C++17)
+	mutable pthread_rwlock_t _rebasing;
+	Shard _shards[SHARDS];
+	std::atomic<size_t> _recorded;
+	std::mutex _saving;
+
+	NamespaceSnapshot(const NamespaceSnapshot&);
+	NamespaceSnapshot& operator=(const NamespaceSnapshot&);
+};
+
+};
+
+#endif //_FUSEPP_SNAPSHOT_H
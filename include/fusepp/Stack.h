@@ -0,0 +1,89 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _FUSEPP_STACK_H
+#define _FUSEPP_STACK_H
+
+#include <utility>
+
+namespace fusepp
+{
+
+// Composes layers over a file system at compile time. A layer is a class
+// template deriving from its parameter, like AttrCache or NegativeCache:
+//   template <class FS>
+//   class MyLayer : public FS
+//   {
+//   public:
+//       template <class... Args>
+//       MyLayer(Args&&... args) : FS(std::forward<Args>(args)...) {}
+//       int getattr(const std::string& path, struct stat* buf)
+//       {
+//           ...
+//           return FS::getattr(path, buf);
+//       }
+//   };
+// It only defines the operations it intercepts and reaches the next layer
+// with a qualified call. Operations the file system does not implement may
+// be defined anyway: they are never instantiated. Defining an operation
+// hides the overloads of the same name in the layers below (getattr(ino_t,
+// ...) of FS_inode_getattr, for instance) unless the layer adds a
+// using-declaration.
+// Layers are listed from the outermost, and the constructor arguments are
+// passed to the file system:
+//   typedef Stack<MyFileSystem, Trace, AttrCache> Layered;
+//   ApplicationPtr app(new StaticApplication<Layered>(std::make_shared<Layered>(arg1)));
+// is Trace<AttrCache<MyFileSystem> >. With StaticApplication every call is
+// qualified, from the hook down to the file system, so the whole stack can
+// be inlined; with Application, a call costs one virtual call whatever the
+// number of layers.
+template <class FS, template <class> class... Layers>
+struct StackOf;
+
+template <class FS>
+struct StackOf<FS>
+{
+	typedef FS type;
+};
+
+template <class FS, template <class> class Outer, template <class> class... Inner>
+struct StackOf<FS, Outer, Inner...>
+{
+	typedef Outer<typename StackOf<FS, Inner...>::type> type;
+};
+
+template <class FS, template <class> class... Layers>
+class Stack : public StackOf<FS, Layers...>::type
+{
+public:
+	typedef typename StackOf<FS, Layers...>::type Layered;
+
+	template <class... Args>
+	Stack(Args&&... args)
+		: Layered(std::forward<Args>(args)...)
+	{}
+};
+
+};
+
+#endif //_FUSEPP_STACK_H
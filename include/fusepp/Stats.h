@@ -0,0 +1,130 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _FUSEPP_STATS_H
+#define _FUSEPP_STATS_H
+
+#include <fusepp/Export.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace fusepp
+{
+
+// Counts and latencies of the calls made to the file system, per operation.
+// Each thread records into counters of its own; they are only merged when
+// read. Latencies go into log-linear histograms (16 buckets per power of two,
+// so within about 6%), from which the percentiles are taken.
+// When enabled, the Application serves the merged figures itself as the
+// read-only file STATS_PATH.
+class FUSEPP_API Stats
+{
+public:
+	enum Operation
+	{
+		GETATTR,
+		READDIR,
+		LOOKUP,
+		OPEN,
+		RELEASE,
+		READ,
+		WRITE,
+		FLUSH,
+		FSYNC,
+		GETXATTR,
+		LISTXATTR,
+		SETXATTR,
+		REMOVEXATTR,
+		OPERATION_COUNT,
+	};
+
+	// Disabled by default
+	static inline bool isEnabled() { return _s_enabled.load(std::memory_order_relaxed); }
+	static void setEnabled(bool enabled);
+
+	static const char* getName(Operation op);
+
+	// Records a call that took 'nanos' nanoseconds
+	static void record(Operation op, uint64_t nanos, bool error);
+
+	struct FUSEPP_API Summary
+	{
+		Summary();
+
+		uint64_t count, errors;
+		uint64_t totalNanos, maxNanos;
+		std::vector<uint64_t> histogram;
+
+		// Upper bound of the latency of the fraction 'q' (0 to 1) of the
+		// fastest calls, in nanoseconds
+		uint64_t getPercentile(double q) const;
+	};
+
+	static Summary getSummary(Operation op);
+
+	// Events counted whether the statistics are enabled or not, per thread
+	// as well
+	enum Counter
+	{
+		// Sequential reads served from prefetched data, or not
+		READAHEAD_HITS,
+		READAHEAD_MISSES,
+		READAHEAD_PREFETCHED_BYTES,
+		// Prefetched, then dropped without being read
+		READAHEAD_WASTED_BYTES,
+		// Calls answered with the result of an identical call in progress
+		// (see SingleFlight), and calls that gave up waiting for it
+		SINGLEFLIGHT_SHARED,
+		SINGLEFLIGHT_TIMEOUTS,
+		// Locks of a LockManager that had to wait, and the time they waited
+		LOCK_CONTENDED,
+		LOCK_WAIT_NANOS,
+		// getxattr() and listxattr() calls answered by an XattrCache, or not
+		XATTR_CACHE_HITS,
+		XATTR_CACHE_MISSES,
+		COUNTER_COUNT,
+	};
+
+	static void count(Counter counter, uint64_t n = 1);
+	static uint64_t getCounter(Counter counter);
+	static const char* getName(Counter counter);
+
+	// One line per operation, then one per counter, as served in STATS_PATH
+	static std::string report();
+
+	static const char* const STATS_DIRECTORY;
+	static const char* const STATS_PATH;
+
+	static const unsigned int HISTOGRAM_BUCKETS = 608;
+	static unsigned int getBucket(uint64_t nanos);
+	static uint64_t getBucketLowerBound(unsigned int bucket);
+
+private:
+	static std::atomic<bool> _s_enabled;
+};
+
+};
+
+#endif //_FUSEPP_STATS_H
@@ -0,0 +1,112 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _FUSEPP_TRACE_H
+#define _FUSEPP_TRACE_H
+
+#include <fusepp/FileSystem.h>
+#include <fusepp/Log.h>
+#include <chrono>
+#include <string>
+#include <utility>
+
+namespace fusepp
+{
+
+// Layer (see Stack) logging the path-based calls made to FS with their
+// result and duration, at LEVEL_DEBUG. When that level is disabled, a call
+// costs one more load.
+template <class FS>
+class Trace : public FS
+{
+public:
+	template <class... Args>
+	Trace(Args&&... args)
+		: FS(std::forward<Args>(args)...)
+	{}
+
+	using FS::getattr;
+	using FS::readdir;
+
+	int getattr(const std::string& path, struct stat* buf)
+	{
+		if (!Log::isEnabled(Log::LEVEL_DEBUG))
+			return FS::getattr(path, buf);
+		Clock::time_point start = Clock::now();
+		return trace("getattr", path, start, FS::getattr(path, buf));
+	}
+
+	int readdir(const std::string& path, FS_readdir::DirectoryFiller& filler)
+	{
+		if (!Log::isEnabled(Log::LEVEL_DEBUG))
+			return FS::readdir(path, filler);
+		Clock::time_point start = Clock::now();
+		return trace("readdir", path, start, FS::readdir(path, filler));
+	}
+
+	int open(const std::string& path, FileInfo& fi)
+	{
+		if (!Log::isEnabled(Log::LEVEL_DEBUG))
+			return FS::open(path, fi);
+		Clock::time_point start = Clock::now();
+		return trace("open", path, start, FS::open(path, fi));
+	}
+
+	int release(const std::string& path, FileInfo& fi)
+	{
+		if (!Log::isEnabled(Log::LEVEL_DEBUG))
+			return FS::release(path, fi);
+		Clock::time_point start = Clock::now();
+		return trace("release", path, start, FS::release(path, fi));
+	}
+
+	int read(const std::string& path, ReadBuffer& buf, off_t offset, FileInfo& fi)
+	{
+		if (!Log::isEnabled(Log::LEVEL_DEBUG))
+			return FS::read(path, buf, offset, fi);
+		Clock::time_point start = Clock::now();
+		return trace("read", path, start, FS::read(path, buf, offset, fi));
+	}
+
+	int write(const std::string& path, WriteBuffer& buf, off_t offset, FileInfo& fi)
+	{
+		if (!Log::isEnabled(Log::LEVEL_DEBUG))
+			return FS::write(path, buf, offset, fi);
+		Clock::time_point start = Clock::now();
+		return trace("write", path, start, FS::write(path, buf, offset, fi));
+	}
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	static int trace(const char* op, const std::string& path, Clock::time_point start, int res)
+	{
+		long long us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+		Log::write(Log::LEVEL_DEBUG, "%s('%s') = %d in %lld us", op, path.c_str(), res, us);
+		return res;
+	}
+};
+
+};
+
+#endif //_FUSEPP_TRACE_H
@@ -0,0 +1,69 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _FUSEPP_WORKER_H
+#define _FUSEPP_WORKER_H
+
+#include <fusepp/Export.h>
+#include <fusepp/FileSystem.h>
+
+namespace fusepp
+{
+
+// State private to a thread serving requests, such as a database connection
+// or scratch buffers. Each worker gets its own context, created by
+// FS_worker::createWorkerContext() and destroyed when the worker exits, so
+// hooks can use it without any locking.
+class FUSEPP_API WorkerContext
+{
+public:
+	virtual ~WorkerContext();
+
+	// Returns the context of the calling thread, creating it on first use.
+	// Throws a fusepp::Error if the file system does not implement FS_worker.
+	static WorkerContext& current();
+};
+
+// Typed access to the context of the calling thread, e.g.
+// getWorkerContext<MyContext>().db
+template <class T>
+inline T& getWorkerContext()
+{
+	return static_cast<T&>(WorkerContext::current());
+}
+
+
+
+class FUSEPP_API FS_worker : public virtual FileSystem
+{
+public:
+	// Called on each worker thread when it starts (or on the first call to
+	// WorkerContext::current() for threads fusepp did not start). The
+	// context belongs to fusepp. If this throws, the creation is attempted
+	// again on the next call to WorkerContext::current().
+	virtual WorkerContext* createWorkerContext() = 0;
+};
+
+};
+
+#endif //_FUSEPP_WORKER_H
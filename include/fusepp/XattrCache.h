@@ -0,0 +1,253 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _FUSEPP_XATTRCACHE_H
+#define _FUSEPP_XATTRCACHE_H
+
+#include <fusepp/Export.h>
+#include <fusepp/FileSystem.h>
+#include <fusepp/Stats.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <errno.h>
+#include <stdint.h>
+
+namespace fusepp
+{
+
+// Time-bounded cache of extended attributes keyed by path. For every path it
+// remembers the values it was given, the names known to be missing, and
+// possibly the complete list of names, from which missing names are
+// inferred. Paths are spread over mutex-protected shards, each holding at
+// most capacity / SHARDS paths; when a shard is full, an arbitrary path is
+// dropped from it.
+// Every shard counts its invalidations: what is read from the file system is
+// put with the stamp taken before reading it, and dropped if the shard was
+// invalidated (or the table cleared) in between.
+class FUSEPP_API XattrCacheTable
+{
+public:
+	static const size_t SHARDS = 16;
+
+	// The stamps of all the shards, for what is put about several paths
+	struct Stamps
+	{
+		uint64_t shards[SHARDS];
+	};
+
+	XattrCacheTable(size_t capacity = 16384, double ttl = 1.0);
+	virtual ~XattrCacheTable();
+
+	// Changes the size and time-to-live (in seconds) of the cache, dropping
+	// its content. This is not thread-safe: call it before mounting.
+	void configure(size_t capacity, double ttl);
+
+	// Returns true when the cache knows about attribute 'name' of 'path':
+	// 'res' is then 0 with its value in 'value', or -ENODATA
+	bool get(const std::string& path, const std::string& name, std::string& value, int& res) const;
+	// Returns true when the complete list of names of 'path' is known
+	bool list(const std::string& path, std::vector<std::string>& names) const;
+
+	uint64_t getStamp(const std::string& path) const;
+	void getStamps(Stamps& stamps) const;
+
+	void putValue(const std::string& path, const std::string& name, const std::string& value, uint64_t stamp);
+	void putMissing(const std::string& path, const std::string& name, uint64_t stamp);
+	void putList(const std::string& path, const std::vector<std::string>& names, uint64_t stamp);
+	// All the attributes of 'path', e.g. from FS_listxattr::listxattrs()
+	void putAll(const std::string& path, const FS_listxattr::Xattrs& xattrs, const Stamps& stamps);
+
+	void invalidate(const std::string& path);
+	void clear();
+
+	inline size_t getCapacity() const { return _capacity; }
+	inline double getTTL() const { return _ttl; }
+
+private:
+	struct Entry
+	{
+		Entry();
+		int64_t expires;
+		bool complete;
+		std::vector<std::string> names;
+		FS_listxattr::Xattrs values;
+		std::vector<std::string> missing;
+	};
+	typedef std::unordered_map<std::string, Entry> EntryMap;
+
+	struct Shard
+	{
+		Shard();
+		mutable std::mutex mutex;
+		EntryMap entries;
+		uint64_t invalidations;
+	};
+
+	size_t index(const std::string& path) const;
+	// Entry of 'path' to update, (re)created when missing or expired, or
+	// NULL if the shard was invalidated since 'stamp' was taken. The shard
+	// must be locked.
+	Entry* update(Shard& shard, const std::string& path, uint64_t stamp);
+
+	std::unique_ptr<Shard[]> _shards;
+	size_t _capacity, _shardCapacity;
+	double _ttl;
+	int64_t _ttlNs;
+
+	XattrCacheTable(const XattrCacheTable&);
+	XattrCacheTable& operator=(const XattrCacheTable&);
+};
+
+
+// Decorator that puts an XattrCacheTable in front of the extended attribute
+// operations of the file system class FS, which must implement FS_getxattr
+// and FS_readdir. Missing attributes are cached too, since most of the calls
+// tools make are for attributes that do not exist. If FS implements
+// FS_listxattr, listings are cached as well, and when a directory is listed
+// its listxattrs() fills the cache for all the entries at once. Changes made
+// through setxattr() and removexattr() invalidate the path; changes made
+// behind the Application's back should call invalidateXattrs(). Like
+// AttrCache, it forwards its constructor arguments to FS and can be stacked:
+//   FileSystemPtr fs(new XattrCache<AttrCache<MyFileSystem> >(arg1));
+template <class FS>
+class XattrCache : public FS
+{
+public:
+	template <class... Args>
+	XattrCache(Args&&... args)
+		: FS(std::forward<Args>(args)...), _bulk(true)
+	{}
+
+	using FS::readdir;
+
+	int getxattr(const std::string& path, const std::string& name, std::string& value)
+	{
+		int res;
+		if (_xattrCache.get(path, name, value, res))
+		{
+			Stats::count(Stats::XATTR_CACHE_HITS);
+			return res;
+		}
+		Stats::count(Stats::XATTR_CACHE_MISSES);
+		uint64_t stamp = _xattrCache.getStamp(path);
+		res = FS::getxattr(path, name, value);
+		if (res == 0)
+			_xattrCache.putValue(path, name, value, stamp);
+		else if (res == -ENODATA)
+			_xattrCache.putMissing(path, name, stamp);
+		return res;
+	}
+
+	int listxattr(const std::string& path, std::vector<std::string>& names)
+	{
+		if (_xattrCache.list(path, names))
+		{
+			Stats::count(Stats::XATTR_CACHE_HITS);
+			return 0;
+		}
+		Stats::count(Stats::XATTR_CACHE_MISSES);
+		uint64_t stamp = _xattrCache.getStamp(path);
+		int res = FS::listxattr(path, names);
+		if (res == 0)
+			_xattrCache.putList(path, names, stamp);
+		return res;
+	}
+
+	int setxattr(const std::string& path, const std::string& name, const std::string& value, int flags)
+	{
+		int res = FS::setxattr(path, name, value, flags);
+		_xattrCache.invalidate(path);
+		return res;
+	}
+
+	int removexattr(const std::string& path, const std::string& name)
+	{
+		int res = FS::removexattr(path, name);
+		_xattrCache.invalidate(path);
+		return res;
+	}
+
+	int readdir(const std::string& path, FS_readdir::DirectoryFiller& filler)
+	{
+		// Only once per listing: streamed listings come back with an offset
+		if (filler.getOffset() == 0)
+			prefetch(path, std::integral_constant<bool, std::is_base_of<FS_listxattr, FS>::value>());
+		return FS::readdir(path, filler);
+	}
+
+	inline XattrCacheTable& getXattrCache() { return _xattrCache; }
+
+	inline void invalidateXattrs(const std::string& path) { _xattrCache.invalidate(path); }
+
+private:
+	class Filler : public FS_listxattr::XattrFiller
+	{
+	public:
+		Filler(XattrCacheTable& cache, const std::string& directory)
+			: _cache(cache), _path(directory)
+		{
+			if (_path.size() > 1)
+				_path += "/";
+			_prefix = _path.size();
+			_cache.getStamps(_stamps);
+		}
+		void add(const std::string& name, const FS_listxattr::Xattrs& xattrs)
+		{
+			_path.resize(_prefix);
+			_path += name;
+			_cache.putAll(_path, xattrs, _stamps);
+		}
+	private:
+		XattrCacheTable& _cache;
+		std::string _path;
+		size_t _prefix;
+		XattrCacheTable::Stamps _stamps;
+	};
+
+	void prefetch(const std::string& path, std::true_type)
+	{
+		if (!_bulk.load(std::memory_order_relaxed))
+			return;
+		Filler filler(_xattrCache, path);
+		if (FS::listxattrs(path, filler) == -ENOSYS)
+			_bulk.store(false, std::memory_order_relaxed);
+	}
+
+	void prefetch(const std::string& path, std::false_type)
+	{
+	}
+
+	XattrCacheTable _xattrCache;
+	// Cleared when FS does not implement listxattrs()
+	std::atomic<bool> _bulk;
+};
+
+};
+
+#endif //_FUSEPP_XATTRCACHE_H
@@ -48,7 +48,7 @@ public:
 	void addOrderClause(const std::string& orderClause);
 	void setOrderAscending(bool ascending);
 
-	void flattenToStream(std::stringstream& stream, bool appendSemicolon) const;
+	void flattenToStream(ArenaStringStream& stream, bool appendSemicolon) const;
 
 private:
 	bool _flattened;
@@ -29,21 +29,33 @@ along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
 #include <vector>
 #include <list>
 #include <sstream>
+#include <fusepp/Arena.h>
 #include <fusepp/Error.h>
+#include <fusepp/Result.h>
 #include <fusepp/pg/Database.h>
 #include <memory>
 
 namespace fusepp
 {
 
-class FUSEPP_PG_API Query : public std::stringstream
+// The text of a query built while serving a request is kept in the arena of
+// the request (see fusepp::Arena): such a query must not outlive the hook.
+class FUSEPP_PG_API Query : public ArenaStringStream
 {
 public:
+	// The state of the query is taken when the error is created, but the
+	// message is only formatted when it is read
 	class FUSEPP_PG_API Error : public fusepp::Error
 	{
 	public:
 		Error(const Query& query);
-		Error(const Query& query, const char* reason, ...);
+		template <class... Args>
+		Error(const Query& query, const char* reason, Args... args)
+		{
+			describe(query, std::make_shared<fusepp::Error>(reason, args...));
+		}
+	private:
+		void describe(const Query& query, std::shared_ptr<const fusepp::Error> reason);
 	};
 	enum Constraints
 	{
@@ -60,6 +72,10 @@ public:
 	
 	virtual bool execute(bool throwOnFail = false);
 
+	// Same as execute(), without exceptions: the number of rows returned, or
+	// ENOENT if the row constraints are not met, or EIO if the query failed
+	Result<unsigned int> tryExecute();
+
 	unsigned int getRowsCount() const;
 	unsigned int getColumnsCount() const;
 
@@ -68,6 +84,8 @@ public:
 	int getColumnIndex(const std::string& columnName);
 	std::string at(unsigned int row, unsigned int column) const;
 	std::string at(unsigned int row, const std::string& columnLabel) const;
+	// Same as at() without a copy: valid as long as the result
+	const char* atc(unsigned int row, unsigned int column) const;
 	double atf(unsigned int row, unsigned int column) const;
 	double atf(unsigned int row, const std::string& columnLabel) const;
 	int ati(unsigned int row, unsigned int column) const;
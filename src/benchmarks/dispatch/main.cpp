@@ -0,0 +1,124 @@
+/*
+Copyright (c) 2014, University of Lausanne, Switzerland 
+All rights reserved. 
+
+Redistribution and use in source and binary forms, with or without 
+modification, are permitted provided that the following conditions are 
+met: 
+
+1. Redistributions of source code must retain the above copyright 
+notice, this list of conditions and the following disclaimer. 
+
+2. Redistributions in binary form must reproduce the above copyright 
+notice, this list of conditions and the following disclaimer in the 
+documentation and/or other materials provided with the distribution. 
+
+3. Neither the name of the copyright holder nor the names of its 
+contributors may be used to endorse or promote products derived from 
+this software without specific prior written permission. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS 
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED 
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A 
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED 
+TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+
+// Measures the cost of dispatching an operation to a file system:
+// - legacy:  dynamic_cast to the FS_* interface on every call, then a
+//            virtual call (what the hooks did before operations were bound)
+// - dynamic: table bound once with Operations::bindDynamic()
+// - static:  table bound at compile time with Binder<FS>
+//
+// Usage: benchmark_dispatch [iterations]
+
+#include <fusepp/Operations.h>
+#include <chrono>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+
+
+class BenchFileSystem : public fusepp::FS_getattr, public fusepp::FS_readdir
+{
+public:
+	int getattr(const std::string& path, struct stat* buf)
+	{
+		buf->st_mode = S_IFREG | 0644;
+		buf->st_size = path.size();
+		return 0;
+	}
+
+	int readdir(const std::string& path, DirectoryFiller& filler)
+	{
+		return 0;
+	}
+};
+
+// Kept out of reach of the optimizer, so that the legacy path cannot be
+// devirtualized either
+fusepp::FileSystem* volatile g_fs = NULL;
+volatile off_t g_sink = 0;
+
+typedef std::chrono::steady_clock Clock;
+
+static void report(const char* name, Clock::time_point start, Clock::time_point end, unsigned long iterations)
+{
+	double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+	std::cout << name << ": " << (ns / iterations) << " ns/op" << std::endl;
+}
+
+static void benchLegacy(const std::string& path, unsigned long iterations)
+{
+	struct stat buf;
+	memset(&buf, 0, sizeof(buf));
+	Clock::time_point start = Clock::now();
+	for (unsigned long i = 0; i < iterations; ++i)
+	{
+		fusepp::FS_getattr* instance = dynamic_cast<fusepp::FS_getattr*>(g_fs);
+		instance->getattr(path, &buf);
+		g_sink = buf.st_size;
+	}
+	report("legacy ", start, Clock::now(), iterations);
+}
+
+static void benchTable(const char* name, const fusepp::Operations& ops, const std::string& path, unsigned long iterations)
+{
+	struct stat buf;
+	memset(&buf, 0, sizeof(buf));
+	Clock::time_point start = Clock::now();
+	for (unsigned long i = 0; i < iterations; ++i)
+	{
+		ops.getattr(ops.target, path, &buf);
+		g_sink = buf.st_size;
+	}
+	report(name, start, Clock::now(), iterations);
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned long iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 50000000UL;
+
+	std::shared_ptr<BenchFileSystem> fs(new BenchFileSystem());
+	g_fs = fs.get();
+	const std::string path("/some/directory/file.jpg");
+
+	fusepp::Operations dynamicOps = fusepp::Operations::bindDynamic(fs);
+	fusepp::Operations staticOps = fusepp::Binder<BenchFileSystem>::bind(fs.get());
+
+	for (int round = 0; round < 3; ++round)
+	{
+		benchLegacy(path, iterations);
+		benchTable("dynamic", dynamicOps, path, iterations);
+		benchTable("static ", staticOps, path, iterations);
+	}
+
+	return 0;
+}
@@ -0,0 +1,290 @@
+/*
+Copyright (c) 2014, University of Lausanne, Switzerland 
+All rights reserved. 
+
+Redistribution and use in source and binary forms, with or without 
+modification, are permitted provided that the following conditions are 
+met: 
+
+1. Redistributions of source code must retain the above copyright 
+notice, this list of conditions and the following disclaimer. 
+
+2. Redistributions in binary form must reproduce the above copyright 
+notice, this list of conditions and the following disclaimer in the 
+documentation and/or other materials provided with the distribution. 
+
+3. Neither the name of the copyright holder nor the names of its 
+contributors may be used to endorse or promote products derived from 
+this software without specific prior written permission. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS 
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED 
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A 
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED 
+TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+
+// Measures the overhead of fusepp without mounting anything: calls the
+// fuse_operations registered by the Application directly, from several
+// threads (high-level mode). It runs against a file system like the minimal
+// sample and against a synthetic directory with many entries, and reports
+// the throughput and the latency percentiles of getattr and readdir.
+// The libfuse session loop and the kernel protocol are left out: feeding a
+// session from user space takes the channel API of libfuse 2
+// (fuse_chan_new), which libfuse 3 removed, and a copy of the kernel's
+// message structures, so that part is measured on a mounted file system.
+//
+// Usage: benchmark_hooks [threads] [iterations]
+
+#define FUSE_USE_VERSION 29
+#include <fuse.h>
+#include <fusepp/Application.h>
+#include <fusepp/Error.h>
+#include <fusepp/Stats.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+
+class MinimalFileSystem : public fusepp::FS_getattr, public fusepp::FS_readdir
+{
+public:
+	int getattr(const std::string& path, struct stat* buf)
+	{
+		if (path == "/" || path == "/bar")
+		{
+			buf->st_mode = S_IFDIR | 0755;
+			return 0;
+		}
+		else if (path == "/foo")
+		{
+			buf->st_mode = S_IFREG | 0644;
+			return 0;
+		}
+		return -ENOENT;
+	}
+
+	int readdir(const std::string& path, DirectoryFiller& filler)
+	{
+		if (path == "/")
+		{
+			filler.add("foo");
+			filler.add("bar");
+		}
+		return 0;
+	}
+};
+
+// A root directory with 'count' files, listed with their attributes
+class LargeDirectoryFileSystem : public fusepp::FS_getattr, public fusepp::FS_readdir
+{
+public:
+	LargeDirectoryFileSystem(unsigned int count)
+		: _count(count)
+	{}
+
+	int getattr(const std::string& path, struct stat* buf)
+	{
+		if (path == "/")
+		{
+			buf->st_mode = S_IFDIR | 0755;
+			return 0;
+		}
+		unsigned int index;
+		if (sscanf(path.c_str(), "/file%u", &index) == 1 && index < _count)
+		{
+			buf->st_mode = S_IFREG | 0444;
+			buf->st_size = index;
+			return 0;
+		}
+		return -ENOENT;
+	}
+
+	int readdir(const std::string& path, DirectoryFiller& filler)
+	{
+		if (path != "/")
+			return -ENOTDIR;
+		struct stat attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.st_mode = S_IFREG | 0444;
+		char name[32];
+		for (unsigned int i = (unsigned int)filler.getOffset(); i < _count; ++i)
+		{
+			snprintf(name, sizeof(name), "file%u", i);
+			attr.st_size = i;
+			if (!filler.add(name, attr, i + 1))
+				break;
+		}
+		return 0;
+	}
+
+private:
+	unsigned int _count;
+};
+
+static const unsigned int LARGE_DIRECTORY_SIZE = 100000;
+
+// ===========================================================================
+// Measurements
+// ===========================================================================
+
+typedef std::chrono::steady_clock Clock;
+
+static inline uint64_t elapsed(Clock::time_point start, Clock::time_point end)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+// Latencies are kept in the histograms of fusepp::Stats
+struct Latencies : public fusepp::Stats::Summary
+{
+	Latencies()
+	{
+		histogram.resize(fusepp::Stats::HISTOGRAM_BUCKETS);
+	}
+
+	inline void add(uint64_t nanos, bool error)
+	{
+		++count;
+		if (error)
+			++errors;
+		totalNanos += nanos;
+		maxNanos = std::max(maxNanos, nanos);
+		++histogram[fusepp::Stats::getBucket(nanos)];
+	}
+
+	void merge(const Latencies& other)
+	{
+		count += other.count;
+		errors += other.errors;
+		totalNanos += other.totalNanos;
+		maxNanos = std::max(maxNanos, other.maxNanos);
+		for (size_t i = 0; i < histogram.size(); ++i)
+			histogram[i] += other.histogram[i];
+	}
+};
+
+static void report(const std::string& name, const Latencies& l, uint64_t wallNanos)
+{
+	printf("%-28s %10.0f ops/s  p50 %8.2f us  p99 %8.2f us  p999 %8.2f us  max %8.2f us  errors %llu\n",
+		name.c_str(), l.count * 1e9 / std::max((uint64_t)1, wallNanos),
+		l.getPercentile(0.5) / 1000.0, l.getPercentile(0.99) / 1000.0,
+		l.getPercentile(0.999) / 1000.0, l.maxNanos / 1000.0, (unsigned long long)l.errors);
+}
+
+// ===========================================================================
+// Hooks
+// ===========================================================================
+
+// Stands for the buffer libfuse fills for the kernel: with offsets, the
+// listing stops once a page is full
+struct DirectoryPage
+{
+	size_t used;
+};
+
+static int fillDirectory(void* buf, const char* name, const struct stat* stbuf, off_t off)
+{
+	DirectoryPage* page = static_cast<DirectoryPage*>(buf);
+	size_t entsize = (24 + strlen(name) + 7) & ~(size_t)7;
+	if (off && page->used + entsize > 4096)
+		return 1;
+	page->used += entsize;
+	return 0;
+}
+
+template <class Call>
+static void runHooks(const std::string& name, unsigned int threads, unsigned long iterations, Call call)
+{
+	std::vector<Latencies> results(threads);
+	std::vector<std::thread> workers;
+	Clock::time_point start = Clock::now();
+	for (unsigned int t = 0; t < threads; ++t)
+	{
+		workers.push_back(std::thread([&results, t, iterations, &call]() {
+			Latencies& l = results[t];
+			for (unsigned long i = 0; i < iterations; ++i)
+			{
+				Clock::time_point before = Clock::now();
+				int res = call(i);
+				l.add(elapsed(before, Clock::now()), res < 0);
+			}
+		}));
+	}
+	for (size_t t = 0; t < workers.size(); ++t)
+		workers[t].join();
+	uint64_t wall = elapsed(start, Clock::now());
+
+	Latencies total;
+	for (size_t t = 0; t < results.size(); ++t)
+		total.merge(results[t]);
+	report(name, total, wall);
+}
+
+static void benchHooks(const std::string& fsName, fusepp::ApplicationPtr app,
+	const char* file, unsigned int threads, unsigned long iterations)
+{
+	struct fuse_operations ops;
+	app->getFuseOperations(&ops);
+
+	runHooks(fsName + " getattr", threads, iterations, [&ops, file](unsigned long i) {
+		struct stat buf;
+		memset(&buf, 0, sizeof(buf));
+		return ops.getattr(file, &buf);
+	});
+
+	// Fewer listings: a large directory takes much longer
+	runHooks(fsName + " readdir", threads, std::max(1UL, iterations / 100), [&ops](unsigned long i) {
+		DirectoryPage page = { 0 };
+		struct fuse_file_info fi;
+		memset(&fi, 0, sizeof(fi));
+		return ops.readdir("/", &page, fillDirectory, 0, &fi);
+	});
+}
+
+// ===========================================================================
+
+int main(int argc, char* argv[])
+{
+	unsigned int threads = argc > 1 ? (unsigned int)strtoul(argv[1], NULL, 10) : 4;
+	unsigned long iterations = argc > 2 ? strtoul(argv[2], NULL, 10) : 200000UL;
+
+	try {
+		// Only one Application can exist at a time
+		for (int fsIndex = 0; fsIndex < 2; ++fsIndex)
+		{
+			fusepp::ApplicationPtr app;
+			std::string fsName;
+			if (fsIndex == 0)
+			{
+				std::shared_ptr<MinimalFileSystem> fs(new MinimalFileSystem());
+				app.reset(new fusepp::StaticApplication<MinimalFileSystem>(fs));
+				fsName = "minimal";
+			}
+			else
+			{
+				std::shared_ptr<LargeDirectoryFileSystem> fs(new LargeDirectoryFileSystem(LARGE_DIRECTORY_SIZE));
+				app.reset(new fusepp::StaticApplication<LargeDirectoryFileSystem>(fs));
+				fsName = "large";
+			}
+			const char* file = fsIndex == 0 ? "/foo" : "/file4242";
+			benchHooks(fsName, app, file, threads, iterations);
+		}
+	} catch (fusepp::Error& err) {
+		std::cerr << "Error: " << err << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
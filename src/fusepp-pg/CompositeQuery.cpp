@@ -93,7 +93,7 @@ void CompositeQuery::setOrderAscending(bool ascending)
 	_orderAsc = ascending;
 }
 
-void CompositeQuery::flattenToStream(std::stringstream& stream, bool appendSemicolon) const
+void CompositeQuery::flattenToStream(ArenaStringStream& stream, bool appendSemicolon) const
 {
 	if (_flattened)
 	{
@@ -104,7 +104,7 @@ void CompositeQuery::flattenToStream(std::stringstream& stream, bool appendSemic
 	{
 		assert(_columns.size() && _tables.size());
 
-		std::string whereClause = str();
+		ArenaString whereClause = str();
 		stream.str("");
 
 		stream << "SELECT ";
@@ -26,7 +26,8 @@ along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
 #include <algorithm>
 #include <fusepp/pg/Database.h>
 #include <fusepp/pg/Query.h>
-#include <iostream>
+#include <fusepp/Log.h>
+#include <sstream>
 #include <locale>
 #ifndef _WIN32
 #include <string.h>
@@ -39,13 +40,13 @@ Database::Database() : _pgconn(NULL)
 #ifdef _DEBUG
 	_ownerThread = fusepp::getCurrentThreadId();
 #endif
-	std::cout << "Created fusepp::Database instance" << std::endl;
+	FUSEPP_LOG_DEBUG("Created fusepp::Database instance");
 }
 
 Database::~Database()
 {
 	disconnect();
-	std::cout << "Destroyed fusepp::Database instance" << std::endl;
+	FUSEPP_LOG_DEBUG("Destroyed fusepp::Database instance");
 }
 
 bool Database::connect(const std::string& host,
@@ -26,6 +26,7 @@ along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
 #include <fusepp/pg/Database.h>
 #include <fusepp/Error.h>
 #include <stdarg.h>
+#include <errno.h>
 #include <iomanip>
 #ifndef _WIN32
 #include <string.h>
@@ -34,6 +35,50 @@ along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
 #include <assert.h>
 using namespace fusepp;
 
+namespace
+{
+	// What is told about a query: the part of its state that outlives it
+	struct QueryState
+	{
+		ExecStatusType status;
+		std::string errorMessage;
+		int rows;
+		unsigned int constraintsViolated;
+	};
+
+	QueryState captureState(const PGresult* result, unsigned int constraintsViolated)
+	{
+		QueryState state;
+		state.status = PQresultStatus(result);
+		state.rows = state.status == PGRES_TUPLES_OK ? PQntuples(result) : 0;
+		if (state.status != PGRES_COMMAND_OK && state.status != PGRES_TUPLES_OK)
+			state.errorMessage = PQresultErrorMessage(result);
+		state.constraintsViolated = constraintsViolated;
+		return state;
+	}
+
+	void describe(std::ostream& stream, const QueryState& state);
+
+	class QueryErrorFormatter : public fusepp::Error::Formatter
+	{
+	public:
+		QueryErrorFormatter(const QueryState& state, std::shared_ptr<const fusepp::Error> reason)
+			: _state(state), _reason(reason)
+		{}
+		std::string format() const
+		{
+			std::stringstream ss;
+			if (_reason)
+				ss << _reason->getReason() << std::endl;
+			describe(ss, _state);
+			return ss.str();
+		}
+	private:
+		QueryState _state;
+		std::shared_ptr<const fusepp::Error> _reason;
+	};
+};
+
 
 // ===========================================================================
 // fusepp::Query implementation
@@ -161,6 +206,13 @@ bool Query::execute(bool throwOnFail)
 	return querySucceeded; 
 }
 
+Result<unsigned int> Query::tryExecute()
+{
+	if (execute(false))
+		return getRowsCount();
+	return Failure(_wasSuccessful ? ENOENT : EIO);
+}
+
 unsigned int Query::getRowsCount() const
 {
 	if (!_wasSuccessful || _wasCommand)
@@ -204,39 +256,47 @@ void Query::checkConstraints()
 
 std::ostream& fusepp::operator<<(std::ostream& stream, const fusepp::Query& query)
 {
-	if (PQresultStatus(query._result) == PGRES_COMMAND_OK)
-		stream << "QUERY OK: command succeeded.";
-	else if (PQresultStatus(query._result) == PGRES_TUPLES_OK)
-		stream << "QUERY OK: " << PQntuples(query._result) << " rows returned.";
-	else{
-		stream << "QUERY ERROR: " << PQresultErrorMessage(query._result) << "(" << PQresStatus(PQresultStatus(query._result)) << ").";
-		return stream;
-	}
-	if (query._constraintsViolated != 0)
+	describe(stream, captureState(query._result, query._constraintsViolated));
+	return stream;
+}
+
+namespace
+{
+	void describe(std::ostream& stream, const QueryState& state)
 	{
-		unsigned int bit = 0x1;
-		while (bit < Query::LAST_CONSTRAINT)
+		if (state.status == PGRES_COMMAND_OK)
+			stream << "QUERY OK: command succeeded.";
+		else if (state.status == PGRES_TUPLES_OK)
+			stream << "QUERY OK: " << state.rows << " rows returned.";
+		else{
+			stream << "QUERY ERROR: " << state.errorMessage << "(" << PQresStatus(state.status) << ").";
+			return;
+		}
+		if (state.constraintsViolated != 0)
 		{
-			if ((query._constraintsViolated & bit) == bit)
+			unsigned int bit = 0x1;
+			while (bit < Query::LAST_CONSTRAINT)
 			{
-				switch (bit)
+				if ((state.constraintsViolated & bit) == bit)
 				{
-				case Query::AT_LEAST_ONE_ROW:
-					stream << " CONSTRAINT ERROR: The query should have returned at least one row";
-					break;
-				case Query::AT_MOST_ONE_ROW:
-					stream << " CONSTRAINT ERROR: The query should have returned at most one row";
-					break;
-				default:
-					assert(false);
-					break;
+					switch (bit)
+					{
+					case Query::AT_LEAST_ONE_ROW:
+						stream << " CONSTRAINT ERROR: The query should have returned at least one row";
+						break;
+					case Query::AT_MOST_ONE_ROW:
+						stream << " CONSTRAINT ERROR: The query should have returned at most one row";
+						break;
+					default:
+						assert(false);
+						break;
+					}
 				}
-			}
-			bit <<= 1;
-		}	
+				bit <<= 1;
+			}	
+		}
 	}
-	return stream;
-}
+};
 
 int Query::getColumnIndex(const std::string& columnName)
 {
@@ -254,6 +314,13 @@ std::string Query::at(unsigned int row, unsigned int column) const
 	return PQgetvalue(_result, row, column);
 }
 
+const char* Query::atc(unsigned int row, unsigned int column) const
+{
+	assert(row < _rowsCount);
+	assert(column < _columnsCount);
+	return PQgetvalue(_result, row, column);
+}
+
 std::string Query::at(unsigned int row, const std::string& columnLabel) const
 {
 	assert(row < _rowsCount);
@@ -268,7 +335,7 @@ double Query::atf(unsigned int row, unsigned int column) const
 {
 	assert(row < _rowsCount);
 	assert(column < _columnsCount);
-	std::stringstream ss;
+	ArenaStringStream ss;
 	ss.imbue(std::locale("C"));
 	ss << PQgetvalue(_result, row, column);
 	double result;
@@ -284,7 +351,7 @@ double Query::atf(unsigned int row, const std::string& columnLabel) const
 	if (column == -1)
 		throw fusepp::Error("the column '%s' was not found in the result set", columnLabel.c_str());
 	assert((unsigned int)column < _columnsCount);
-	std::stringstream ss;
+	ArenaStringStream ss;
 	ss.imbue(std::locale("C"));
 	ss << PQgetvalue(_result, row, column);
 	double result;
@@ -366,7 +433,7 @@ void Query::atf_array(unsigned int row, unsigned int column, std::vector<double>
 
 	p[l-1] = ',';
 
-	std::stringstream atofs;
+	ArenaStringStream atofs;
 	atofs.imbue(std::locale("C"));
 
 	++p;
@@ -510,7 +577,7 @@ void Query::ati_array(unsigned int row, unsigned int column, std::vector<int>& r
 
 	p[l-1] = ',';
 
-	std::stringstream atois;
+	ArenaStringStream atois;
 
 	result.clear();
 	++p;
@@ -614,20 +681,12 @@ std::ostream& Query::getStdIn()
 
 Query::Error::Error(const Query& query) : fusepp::Error()
 {
-	std::stringstream ss;
-	ss << query;
-
-	set("%s", ss.str().c_str());
+	describe(query, std::shared_ptr<const fusepp::Error>());
 }
 
-Query::Error::Error(const Query& query, const char* reason, ...)
+void Query::Error::describe(const Query& query, std::shared_ptr<const fusepp::Error> reason)
 {
-	va_list arglist;
-	va_start(arglist, reason);
-	format(reason, arglist);
-	std::stringstream ss;
-	ss << getReason() << std::endl << query;
-	set("%s", ss.str().c_str());
+	setFormatter(std::make_shared<QueryErrorFormatter>(captureState(query._result, query._constraintsViolated), reason));
 }
 
 
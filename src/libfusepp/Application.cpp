@@ -23,18 +23,29 @@ along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
 
 
 #include <fusepp/Application.h>
-#define FUSE_USE_VERSION 26
-#include <fuse.h>
+#include "hooks.h"
 #include <string.h>
-#include <assert.h>
-#include <iostream>
-#include <fusepp/Error.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <vector>
 using namespace fusepp;
 
 Application* Application::_s_instance(NULL);
 
 Application::Application(FileSystemPtr fs)
-	: _fs(fs)
+	: _fs(fs), _ops(Operations::bindDynamic(fs)), _mode(HIGH_LEVEL), _entryTimeout(1.0), _attrTimeout(1.0), _negativeTimeout(0), _workerCount(0),
+	_writeCoalescingSize(0), _writeCoalescingWindow(0), _readAheadWindow(0), _readAheadThreads(0), _invalidationRate(1000), _snapshotInterval(0)
+{
+	assert(!_s_instance);
+	assert(_fs.get());
+	_s_instance = this;
+}
+
+Application::Application(FileSystemPtr fs, const Operations& ops)
+	: _fs(fs), _ops(ops), _mode(HIGH_LEVEL), _entryTimeout(1.0), _attrTimeout(1.0), _negativeTimeout(0), _workerCount(0),
+	_writeCoalescingSize(0), _writeCoalescingWindow(0), _readAheadWindow(0), _readAheadThreads(0), _invalidationRate(1000), _snapshotInterval(0)
 {
 	assert(!_s_instance);
 	assert(_fs.get());
@@ -43,34 +54,50 @@ Application::Application(FileSystemPtr fs)
 
 Application::~Application()
 {
+	if (_s_instance == this)
+		_s_instance = NULL;
 }
 
-namespace fusepp_impl
+void Application::setTimeouts(double entryTimeout, double attrTimeout)
 {
+	_entryTimeout = entryTimeout;
+	_attrTimeout = attrTimeout;
+}
 
-#define GET_FS_INSTANCE(cls) \
-	assert(Application::_s_instance); \
-	cls* instance = dynamic_cast<cls*>(Application::_s_instance->_fs.get()); \
-	assert(instance)
-
-#define CALL_FS_IMPL_BEGIN() \
-	try {
-
-#define CALL_FS_IMPL_END(errval) \
-	} catch (Error& err) { \
-		std::cout << "[ERROR] Unhandled fusepp::Error: " << err << std::endl; \
-	} catch (std::exception& err) { \
-		std::cout << "[ERROR] Unhandled std::exception: " << err.what() << std::endl; \
-	} catch (...) { \
-		std::cout << "[ERROR] Unhandled (unknown) exception!" << std::endl; \
-	} \
-	return errval
-
-#define CALL_FS_IMPL(cls, funcall, errval) \
-	GET_FS_INSTANCE(cls); \
-	CALL_FS_IMPL_BEGIN() \
-		return instance->funcall; \
-	CALL_FS_IMPL_END(errval)
+void Application::setWriteCoalescing(size_t maxSize, double window)
+{
+	_writeCoalescingSize = maxSize;
+	_writeCoalescingWindow = window;
+}
+
+void Application::setSnapshot(const std::string& file, double interval)
+{
+	_snapshotFile = file;
+	// The file is opened once mounted, after libfuse changed to / in the
+	// background
+	if (!file.empty() && file[0] != '/')
+	{
+		char* cwd = getcwd(NULL, 0);
+		if (cwd)
+		{
+			_snapshotFile = std::string(cwd) + (cwd[1] ? "/" : "") + file;
+			free(cwd);
+		}
+		else
+			FUSEPP_LOG_WARNING("Could not resolve the namespace snapshot %s: %s", file.c_str(), strerror(errno));
+	}
+	_snapshotInterval = interval;
+	_snapshot.reset(file.empty() ? NULL : new NamespaceSnapshot);
+}
+
+void Application::setReadAhead(size_t maxWindow, unsigned int threads)
+{
+	_readAheadWindow = maxWindow;
+	_readAheadThreads = std::max(threads, 1u);
+}
+
+namespace fusepp_impl
+{
 
 	class Hooks
 	{
@@ -78,16 +105,51 @@ namespace fusepp_impl
 
 		static int getattr(const char* path, struct stat* buf)
 		{
-			CALL_FS_IMPL(FS_getattr, getattr(path, buf), -ENOENT);
+			ArenaScope arena;
+			StatsFile::Kind stats = StatsFile::match(path);
+			if (stats != StatsFile::NONE)
+			{
+				StatsFile::getAttr(stats, buf);
+				return 0;
+			}
+			const std::string& p = arena.getArena().string(path);
+			if (Snapshots::take(p, buf))
+				return 0;
+			int res = doGetattr(p, buf);
+			Snapshots::record(p, res, *buf);
+			return res;
+		}
+
+		static int doGetattr(const std::string& path, struct stat* buf)
+		{
+			CALL_FS_IMPL(getattr, -ENOENT, path, buf);
 		}
 
 		class RealDirectoryFiller : public fusepp::FS_readdir::DirectoryFiller
 		{
 		public:
 			RealDirectoryFiller(void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi)
-				: fusepp::FS_readdir::DirectoryFiller(), _buf(buf), _filler(filler), _offset(offset), _fi(fi)
+				: fusepp::FS_readdir::DirectoryFiller(offset), _buf(buf), _filler(filler), _fi(fi)
 			{}
 			void add(const std::string& name, ino_t id = INVALID_ID)
+			{
+				// With a zero offset, libfuse collects the whole listing and
+				// serves the kernel's requests from it
+				fill(name, id, 0);
+			}
+			bool add(const std::string& name, ino_t id, off_t cookie)
+			{
+				assert(cookie != 0);
+				return fill(name, id, cookie);
+			}
+			bool add(const std::string& name, const struct stat& attr, off_t cookie, double entryTimeout, double attrTimeout)
+			{
+				// The high-level API of libfuse 2 only uses the inode number
+				// (with -o use_ino) and the file type
+				return _filler(_buf, name.c_str(), &attr, cookie) == 0;
+			}
+		private:
+			bool fill(const std::string& name, ino_t id, off_t offset)
 			{
 				if (id != INVALID_ID)
 				{
@@ -96,50 +158,282 @@ namespace fusepp_impl
 					s.st_mode = S_IFREG | 0644;
 					s.st_ino = id;
 					s.st_nlink = 1;
-					_filler(_buf, name.c_str(), &s, 0);
-					std::cout << "set using struct stat to ino " << id << std::endl;
+					FUSEPP_LOG_DEBUG("set using struct stat to ino %lu", (unsigned long)id);
+					return _filler(_buf, name.c_str(), &s, offset) == 0;
 				}
 				else
 				{
-					_filler(_buf, name.c_str(), NULL, 0);
+					return _filler(_buf, name.c_str(), NULL, offset) == 0;
 				}
 			}
-		private:
+
 			void* _buf;
 			fuse_fill_dir_t _filler;
-			off_t _offset;
 			fuse_file_info* _fi;
 		};
 
 		static int readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi)
 		{
-			GET_FS_INSTANCE(FS_readdir);
-			CALL_FS_IMPL_BEGIN();
-				RealDirectoryFiller f(buf, filler, offset, fi);
-				return instance->readdir(path, f);
-			CALL_FS_IMPL_END(-EACCES);
+			ArenaScope arena;
+			RealDirectoryFiller f(buf, filler, offset, fi);
+			if (StatsFile::match(path) == StatsFile::DIRECTORY)
+			{
+				StatsFile::fill(f);
+				return 0;
+			}
+			if (!fusepp::Application::_s_instance->_ops.readdir)
+				return -ENOSYS;
+			CALL_FS_IMPL(readdir, -EACCES, arena.getArena().string(path), f);
 		}
 
-	};
+		static void* init(struct fuse_conn_info* conn)
+		{
+			enableSplice(conn);
+			Snapshots::start();
+			return fuse_get_context()->private_data;
+		}
 
-#undef GET_FS_INSTANCE
-#undef CALL_FS_IMPL
+		static int doOpen(const std::string& path, struct fuse_file_info* fi)
+		{
+			if (!fusepp::Application::_s_instance->_ops.open)
+				return 0;
+			FileInfo info(fi);
+			CALL_FS_IMPL(open, -EACCES, path, info);
+		}
+
+		static int open(const char* path, struct fuse_file_info* fi)
+		{
+			if (StatsFile::match(path) == StatsFile::FILE)
+				return StatsFile::open(fi);
+			ArenaScope arena;
+			int res = doOpen(arena.getArena().string(path), fi);
+			if (res == 0)
+				OpenFile::attach(fi);
+			return res;
+		}
+
+		static int doRelease(const std::string& path, FileInfo& info)
+		{
+			if (!fusepp::Application::_s_instance->_ops.release)
+				return 0;
+			CALL_FS_IMPL(release, -EIO, path, info);
+		}
+
+		static int release(const char* path, struct fuse_file_info* fi)
+		{
+			if (StatsFile::match(path) == StatsFile::FILE)
+			{
+				StatsFile::release(fi);
+				return 0;
+			}
+			ArenaScope arena;
+			std::string& p = arena.getArena().string(path);
+			OpenFile::detach(fi, &p);
+			FileInfo info(fi);
+			return doRelease(p, info);
+		}
+
+		static int doRead(const std::string& path, ReadBuffer& buf, off_t offset, struct fuse_file_info* fi)
+		{
+			if (StatsFile::match(path.c_str()) == StatsFile::FILE)
+				return StatsFile::read(fi, buf, offset);
+			if (!fusepp::Application::_s_instance->_ops.read)
+				return -ENOSYS;
+			FileHandle handle(fi);
+			if (handle.getOpenFile())
+				return handle.getOpenFile()->read(path, buf, offset, handle.getInfo());
+			CALL_FS_IMPL(read, -EIO, path, buf, offset, handle.getInfo());
+		}
+
+		static int read_buf(const char* path, struct fuse_bufvec** bufp, size_t size, off_t offset, struct fuse_file_info* fi)
+		{
+			// libfuse free()s the vector and its memory segments once the
+			// reply has been sent, so referenced memory is copied
+			ArenaScope arena;
+			ReadBuffer buf(size, false);
+			int res = doRead(arena.getArena().string(path), buf, offset, fi);
+			if (res < 0)
+				return res;
+
+			struct fuse_bufvec* bufv = static_cast<struct fuse_bufvec*>(malloc(bufvecSize(buf.getSegments().size())));
+			if (!bufv)
+				return -ENOMEM;
+			buf.toBufvec(bufv);
+			buf.detach();
+			*bufp = bufv;
+			return 0;
+		}
+
+		static int write_buf(const char* path, struct fuse_bufvec* bufv, off_t offset, struct fuse_file_info* fi)
+		{
+			ArenaScope arena;
+			const std::string& p = arena.getArena().string(path);
+			WriteBuffer buf(bufv);
+			FileHandle handle(fi);
+			if (handle.getOpenFile())
+				return handle.getOpenFile()->write(p, buf, offset, handle.getInfo());
+			CALL_FS_IMPL(write, -EIO, p, buf, offset, handle.getInfo());
+		}
+
+		static int flush(const char* path, struct fuse_file_info* fi)
+		{
+			if (StatsFile::match(path) == StatsFile::FILE)
+				return 0;
+			ArenaScope arena;
+			const std::string& p = arena.getArena().string(path);
+			FileHandle handle(fi);
+			FileInfo& info(handle.getInfo());
+			int res = handle.getOpenFile() ? handle.getOpenFile()->drain(p, info) : 0;
+			if (res != 0 || !fusepp::Application::_s_instance->_ops.flush)
+				return res;
+			CALL_FS_IMPL(flush, -EIO, p, info);
+		}
+
+		static int fsync(const char* path, int datasync, struct fuse_file_info* fi)
+		{
+			if (StatsFile::match(path) == StatsFile::FILE)
+				return 0;
+			ArenaScope arena;
+			const std::string& p = arena.getArena().string(path);
+			FileHandle handle(fi);
+			FileInfo& info(handle.getInfo());
+			int res = handle.getOpenFile() ? handle.getOpenFile()->drain(p, info) : 0;
+			if (res != 0 || !fusepp::Application::_s_instance->_ops.fsync)
+				return res;
+			CALL_FS_IMPL(fsync, -EIO, p, datasync != 0, info);
+		}
+
+		static int doGetxattr(const std::string& path, const std::string& name, std::string& value)
+		{
+			CALL_FS_IMPL(getxattr, -EIO, path, name, value);
+		}
+
+		static int getxattr(const char* path, const char* name, char* value, size_t size)
+		{
+			if (StatsFile::match(path) != StatsFile::NONE)
+				return -ENODATA;
+			ArenaScope arena;
+			std::string& v = arena.getArena().string();
+			int res = doGetxattr(arena.getArena().string(path), arena.getArena().string(name), v);
+			return res < 0 ? res : copyXattr(v, value, size);
+		}
+
+		static int doListxattr(const std::string& path, std::vector<std::string>& names)
+		{
+			CALL_FS_IMPL(listxattr, -EIO, path, names);
+		}
+
+		static int listxattr(const char* path, char* list, size_t size)
+		{
+			if (StatsFile::match(path) != StatsFile::NONE)
+				return 0;
+			ArenaScope arena;
+			std::vector<std::string> names;
+			int res = doListxattr(arena.getArena().string(path), names);
+			if (res < 0)
+				return res;
+			std::string& l = arena.getArena().string();
+			joinXattrNames(names, l);
+			return copyXattr(l, list, size);
+		}
+
+		static int setxattr(const char* path, const char* name, const char* value, size_t size, int flags)
+		{
+			if (StatsFile::match(path) != StatsFile::NONE)
+				return -ENOTSUP;
+			ArenaScope arena;
+			std::string& v = arena.getArena().string();
+			v.assign(value, size);
+			CALL_FS_IMPL(setxattr, -EIO, arena.getArena().string(path), arena.getArena().string(name), v, flags);
+		}
+
+		static int removexattr(const char* path, const char* name)
+		{
+			if (StatsFile::match(path) != StatsFile::NONE)
+				return -ENOTSUP;
+			ArenaScope arena;
+			CALL_FS_IMPL(removexattr, -EIO, arena.getArena().string(path), arena.getArena().string(name));
+		}
+
+	};
 
 };
 
 
 int Application::run(int argc, char* argv[])
 {
-	fuse_operations ops;
+	int res = _mode == LOW_LEVEL ? runLowLevel(argc, argv) : runHighLevel(argc, argv);
+	fusepp_impl::Snapshots::stop();
+	return res;
+}
+
+void Application::getFuseOperations(struct fuse_operations* fuseOps) const
+{
+	if (_ops.async_lookup || _ops.async_getattr || _ops.async_readdir || _ops.async_read)
+		throw Error("fusepp::Application::getFuseOperations() : asynchronous operations require the low-level mode");
+
+	fuse_operations& ops = *fuseOps;
 	memset(&ops, 0, sizeof(ops));
 
-	FS_getattr* check_getattr = dynamic_cast<FS_getattr*>(_fs.get());
-	if (check_getattr) ops.getattr = fusepp_impl::Hooks::getattr;
+	// The statistics file needs the hooks whether the file system
+	// implements the operations or not
+	bool stats = Stats::isEnabled();
+	if (_ops.getattr) ops.getattr = fusepp_impl::Hooks::getattr;
+	if (_ops.readdir || stats) ops.readdir = fusepp_impl::Hooks::readdir;
+	// Coalesced writes and read-ahead need every handle to go through the hooks
+	bool coalescing = _ops.write && _writeCoalescingSize > 0;
+	bool readAhead = _ops.read && _readAheadWindow > 0;
+	if (_ops.open || stats || coalescing || readAhead)
+	{
+		ops.open = fusepp_impl::Hooks::open;
+		ops.release = fusepp_impl::Hooks::release;
+	}
+	if (_ops.read || stats) ops.read_buf = fusepp_impl::Hooks::read_buf;
+	if (_ops.write) ops.write_buf = fusepp_impl::Hooks::write_buf;
+	if (_ops.flush || coalescing)
+	{
+		ops.flush = fusepp_impl::Hooks::flush;
+		ops.fsync = fusepp_impl::Hooks::fsync;
+	}
+	if (_ops.getxattr) ops.getxattr = fusepp_impl::Hooks::getxattr;
+	if (_ops.listxattr) ops.listxattr = fusepp_impl::Hooks::listxattr;
+	if (_ops.setxattr)
+	{
+		ops.setxattr = fusepp_impl::Hooks::setxattr;
+		ops.removexattr = fusepp_impl::Hooks::removexattr;
+	}
+	ops.init = fusepp_impl::Hooks::init;
+}
 
-	FS_readdir* check_readdir = dynamic_cast<FS_readdir*>(_fs.get());
-	if (check_readdir) ops.readdir = fusepp_impl::Hooks::readdir;
+int Application::runHighLevel(int argc, char* argv[])
+{
+	fuse_operations ops;
+	getFuseOperations(&ops);
+
+	// libfuse takes the timeouts of the high-level API as mount options
+	std::vector<char*> args(argv, argv + argc);
+	char negativeTimeout[64];
+	if (_negativeTimeout > 0)
+	{
+		snprintf(negativeTimeout, sizeof(negativeTimeout), "-onegative_timeout=%g", _negativeTimeout);
+		args.push_back(negativeTimeout);
+	}
+	argc = (int)args.size();
+	args.push_back(NULL);
+	argv = &args[0];
+
+	if (!_workerCount)
+	{
+		fuse_main(argc, argv, &ops, this);
+		return 0;
+	}
 
-	fuse_main(argc, argv, &ops, this);
-	
-	return 0;
+	char* mountpoint = NULL;
+	int multithreaded = 0;
+	struct fuse* fuse = fuse_setup(argc, argv, &ops, sizeof(ops), &mountpoint, &multithreaded, this);
+	if (!fuse)
+		return 1;
+	int err = fusepp_impl::Workers::run(fuse_get_session(fuse), multithreaded ? _workerCount : 1);
+	fuse_teardown(fuse, mountpoint);
+	return err ? 1 : 0;
 }
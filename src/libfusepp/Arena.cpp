@@ -0,0 +1,189 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <fusepp/Arena.h>
+#include <algorithm>
+#include <memory>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+using namespace fusepp;
+
+namespace
+{
+	thread_local std::unique_ptr<Arena> t_arena;
+	thread_local unsigned int t_depth = 0;
+
+	// Strings larger than this are not worth keeping for the next request
+	const size_t MAX_RETAINED_STRING = 4096;
+};
+
+const size_t Arena::BLOCK_SIZE;
+const size_t Arena::MAX_RETAINED;
+
+// ===========================================================================
+// Arena
+// ===========================================================================
+
+Arena::Arena()
+	: _first(NULL), _current(NULL), _offset(0), _used(0), _stringsUsed(0)
+{
+}
+
+Arena::~Arena()
+{
+	while (_first)
+	{
+		Block* next = _first->next;
+		free(_first);
+		_first = next;
+	}
+}
+
+void* Arena::allocate(size_t size, size_t align)
+{
+	assert(align && (align & (align - 1)) == 0);
+	for (;;)
+	{
+		if (_current)
+		{
+			uintptr_t base = reinterpret_cast<uintptr_t>(_current + 1);
+			uintptr_t p = (base + _offset + align - 1) & ~(uintptr_t)(align - 1);
+			if (p + size <= base + _current->size)
+			{
+				_used += p + size - (base + _offset);
+				_offset = p + size - base;
+				return reinterpret_cast<void*>(p);
+			}
+			if (_current->next && _current->next->size >= size + align)
+			{
+				// A block kept from a previous request
+				_current = _current->next;
+				_offset = 0;
+				continue;
+			}
+		}
+
+		// Blocks are chained in the order they are used, so a new one goes
+		// right after the current block
+		size_t blockSize = std::max(BLOCK_SIZE, size + align);
+		Block* block = static_cast<Block*>(malloc(sizeof(Block) + blockSize));
+		if (!block)
+			throw std::bad_alloc();
+		block->size = blockSize;
+		if (_current)
+		{
+			block->next = _current->next;
+			_current->next = block;
+		}
+		else
+		{
+			block->next = _first;
+			_first = block;
+		}
+		_current = block;
+		_offset = 0;
+	}
+}
+
+void Arena::deallocate(void* p, size_t size)
+{
+	if (!_current)
+		return;
+	char* top = reinterpret_cast<char*>(_current + 1) + _offset;
+	if (static_cast<char*>(p) + size == top)
+	{
+		_offset -= size;
+		_used -= size;
+	}
+}
+
+void Arena::reset()
+{
+	// Keep the blocks of the usual size, up to MAX_RETAINED bytes
+	size_t retained = 0;
+	Block** link = &_first;
+	while (*link)
+	{
+		Block* block = *link;
+		if (block->size == BLOCK_SIZE && retained + BLOCK_SIZE <= MAX_RETAINED)
+		{
+			retained += BLOCK_SIZE;
+			link = &block->next;
+		}
+		else
+		{
+			*link = block->next;
+			free(block);
+		}
+	}
+	_current = _first;
+	_offset = 0;
+	_used = 0;
+
+	for (size_t i = 0; i < _stringsUsed; ++i)
+	{
+		if (_strings[i].capacity() > MAX_RETAINED_STRING)
+			std::string().swap(_strings[i]);
+	}
+	_stringsUsed = 0;
+}
+
+std::string& Arena::string()
+{
+	if (_stringsUsed == _strings.size())
+		_strings.push_back(std::string());
+	std::string& s = _strings[_stringsUsed++];
+	s.clear();
+	return s;
+}
+
+std::string& Arena::string(const char* s)
+{
+	std::string& str = string();
+	str.assign(s);
+	return str;
+}
+
+Arena* Arena::current()
+{
+	return t_depth ? t_arena.get() : NULL;
+}
+
+// ===========================================================================
+// ArenaScope
+// ===========================================================================
+
+ArenaScope::ArenaScope()
+{
+	if (!t_arena)
+		t_arena.reset(new Arena);
+	_arena = t_arena.get();
+	++t_depth;
+}
+
+ArenaScope::~ArenaScope()
+{
+	if (--t_depth == 0)
+		_arena->reset();
+}
@@ -0,0 +1,172 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include <fusepp/AttrCache.h>
+#include "PathSlots.h"
+#include <string.h>
+using namespace fusepp;
+using namespace fusepp_impl;
+
+const size_t AttrCacheTable::MAX_PATH_LENGTH;
+const size_t AttrCacheTable::WAYS;
+
+struct AttrCacheTable::Slot : public PathSlot<AttrCacheTable::MAX_PATH_LENGTH>
+{
+	Slot() : referenced(0) {}
+	std::atomic<uint8_t> referenced;
+	struct stat attr;
+};
+
+AttrCacheTable::AttrCacheTable(size_t capacity, double ttl)
+	: _capacity(0), _mask(0), _ttl(0), _ttlNs(0), _generation(0)
+{
+	configure(capacity, ttl);
+}
+
+AttrCacheTable::~AttrCacheTable()
+{
+}
+
+void AttrCacheTable::configure(size_t capacity, double ttl)
+{
+	size_t buckets = 1;
+	while (buckets * WAYS < capacity)
+		buckets <<= 1;
+
+	_capacity = buckets * WAYS;
+	_mask = buckets - 1;
+	_slots.reset(new Slot[_capacity]);
+	_hands.reset(new std::atomic<uint8_t>[buckets]);
+	_invalidations.reset(new std::atomic<uint32_t>[buckets]);
+	for (size_t i = 0; i < buckets; ++i)
+	{
+		_hands[i].store(0, std::memory_order_relaxed);
+		_invalidations[i].store(0, std::memory_order_relaxed);
+	}
+	_ttl = ttl;
+	_ttlNs = (int64_t)(ttl * 1e9);
+}
+
+size_t AttrCacheTable::bucket(uint64_t hash) const
+{
+	return (size_t)(hash & _mask) * WAYS;
+}
+
+bool AttrCacheTable::get(const std::string& path, struct stat* buf) const
+{
+	if (_ttlNs <= 0 || path.size() > MAX_PATH_LENGTH)
+		return false;
+
+	uint64_t hash = hashPath(path);
+	uint32_t generation = _generation.load(std::memory_order_acquire);
+	Slot* first = &_slots[bucket(hash)];
+
+	for (size_t i = 0; i < WAYS; ++i)
+	{
+		Slot& slot(first[i]);
+		uint32_t seq;
+		if (!slot.beginRead(seq) || slot.hash != hash)
+			continue;
+
+		struct stat attr;
+		bool found = slot.matches(hash, path) && slot.generation == generation;
+		int64_t expires = slot.expires;
+		memcpy(&attr, &slot.attr, sizeof(attr));
+		if (!slot.endRead(seq))
+			return false;
+
+		if (!found || expires < now())
+			return false;
+
+		if (!slot.referenced.load(std::memory_order_relaxed))
+			slot.referenced.store(1, std::memory_order_relaxed);
+		memcpy(buf, &attr, sizeof(attr));
+		return true;
+	}
+	return false;
+}
+
+uint64_t AttrCacheTable::getStamp(const std::string& path) const
+{
+	uint32_t generation = _generation.load();
+	return makeStamp(generation, _invalidations[bucket(hashPath(path)) / WAYS].load());
+}
+
+void AttrCacheTable::put(const std::string& path, const struct stat& buf)
+{
+	put(path, buf, getStamp(path));
+}
+
+void AttrCacheTable::put(const std::string& path, const struct stat& buf, uint64_t stamp)
+{
+	if (_ttlNs <= 0 || path.size() > MAX_PATH_LENGTH)
+		return;
+
+	uint64_t hash = hashPath(path);
+	uint32_t generation = stampGeneration(stamp);
+	int64_t t = now();
+	size_t index = bucket(hash);
+	Slot* first = &_slots[index];
+
+	// When every slot is in use, the first one whose referenced bit is clear
+	// (CLOCK)
+	Slot* victim = findSlot(first, WAYS, hash, generation, t);
+	if (!victim)
+	{
+		std::atomic<uint8_t>& hand(_hands[index / WAYS]);
+		uint8_t pos = hand.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < 2 * WAYS && !victim; ++i, pos = (pos + 1) % WAYS)
+		{
+			if (first[pos].referenced.exchange(0, std::memory_order_relaxed) == 0)
+				victim = &first[pos];
+		}
+		if (!victim)
+			victim = &first[pos];
+		hand.store((pos + 1) % WAYS, std::memory_order_relaxed);
+	}
+
+	uint32_t seq;
+	if (!lockForPut(*victim, seq, [this, &path, stamp]() { return getStamp(path) == stamp; }))
+		return;
+	victim->assign(hash, generation, t + _ttlNs, path);
+	memcpy(&victim->attr, &buf, sizeof(buf));
+	victim->referenced.store(0, std::memory_order_relaxed);
+	victim->unlock(seq);
+}
+
+void AttrCacheTable::invalidate(const std::string& path)
+{
+	if (path.size() > MAX_PATH_LENGTH)
+		return;
+
+	uint64_t hash = hashPath(path);
+	size_t index = bucket(hash);
+	_invalidations[index / WAYS].fetch_add(1);
+	erasePath(&_slots[index], WAYS, hash, path);
+}
+
+void AttrCacheTable::clear()
+{
+	_generation.fetch_add(1);
+}
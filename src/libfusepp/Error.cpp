@@ -28,29 +28,37 @@ along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
 #else
 #include <windows.h>
 #endif
-#include <iostream>
+#include <fusepp/Log.h>
+#include <ostream>
 using namespace fusepp;
 
 Error::Error()
 {
-#ifdef _DEBUG
-	std::cout << "DEBUG: thrown fusepp::Error (without message)" << std::endl;
-#endif
+	traced();
 }
 
 Error::~Error()
 {
 }
 
-Error::Error(const char* reason, ...)
+Error::Formatter::~Formatter()
 {
-	va_list arglist;
-	va_start(arglist, reason);
-	format(reason, arglist);
-	
-#ifdef _DEBUG
-	std::cout << "DEBUG: thrown fusepp::Error : " << _reason << std::endl;
-#endif
+}
+
+void Error::traced() const
+{
+	if (Log::isEnabled(Log::LEVEL_DEBUG))
+		Log::write(Log::LEVEL_DEBUG, "thrown fusepp::Error : %s", getReason().c_str());
+}
+
+const std::string& Error::getReason() const
+{
+	if (_formatter)
+	{
+		_reason = _formatter->format();
+		_formatter.reset();
+	}
+	return _reason;
 }
 
 void Error::set(const char* reason, ...)
@@ -60,6 +68,12 @@ void Error::set(const char* reason, ...)
 	format(reason, arglist);
 }
 
+void Error::setFormatter(std::shared_ptr<const Formatter> formatter)
+{
+	_formatter = formatter;
+	_reason.clear();
+}
+
 int myvsnprintf(char* buffer, size_t bufsize, const char* format, va_list arglist);
 
 void Error::format(const char* in, va_list arglist)
@@ -68,11 +82,37 @@ void Error::format(const char* in, va_list arglist)
 	myvsnprintf(buffer, 2048, in, arglist);
 	va_end(arglist);
 	_reason = buffer;
+	_formatter.reset();
+}
+
+std::string Error::formatString(const char* format, ...)
+{
+	va_list arglist;
+	va_start(arglist, format);
+	char buffer[512];
+	va_list copy;
+	va_copy(copy, arglist);
+	int size = myvsnprintf(buffer, sizeof(buffer), format, copy);
+	va_end(copy);
+	std::string result;
+	if (size < 0 || (size_t)size < sizeof(buffer))
+	{
+		// A negative size is a truncation on Windows
+		result = buffer;
+	}
+	else
+	{
+		result.resize(size + 1);
+		myvsnprintf(&result[0], result.size(), format, arglist);
+		result.resize(size);
+	}
+	va_end(arglist);
+	return result;
 }
 
 std::ostream& fusepp::operator<<(std::ostream& stream, const Error& err)
 {
-	stream << err._reason;
+	stream << err.getReason();
 	return stream;
 }
 
@@ -123,11 +163,11 @@ Error Error::System(const std::string& api)
 	std::string copy = szPrintBuffer;
 	LocalFree(lpvMessageBuffer);
 
-	return Error(copy.c_str());
+	return Error("%s", copy);
 	
 #else //_WIN32
 
-	return Error(api.c_str());
+	return Error("%s", api);
 
 #endif //_WIN32
 }
@@ -23,7 +23,12 @@ along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
 
 
 #include <fusepp/FileSystem.h>
-#include <fuse.h>
+#include <fusepp/Async.h>
+#include "hooks.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
 using namespace fusepp;
 
 FileSystem::FileSystem()
@@ -34,9 +39,254 @@ FileSystem::~FileSystem()
 {
 }
 
-FS_readdir::DirectoryFiller::DirectoryFiller()
+FS_readdir::DirectoryFiller::DirectoryFiller(off_t offset)
+	: _offset(offset)
 {
 }
 FS_readdir::DirectoryFiller::~DirectoryFiller()
 {
-}
\ No newline at end of file
+}
+
+void FS_lookup::forget(ino_t ino)
+{
+}
+
+void FS_async_lookup::forget(ino_t ino)
+{
+}
+
+int FS_open::release(const std::string& path, FileInfo& fi)
+{
+	return 0;
+}
+
+int FS_flush::fsync(const std::string& path, bool datasync, FileInfo& fi)
+{
+	return flush(path, fi);
+}
+
+FS_listxattr::XattrFiller::~XattrFiller()
+{
+}
+
+int FS_listxattr::listxattrs(const std::string& path, XattrFiller& filler)
+{
+	return -ENOSYS;
+}
+
+int FS_setxattr::removexattr(const std::string& path, const std::string& name)
+{
+	return -ENOTSUP;
+}
+
+// ===========================================================================
+// FileInfo implementation
+// ===========================================================================
+
+FileInfo::FileInfo(struct fuse_file_info* fi)
+	: _fi(fi)
+{
+	assert(_fi);
+}
+
+int FileInfo::getFlags() const
+{
+	return _fi->flags;
+}
+
+uint64_t FileInfo::getHandle() const
+{
+	return _fi->fh;
+}
+
+void FileInfo::setHandle(uint64_t handle)
+{
+	_fi->fh = handle;
+}
+
+bool FileInfo::getKeepCache() const
+{
+	return _fi->keep_cache != 0;
+}
+
+void FileInfo::setKeepCache(bool keep)
+{
+	_fi->keep_cache = keep;
+}
+
+bool FileInfo::getDirectIO() const
+{
+	return _fi->direct_io != 0;
+}
+
+void FileInfo::setDirectIO(bool direct)
+{
+	_fi->direct_io = direct;
+}
+
+bool FileInfo::getNonSeekable() const
+{
+	return _fi->nonseekable != 0;
+}
+
+void FileInfo::setNonSeekable(bool nonSeekable)
+{
+	_fi->nonseekable = nonSeekable;
+}
+
+bool FileInfo::setParallelDirectWrites(bool parallel)
+{
+#if FUSE_MAJOR_VERSION > 3 || (FUSE_MAJOR_VERSION == 3 && FUSE_MINOR_VERSION >= 15)
+	_fi->parallel_direct_writes = parallel;
+	return true;
+#else
+	return !parallel;
+#endif
+}
+
+// ===========================================================================
+// ReadBuffer implementation
+// ===========================================================================
+
+ReadBuffer::ReadBuffer(size_t size, bool canReference)
+	: _size(size), _filled(0), _canReference(canReference)
+{
+}
+
+ReadBuffer::~ReadBuffer()
+{
+	for (std::vector<Segment>::iterator it = _segments.begin(); it != _segments.end(); ++it)
+		if (it->owned)
+			free(it->mem);
+}
+
+size_t ReadBuffer::clamp(size_t size) const
+{
+	return std::min(size, _size - _filled);
+}
+
+void* ReadBuffer::allocate(size_t size, size_t& granted)
+{
+	granted = clamp(size);
+	if (granted == 0)
+		return NULL;
+	void* mem = malloc(granted);
+	if (!mem)
+		throw std::bad_alloc();
+	Segment seg = { mem, -1, 0, granted, true };
+	_segments.push_back(seg);
+	_filled += granted;
+	return mem;
+}
+
+size_t ReadBuffer::adopt(void* data, size_t size)
+{
+	size = clamp(size);
+	if (size == 0)
+	{
+		free(data);
+		return 0;
+	}
+	Segment seg = { data, -1, 0, size, true };
+	_segments.push_back(seg);
+	_filled += size;
+	return size;
+}
+
+void ReadBuffer::reference(const void* data, size_t size, std::shared_ptr<const void> owner)
+{
+	if (!_canReference)
+	{
+		size_t granted;
+		void* mem = allocate(size, granted);
+		if (mem)
+			memcpy(mem, data, granted);
+		return;
+	}
+	size = clamp(size);
+	if (size == 0)
+		return;
+	Segment seg = { const_cast<void*>(data), -1, 0, size, false };
+	_segments.push_back(seg);
+	_filled += size;
+	_owners.push_back(owner);
+}
+
+void ReadBuffer::splice(int fd, off_t pos, size_t size)
+{
+	size = clamp(size);
+	if (size == 0)
+		return;
+	Segment seg = { NULL, fd, pos, size, false };
+	_segments.push_back(seg);
+	_filled += size;
+}
+
+void ReadBuffer::toBufvec(struct fuse_bufvec* bufv) const
+{
+	bufv->count = std::max((size_t)1, _segments.size());
+	bufv->idx = 0;
+	bufv->off = 0;
+	memset(&bufv->buf[0], 0, sizeof(struct fuse_buf) * bufv->count);
+	bufv->buf[0].fd = -1;
+	for (size_t i = 0; i < _segments.size(); ++i)
+	{
+		const Segment& seg(_segments[i]);
+		struct fuse_buf& buf(bufv->buf[i]);
+		buf.size = seg.size;
+		buf.mem = seg.mem;
+		buf.fd = seg.fd;
+		buf.pos = seg.pos;
+		buf.flags = (seg.fd != -1) ? (enum fuse_buf_flags)(FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK) : (enum fuse_buf_flags)0;
+	}
+}
+
+void ReadBuffer::detach()
+{
+	for (std::vector<Segment>::iterator it = _segments.begin(); it != _segments.end(); ++it)
+		it->owned = false;
+}
+
+// ===========================================================================
+// WriteBuffer implementation
+// ===========================================================================
+
+WriteBuffer::WriteBuffer(struct fuse_bufvec* bufv)
+	: _bufv(bufv)
+{
+	assert(_bufv);
+}
+
+size_t WriteBuffer::getSize() const
+{
+	size_t size = 0;
+	for (size_t i = _bufv->idx; i < _bufv->count; ++i)
+		size += _bufv->buf[i].size;
+	return size - _bufv->off;
+}
+
+const void* WriteBuffer::getData() const
+{
+	if (_bufv->count - _bufv->idx != 1)
+		return NULL;
+	const struct fuse_buf& buf(_bufv->buf[_bufv->idx]);
+	if (buf.flags & FUSE_BUF_IS_FD)
+		return NULL;
+	return static_cast<const char*>(buf.mem) + _bufv->off;
+}
+
+ssize_t WriteBuffer::copyTo(void* dst, size_t size)
+{
+	struct fuse_bufvec dstv = FUSE_BUFVEC_INIT(size);
+	dstv.buf[0].mem = dst;
+	return fuse_buf_copy(&dstv, _bufv, (enum fuse_buf_copy_flags)0);
+}
+
+ssize_t WriteBuffer::spliceTo(int fd, off_t pos)
+{
+	struct fuse_bufvec dstv = FUSE_BUFVEC_INIT(getSize());
+	dstv.buf[0].flags = (enum fuse_buf_flags)(FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK);
+	dstv.buf[0].fd = fd;
+	dstv.buf[0].pos = pos;
+	return fuse_buf_copy(&dstv, _bufv, (enum fuse_buf_copy_flags)0);
+}
@@ -0,0 +1,264 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include <fusepp/InodeTable.h>
+#include <fusepp/Arena.h>
+#include <assert.h>
+#include <vector>
+#include <chrono>
+using namespace fusepp;
+
+const ino_t InodeTable::ROOT;
+const size_t InodeTable::MAX_PRIMED;
+
+namespace
+{
+	inline int64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	inline int64_t deadline(double timeout)
+	{
+		return now() + (int64_t)(timeout * 1e9);
+	}
+};
+
+InodeTable::InodeTable()
+	: _next(ROOT + 1)
+{
+	Node& root = _nodes[ROOT];
+	root.parent = ROOT;
+	root.nlookup = 1;
+}
+
+InodeTable::~InodeTable()
+{
+}
+
+ino_t InodeTable::lookup(ino_t parent, const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	Nodes::iterator pit = _nodes.find(parent);
+	if (pit == _nodes.end())
+		return 0;
+
+	const NameKey& key = searchKey(parent, name);
+	Names::iterator it = _names.find(key);
+	if (it != _names.end())
+	{
+		_nodes[it->second].nlookup++;
+		return it->second;
+	}
+
+	ino_t ino = _next++;
+	Node& node = _nodes[ino];
+	node.parent = parent;
+	node.name = name;
+	node.nlookup = 1;
+	pit = _nodes.find(parent);
+	pit->second.children++;
+	_names.insert(Names::value_type(key, ino));
+	return ino;
+}
+
+bool InodeTable::forget(ino_t ino, uint64_t nlookup)
+{
+	if (ino == ROOT)
+		return false;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	Nodes::iterator it = _nodes.find(ino);
+	if (it == _nodes.end())
+		return false;
+
+	Node& node = it->second;
+	node.nlookup = (nlookup >= node.nlookup) ? 0 : node.nlookup - nlookup;
+	if (node.nlookup > 0 || node.children > 0)
+		return false;
+
+	release(ino);
+	return true;
+}
+
+void InodeTable::release(ino_t ino)
+{
+	// Walks up the tree: a parent that was only kept alive by this child
+	// goes away with it
+	while (ino != ROOT)
+	{
+		Nodes::iterator it = _nodes.find(ino);
+		assert(it != _nodes.end());
+		ino_t parent = it->second.parent;
+		_names.erase(searchKey(parent, it->second.name));
+		_nodes.erase(it);
+
+		Nodes::iterator pit = _nodes.find(parent);
+		assert(pit != _nodes.end());
+		assert(pit->second.children > 0);
+		if (--pit->second.children > 0 || pit->second.nlookup > 0)
+			break;
+		ino = parent;
+	}
+}
+
+bool InodeTable::find(ino_t parent, const std::string& name, ino_t& ino) const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	Names::const_iterator it = _names.find(searchKey(parent, name));
+	if (it == _names.end())
+		return false;
+	ino = it->second;
+	return true;
+}
+
+const InodeTable::NameKey& InodeTable::searchKey(ino_t parent, const std::string& name)
+{
+	static thread_local NameKey key(0, std::string());
+	key.parent = parent;
+	key.name.assign(name);
+	return key;
+}
+
+bool InodeTable::path(ino_t ino, std::string& path) const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	ArenaVector<const std::string*> components;
+	while (ino != ROOT)
+	{
+		Nodes::const_iterator it = _nodes.find(ino);
+		if (it == _nodes.end())
+			return false;
+		components.push_back(&it->second.name);
+		ino = it->second.parent;
+	}
+
+	path.clear();
+	if (components.empty())
+		path = "/";
+	for (ArenaVector<const std::string*>::reverse_iterator it = components.rbegin(); it != components.rend(); ++it)
+	{
+		path += "/";
+		path += **it;
+	}
+	return true;
+}
+
+size_t InodeTable::size() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _nodes.size();
+}
+
+void InodeTable::prime(ino_t parent, const std::string& name, const struct stat& attr, double entryTimeout, double attrTimeout)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (_primed.size() >= MAX_PRIMED)
+	{
+		// Drop what has expired; if that is not enough, forget everything:
+		// primed entries are only a shortcut
+		int64_t t = now();
+		for (PrimedEntries::iterator it = _primed.begin(); it != _primed.end(); )
+		{
+			if (it->second.expires < t)
+				it = _primed.erase(it);
+			else
+				++it;
+		}
+		if (_primed.size() >= MAX_PRIMED)
+			_primed.clear();
+	}
+
+	Primed& primed = _primed[searchKey(parent, name)];
+	primed.attr = attr;
+	primed.expires = deadline(entryTimeout);
+	primed.entryTimeout = entryTimeout;
+	primed.attrTimeout = attrTimeout;
+}
+
+bool InodeTable::takePrimed(ino_t parent, const std::string& name, struct stat& attr, double& entryTimeout, double& attrTimeout)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (_primed.empty())
+		return false;
+	PrimedEntries::iterator it = _primed.find(searchKey(parent, name));
+	if (it == _primed.end())
+		return false;
+
+	bool valid = it->second.expires >= now();
+	if (valid)
+	{
+		attr = it->second.attr;
+		entryTimeout = it->second.entryTimeout;
+		attrTimeout = it->second.attrTimeout;
+
+		// Serve the getattr() that usually follows from the same attributes
+		Names::const_iterator nit = _names.find(it->first);
+		if (nit != _names.end())
+		{
+			Node& node = _nodes[nit->second];
+			node.attr = attr;
+			node.attrTimeout = attrTimeout;
+			node.attrExpires = deadline(attrTimeout);
+		}
+	}
+	_primed.erase(it);
+	return valid;
+}
+
+bool InodeTable::getAttr(ino_t ino, struct stat& attr, double& attrTimeout) const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	Nodes::const_iterator it = _nodes.find(ino);
+	if (it == _nodes.end() || it->second.attrExpires == 0 || it->second.attrExpires < now())
+		return false;
+	attr = it->second.attr;
+	attrTimeout = it->second.attrTimeout;
+	return true;
+}
+
+void InodeTable::dropPrimed(ino_t parent, const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (!_primed.empty())
+		_primed.erase(searchKey(parent, name));
+}
+
+void InodeTable::dropAttr(ino_t ino)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	Nodes::iterator it = _nodes.find(ino);
+	if (it != _nodes.end())
+		it->second.attrExpires = 0;
+}
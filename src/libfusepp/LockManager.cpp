@@ -0,0 +1,229 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <fusepp/LockManager.h>
+#include <fusepp/Error.h>
+#include <fusepp/Stats.h>
+#include "PathSlots.h"
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+using namespace fusepp;
+using namespace fusepp_impl;
+
+const size_t LockManager::DEFAULT_STRIPES;
+const size_t LockManager::CACHE_LINE;
+
+struct alignas(LockManager::CACHE_LINE) LockManager::Stripe
+{
+	pthread_rwlock_t lock;
+};
+
+struct alignas(LockManager::CACHE_LINE) LockManager::RangeShard
+{
+	struct Held
+	{
+		off_t start, end;
+		bool exclusive;
+	};
+	typedef std::unordered_map<std::string,std::vector<Held> > Files;
+
+	std::mutex mutex;
+	std::condition_variable released;
+	Files files;
+};
+
+namespace
+{
+	inline void countWait(uint64_t start)
+	{
+		Stats::count(Stats::LOCK_CONTENDED);
+		Stats::count(Stats::LOCK_WAIT_NANOS, now() - start);
+	}
+};
+
+LockManager::LockManager(size_t stripes)
+	: _memory(NULL), _stripes(NULL), _ranges(NULL), _mask(0)
+{
+	size_t count = 1;
+	while (count < stripes)
+		count <<= 1;
+	_mask = count - 1;
+
+	// new[] does not honor the alignment of the stripes before C++17
+	if (posix_memalign(&_memory, CACHE_LINE, count * (sizeof(Stripe) + sizeof(RangeShard))) != 0)
+		throw std::bad_alloc();
+	_stripes = static_cast<Stripe*>(_memory);
+	_ranges = reinterpret_cast<RangeShard*>(_stripes + count);
+
+	pthread_rwlockattr_t attr;
+	pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+	// Writers would otherwise wait for as long as readers keep coming
+	pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+	for (size_t i = 0; i < count; ++i)
+	{
+		pthread_rwlock_init(&_stripes[i].lock, &attr);
+		new (&_ranges[i]) RangeShard;
+	}
+	pthread_rwlockattr_destroy(&attr);
+}
+
+LockManager::~LockManager()
+{
+	for (size_t i = 0; i <= _mask; ++i)
+	{
+		pthread_rwlock_destroy(&_stripes[i].lock);
+		_ranges[i].~RangeShard();
+	}
+	free(_memory);
+}
+
+size_t LockManager::stripe(const std::string& path) const
+{
+	return (size_t)(hashPath(path) & _mask);
+}
+
+// ===========================================================================
+// Path locks
+// ===========================================================================
+
+void LockManager::lockStripe(size_t index, bool exclusive)
+{
+	pthread_rwlock_t* lock = &_stripes[index].lock;
+	if ((exclusive ? pthread_rwlock_trywrlock(lock) : pthread_rwlock_tryrdlock(lock)) == 0)
+		return;
+	uint64_t start = now();
+	int res = exclusive ? pthread_rwlock_wrlock(lock) : pthread_rwlock_rdlock(lock);
+	if (res != 0)
+		throw Error("fusepp::LockManager : could not lock a path: %s", strerror(res));
+	countWait(start);
+}
+
+void LockManager::unlockStripe(size_t index)
+{
+	pthread_rwlock_unlock(&_stripes[index].lock);
+}
+
+void LockManager::lock(const std::string& path)
+{
+	lockStripe(stripe(path), true);
+}
+
+void LockManager::unlock(const std::string& path)
+{
+	unlockStripe(stripe(path));
+}
+
+void LockManager::lockShared(const std::string& path)
+{
+	lockStripe(stripe(path), false);
+}
+
+void LockManager::unlockShared(const std::string& path)
+{
+	unlockStripe(stripe(path));
+}
+
+void LockManager::lock(const std::string& a, const std::string& b)
+{
+	// Stripes are always taken in increasing order, and once
+	size_t first = stripe(a), second = stripe(b);
+	if (first > second)
+		std::swap(first, second);
+	lockStripe(first, true);
+	if (second != first)
+		lockStripe(second, true);
+}
+
+void LockManager::unlock(const std::string& a, const std::string& b)
+{
+	size_t first = stripe(a), second = stripe(b);
+	unlockStripe(first);
+	if (second != first)
+		unlockStripe(second);
+}
+
+// ===========================================================================
+// Range locks
+// ===========================================================================
+
+void LockManager::lockRange(const std::string& path, off_t offset, off_t length, bool exclusive)
+{
+	RangeShard::Held range;
+	range.start = offset;
+	range.end = length > 0 ? offset + length : std::numeric_limits<off_t>::max();
+	range.exclusive = exclusive;
+
+	RangeShard& shard(_ranges[stripe(path)]);
+	std::unique_lock<std::mutex> lock(shard.mutex);
+	uint64_t start = 0;
+	for (;;)
+	{
+		bool conflict = false;
+		RangeShard::Files::const_iterator it = shard.files.find(path);
+		if (it != shard.files.end())
+		{
+			for (std::vector<RangeShard::Held>::const_iterator held = it->second.begin(); held != it->second.end() && !conflict; ++held)
+				conflict = (exclusive || held->exclusive) && held->start < range.end && range.start < held->end;
+		}
+		if (!conflict)
+			break;
+		if (!start)
+			start = now();
+		shard.released.wait(lock);
+	}
+	shard.files[path].push_back(range);
+	if (start)
+		countWait(start);
+}
+
+void LockManager::unlockRange(const std::string& path, off_t offset, off_t length, bool exclusive)
+{
+	off_t end = length > 0 ? offset + length : std::numeric_limits<off_t>::max();
+
+	RangeShard& shard(_ranges[stripe(path)]);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	RangeShard::Files::iterator it = shard.files.find(path);
+	if (it == shard.files.end())
+		return;
+	std::vector<RangeShard::Held>& held(it->second);
+	for (std::vector<RangeShard::Held>::iterator h = held.begin(); h != held.end(); ++h)
+	{
+		if (h->start == offset && h->end == end && h->exclusive == exclusive)
+		{
+			held.erase(h);
+			break;
+		}
+	}
+	if (held.empty())
+		shard.files.erase(it);
+	shard.released.notify_all();
+}
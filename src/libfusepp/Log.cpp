@@ -0,0 +1,350 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include <fusepp/Log.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <string>
+#include <vector>
+using namespace fusepp;
+
+namespace
+{
+	const char* const LEVEL_NAMES[] = { "DEBUG", "INFO", "WARNING", "ERROR" };
+
+	struct Record
+	{
+		int level;
+		char text[Log::MAX_MESSAGE_LENGTH + 1];
+	};
+
+	// Messages of one thread. The owning thread is the only one to move
+	// 'head', the flusher the only one to move 'tail'.
+	struct Ring
+	{
+		static const size_t CAPACITY = 256;
+
+		Ring() : head(0), tail(0), closed(false) {}
+
+		Record records[CAPACITY];
+		std::atomic<size_t> head;
+		std::atomic<size_t> tail;
+		// Set when the owning thread exits
+		std::atomic<bool> closed;
+	};
+
+	class Logger
+	{
+	public:
+		static Logger& instance()
+		{
+			// Never destroyed: threads may log until the very end
+			static Logger* logger = new Logger;
+			return *logger;
+		}
+
+		void registerRing(const std::shared_ptr<Ring>& ring)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_rings.push_back(ring);
+			start();
+		}
+
+		void wake()
+		{
+			_wake.notify_one();
+		}
+
+		// The flusher is started with the first ring, and again in a child
+		// process after fork()
+		void ensureRunning()
+		{
+			if (_running.load(std::memory_order_relaxed))
+				return;
+			std::lock_guard<std::mutex> lock(_mutex);
+			start();
+		}
+
+		void flush()
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			start();
+			unsigned long ticket = ++_flushRequested;
+			_wake.notify_one();
+			while (_running && _flushDone < ticket)
+				_flushed.wait(lock);
+		}
+
+		void stop()
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			if (!_running)
+			{
+				_stopped = true;
+				return;
+			}
+			_stopping = true;
+			_wake.notify_one();
+			lock.unlock();
+			pthread_join(_thread, NULL);
+			lock.lock();
+			_running = false;
+			_stopped = true;
+		}
+
+		inline bool isStopped() const { return _stopped.load(std::memory_order_relaxed); }
+
+		std::atomic<unsigned long> dropped;
+
+	private:
+		Logger()
+			: dropped(0), _running(false), _stopping(false), _stopped(false), _flushRequested(0), _flushDone(0), _reported(0)
+		{
+			pthread_atfork(forkPrepare, forkParent, forkChild);
+		}
+
+		// Called with the mutex held
+		void start()
+		{
+			if (_running || _stopping)
+				return;
+			if (pthread_create(&_thread, NULL, run, this) == 0)
+				_running = true;
+		}
+
+		static void* run(void* arg)
+		{
+			static_cast<Logger*>(arg)->loop();
+			return NULL;
+		}
+
+		void loop()
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			for (;;)
+			{
+				bool stopping = _stopping;
+				unsigned long requested = _flushRequested;
+				std::vector<std::shared_ptr<Ring> > rings(_rings);
+				lock.unlock();
+				drain(rings);
+				lock.lock();
+
+				// Rings of exited threads go away once they are empty
+				for (size_t i = 0; i < _rings.size(); )
+				{
+					Ring& ring = *_rings[i];
+					if (ring.closed.load() && ring.tail.load() == ring.head.load())
+					{
+						_rings[i] = _rings.back();
+						_rings.pop_back();
+					}
+					else
+						++i;
+				}
+
+				_flushDone = requested;
+				_flushed.notify_all();
+				if (stopping)
+					break;
+				if (!_stopping && _flushRequested == requested)
+					_wake.wait_for(lock, std::chrono::milliseconds(50));
+			}
+		}
+
+		void drain(const std::vector<std::shared_ptr<Ring> >& rings)
+		{
+			std::string out;
+			for (size_t i = 0; i < rings.size(); ++i)
+			{
+				Ring& ring = *rings[i];
+				size_t tail = ring.tail.load(std::memory_order_relaxed);
+				size_t head = ring.head.load(std::memory_order_acquire);
+				for (; tail != head; ++tail)
+				{
+					const Record& record = ring.records[tail % Ring::CAPACITY];
+					out += "[";
+					out += LEVEL_NAMES[record.level];
+					out += "] ";
+					out += record.text;
+					out += "\n";
+				}
+				ring.tail.store(tail, std::memory_order_release);
+			}
+
+			unsigned long dropped = this->dropped.load();
+			if (dropped != _reported)
+			{
+				char buffer[64];
+				snprintf(buffer, sizeof(buffer), "[WARNING] %lu log messages dropped\n", dropped - _reported);
+				out += buffer;
+				_reported = dropped;
+			}
+
+			if (!out.empty())
+			{
+				fwrite(out.data(), 1, out.size(), stderr);
+				fflush(stderr);
+			}
+		}
+
+		// Only the forking thread survives in the child: the flusher has to
+		// be started again, and what other threads queued is written by the
+		// parent
+		static void forkPrepare()
+		{
+			instance()._mutex.lock();
+		}
+		static void forkParent()
+		{
+			instance()._mutex.unlock();
+		}
+		static void forkChild();
+
+		std::mutex _mutex;
+		std::condition_variable _wake, _flushed;
+		std::vector<std::shared_ptr<Ring> > _rings;
+		pthread_t _thread;
+		std::atomic<bool> _running;
+		bool _stopping;
+		std::atomic<bool> _stopped;
+		unsigned long _flushRequested, _flushDone;
+		// Dropped messages already reported (flusher only)
+		unsigned long _reported;
+	};
+
+	struct RingHolder
+	{
+		~RingHolder()
+		{
+			if (ring)
+				ring->closed = true;
+		}
+
+		std::shared_ptr<Ring> ring;
+	};
+
+	thread_local RingHolder t_ring;
+
+	Ring& currentRing()
+	{
+		if (!t_ring.ring)
+		{
+			t_ring.ring = std::make_shared<Ring>();
+			Logger::instance().registerRing(t_ring.ring);
+		}
+		return *t_ring.ring;
+	}
+
+	void Logger::forkChild()
+	{
+		Logger& logger = instance();
+		logger._running = false;
+		for (size_t i = 0; i < logger._rings.size(); ++i)
+		{
+			Ring& ring = *logger._rings[i];
+			if (logger._rings[i] != t_ring.ring)
+			{
+				ring.tail.store(ring.head.load());
+				ring.closed = true;
+			}
+		}
+		logger._mutex.unlock();
+	}
+
+	// Writes what is left when the program exits; later messages are
+	// written directly
+	struct Shutdown
+	{
+		~Shutdown()
+		{
+			Logger::instance().stop();
+		}
+	} s_shutdown;
+};
+
+// ===========================================================================
+// Log implementation
+// ===========================================================================
+
+std::atomic<int> Log::_s_level(Log::LEVEL_INFO);
+const unsigned int Log::MAX_MESSAGE_LENGTH;
+
+void Log::setLevel(Level level)
+{
+	_s_level.store(level, std::memory_order_relaxed);
+}
+
+void Log::write(Level level, const char* format, ...)
+{
+	if (level < LEVEL_DEBUG || level >= LEVEL_NONE)
+		return;
+
+	Logger& logger = Logger::instance();
+	va_list arglist;
+	va_start(arglist, format);
+	if (logger.isStopped())
+	{
+		char text[MAX_MESSAGE_LENGTH + 1];
+		vsnprintf(text, sizeof(text), format, arglist);
+		va_end(arglist);
+		fprintf(stderr, "[%s] %s\n", LEVEL_NAMES[level], text);
+		return;
+	}
+
+	Ring& ring = currentRing();
+	size_t head = ring.head.load(std::memory_order_relaxed);
+	if (head - ring.tail.load(std::memory_order_acquire) >= Ring::CAPACITY)
+	{
+		va_end(arglist);
+		logger.dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	Record& record = ring.records[head % Ring::CAPACITY];
+	record.level = level;
+	vsnprintf(record.text, sizeof(record.text), format, arglist);
+	va_end(arglist);
+	ring.head.store(head + 1, std::memory_order_release);
+
+	logger.ensureRunning();
+	// Errors are worth writing out right away
+	if (level >= LEVEL_ERROR)
+		logger.wake();
+}
+
+void Log::flush()
+{
+	Logger::instance().flush();
+}
+
+unsigned long Log::getDropped()
+{
+	return Logger::instance().dropped.load();
+}
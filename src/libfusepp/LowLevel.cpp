@@ -0,0 +1,930 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include <fusepp/Application.h>
+#include <fusepp/Async.h>
+#include "hooks.h"
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include <atomic>
+using namespace fusepp;
+
+// A request waiting for its answer. The first answer takes 'req' away; if
+// nobody did when the last handle goes away, the request fails with EIO.
+struct fusepp::Request::State
+{
+	State(fuse_req_t req, ino_t ino, bool entry = false)
+		: req(req), ino(ino), entry(entry)
+	{}
+	virtual ~State();
+
+	std::atomic<fuse_req_t> req;
+	ino_t ino;
+	// Lookups hold a reference on 'ino' until the entry reaches the kernel
+	bool entry;
+};
+
+namespace fusepp_impl
+{
+
+	class LowLevelHooks
+	{
+	public:
+
+		static Application* app()
+		{
+			assert(Application::_s_instance);
+			return Application::_s_instance;
+		}
+
+		// Timeouts given by the file system, negative for the defaults
+		static double entryTimeout(double timeout)
+		{
+			return timeout < 0 ? app()->_entryTimeout : timeout;
+		}
+		static double attrTimeout(double timeout)
+		{
+			return timeout < 0 ? app()->_attrTimeout : timeout;
+		}
+
+		// Inode numbers we do not know anything about are reported with the
+		// same value libfuse uses in high-level mode
+		static const ino_t UNKNOWN_INO = 0xffffffff;
+
+		// Runs the path-based implementation of an operation on the path of
+		// 'ino' (optionally extended with 'name'), for file systems that do not
+		// implement the inode-based interfaces
+		static bool buildPath(ino_t ino, const char* name, std::string& path)
+		{
+			if (!app()->_inodes.path(ino, path))
+				return false;
+			if (name)
+			{
+				if (path.size() > 1)
+					path += "/";
+				path += name;
+			}
+			return true;
+		}
+
+		static int doLookup(ino_t parent, const std::string& name, ino_t ino, struct stat* buf)
+		{
+			if (app()->_ops.lookup)
+			{
+				CALL_FS_IMPL(lookup, -EIO, parent, name, ino, buf);
+			}
+
+			std::string& path = Arena::current()->string();
+			if (!buildPath(parent, name.c_str(), path))
+				return -ENOENT;
+			CALL_FS_IMPL(getattr, -ENOENT, path, buf);
+		}
+
+		static void lookup(fuse_req_t req, fuse_ino_t parent, const char* name)
+		{
+			ArenaScope arena;
+			const std::string& n = arena.getArena().string(name);
+			InodeTable& inodes = app()->_inodes;
+			ino_t ino = inodes.lookup(parent, n);
+			if (ino == 0)
+			{
+				fuse_reply_err(req, ENOENT);
+				return;
+			}
+
+			struct fuse_entry_param e;
+			memset(&e, 0, sizeof(e));
+			e.attr_timeout = app()->_attrTimeout;
+			e.entry_timeout = app()->_entryTimeout;
+
+			StatsFile::Kind stats = StatsFile::matchEntry(parent, name);
+			if (stats != StatsFile::NONE)
+			{
+				StatsFile::setInode(stats, ino);
+				StatsFile::getAttr(stats, &e.attr);
+				replyEntry(req, ino, e);
+				return;
+			}
+
+			if (!inodes.takePrimed(parent, n, e.attr, e.entry_timeout, e.attr_timeout))
+			{
+				std::string& path = arena.getArena().string();
+				bool snapshot = Snapshots::get() && buildPath(parent, name, path);
+				if (snapshot && Snapshots::take(path, &e.attr))
+				{
+					// Possibly stale: the kernel must not keep it, and asks
+					// the file system next time
+					e.entry_timeout = 0;
+					e.attr_timeout = 0;
+				}
+				else
+				{
+					if (app()->_ops.async_lookup)
+					{
+						asyncLookup(req, parent, name, ino);
+						return;
+					}
+
+					int res = doLookup(parent, n, ino, &e.attr);
+					if (snapshot)
+						Snapshots::record(path, res, e.attr);
+					if (res != 0)
+					{
+						dropEntry(ino);
+						replyError(req, -res);
+						return;
+					}
+				}
+			}
+
+			replyEntry(req, ino, e);
+		}
+
+		static void asyncLookup(fuse_req_t req, ino_t parent, const char* name, ino_t ino)
+		{
+			EntryReply reply(std::make_shared<Request::State>(req, ino, true));
+			CALL_FS_ASYNC(async_lookup, reply, parent, name, ino);
+		}
+
+		static void replyEntry(fuse_req_t req, ino_t ino, struct fuse_entry_param& e)
+		{
+			e.ino = ino;
+			e.attr.st_ino = ino;
+			if (fuse_reply_entry(req, &e) != 0)
+			{
+				// The kernel did not get the entry, so it will never forget it
+				dropEntry(ino);
+			}
+		}
+
+		// A missing name is replied as an entry with no inode, which the
+		// kernel caches for the negative timeout
+		static void replyError(fuse_req_t req, int err)
+		{
+			double timeout = app()->_negativeTimeout;
+			if (err != ENOENT || timeout <= 0)
+			{
+				fuse_reply_err(req, err);
+				return;
+			}
+			struct fuse_entry_param e;
+			memset(&e, 0, sizeof(e));
+			e.entry_timeout = timeout;
+			fuse_reply_entry(req, &e);
+		}
+
+		// Undoes the lookup count taken for an entry that was not sent
+		static void dropEntry(ino_t ino)
+		{
+			if (app()->_inodes.forget(ino, 1))
+				doForget(ino);
+		}
+
+		static void doForget(ino_t ino)
+		{
+			const Operations& ops = app()->_ops;
+			if (!ops.forget)
+				return;
+			try {
+				ops.forget(ops.target, ino);
+			} catch (std::exception& err) {
+				FUSEPP_LOG_ERROR("Unhandled std::exception in forget(): %s", err.what());
+			} catch (...) {
+				FUSEPP_LOG_ERROR("Unhandled (unknown) exception in forget()!");
+			}
+		}
+
+		static void forget(fuse_req_t req, fuse_ino_t ino, unsigned long nlookup)
+		{
+			if (app()->_inodes.forget(ino, nlookup))
+			{
+				StatsFile::forget(ino);
+				doForget(ino);
+			}
+			fuse_reply_none(req);
+		}
+
+		static int doGetattr(ino_t ino, struct stat* buf)
+		{
+			if (app()->_ops.inode_getattr)
+			{
+				CALL_FS_IMPL(inode_getattr, -EIO, ino, buf);
+			}
+			if (!app()->_ops.getattr)
+				return -ENOSYS;
+
+			std::string& path = Arena::current()->string();
+			if (!buildPath(ino, NULL, path))
+				return -ENOENT;
+			CALL_FS_IMPL(getattr, -ENOENT, path, buf);
+		}
+
+		static void getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi)
+		{
+			ArenaScope arena;
+			struct stat buf;
+			double timeout = app()->_attrTimeout;
+			StatsFile::Kind stats = StatsFile::matchInode(ino);
+			if (stats != StatsFile::NONE)
+				StatsFile::getAttr(stats, &buf);
+			else if (!app()->_inodes.getAttr(ino, buf, timeout))
+			{
+				std::string& path = arena.getArena().string();
+				bool snapshot = Snapshots::get() && app()->_inodes.path(ino, path);
+				if (snapshot && Snapshots::take(path, &buf))
+					timeout = 0;
+				else
+				{
+					if (app()->_ops.async_getattr)
+					{
+						AttrReply reply(std::make_shared<Request::State>(req, ino));
+						CALL_FS_ASYNC(async_getattr, reply, ino);
+					}
+
+					memset(&buf, 0, sizeof(buf));
+					int res = doGetattr(ino, &buf);
+					if (snapshot)
+						Snapshots::record(path, res, buf);
+					if (res != 0)
+					{
+						fuse_reply_err(req, -res);
+						return;
+					}
+				}
+			}
+			buf.st_ino = ino;
+			fuse_reply_attr(req, &buf, timeout);
+		}
+
+		// Serializes the entries of a directory in the format expected by the
+		// kernel, straight into a reply of at most 'size' bytes. Listings made
+		// with add(name, id) are numbered by the filler: entries before the
+		// requested offset are skipped and the ones that do not fit are
+		// dropped, to be produced again by the next call.
+		class LowLevelDirectoryFiller : public FS_readdir::DirectoryFiller
+		{
+		public:
+			// The reply is built in 'arena', or on the heap for fillers that
+			// outlive the hook
+			LowLevelDirectoryFiller(fuse_req_t req, ino_t ino, size_t size, off_t offset, Arena* arena)
+				: FS_readdir::DirectoryFiller(offset), _req(req), _ino(ino), _buffer(size, ArenaAllocator<char>(arena)), _used(0), _index(0), _full(false)
+			{}
+			void add(const std::string& name, ino_t id = INVALID_ID)
+			{
+				++_index;
+				if (_index <= getOffset())
+					return;
+				fill(name, _index, NULL);
+			}
+			bool add(const std::string& name, ino_t id, off_t cookie)
+			{
+				assert(cookie != 0);
+				return fill(name, cookie, NULL);
+			}
+			bool add(const std::string& name, const struct stat& attr, off_t cookie, double entryTimeout, double attrTimeout)
+			{
+				if (cookie == 0)
+				{
+					++_index;
+					if (_index <= getOffset())
+						return true;
+					cookie = _index;
+				}
+				if (!fill(name, cookie, &attr))
+					return false;
+
+				// libfuse 2 has no readdirplus: keep the attributes for the
+				// lookup the kernel is about to send instead
+				app()->_inodes.prime(_ino, name, attr,
+					LowLevelHooks::entryTimeout(entryTimeout), LowLevelHooks::attrTimeout(attrTimeout));
+				return true;
+			}
+			void reply()
+			{
+				fuse_reply_buf(_req, _used ? &_buffer[0] : NULL, _used);
+			}
+		private:
+			bool fill(const std::string& name, off_t offset, const struct stat* attr)
+			{
+				if (_full)
+					return false;
+
+				struct stat s;
+				memset(&s, 0, sizeof(s));
+				if (attr)
+					s.st_mode = attr->st_mode;
+				if (!app()->_inodes.find(_ino, name, s.st_ino))
+					s.st_ino = UNKNOWN_INO;
+
+				size_t remaining = _buffer.size() - _used;
+				size_t entsize = fuse_add_direntry(_req, remaining ? &_buffer[_used] : NULL, remaining, name.c_str(), &s, offset);
+				if (entsize > remaining)
+				{
+					_full = true;
+					return false;
+				}
+				_used += entsize;
+				return true;
+			}
+
+			fuse_req_t _req;
+			ino_t _ino;
+			ArenaVector<char> _buffer;
+			size_t _used;
+			off_t _index;
+			bool _full;
+		};
+
+		static int doReaddir(ino_t ino, FS_readdir::DirectoryFiller& filler)
+		{
+			if (StatsFile::matchInode(ino) == StatsFile::DIRECTORY)
+			{
+				StatsFile::fill(filler);
+				return 0;
+			}
+			if (!app()->_ops.inode_readdir && !app()->_ops.readdir)
+				return -ENOSYS;
+			if (app()->_ops.inode_readdir)
+			{
+				CALL_FS_IMPL(inode_readdir, -EACCES, ino, filler);
+			}
+
+			std::string& path = Arena::current()->string();
+			if (!buildPath(ino, NULL, path))
+				return -ENOENT;
+			CALL_FS_IMPL(readdir, -EACCES, path, filler);
+		}
+
+		struct DirectoryState : public Request::State
+		{
+			DirectoryState(fuse_req_t req, ino_t ino, size_t size, off_t offset)
+				: Request::State(req, ino), filler(req, ino, size, offset, NULL)
+			{}
+			LowLevelDirectoryFiller filler;
+		};
+
+		static void readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, struct fuse_file_info* fi)
+		{
+			ArenaScope arena;
+			if (app()->_ops.async_readdir && StatsFile::matchInode(ino) == StatsFile::NONE)
+			{
+				DirectoryReply reply(std::make_shared<DirectoryState>(req, ino, size, off));
+				CALL_FS_ASYNC(async_readdir, reply, ino);
+			}
+
+			LowLevelDirectoryFiller filler(req, ino, size, off, &arena.getArena());
+			int res = doReaddir(ino, filler);
+			if (res != 0)
+				fuse_reply_err(req, -res);
+			else
+				filler.reply();
+		}
+
+		static void init(void* userdata, struct fuse_conn_info* conn)
+		{
+			enableSplice(conn);
+			Snapshots::start();
+		}
+
+		static int doOpen(ino_t ino, FileInfo& info)
+		{
+			if (StatsFile::matchInode(ino) == StatsFile::FILE)
+				return StatsFile::open(info.get());
+			if (!app()->_ops.open)
+				return 0;
+			std::string& path = Arena::current()->string();
+			if (!buildPath(ino, NULL, path))
+				return -ENOENT;
+			CALL_FS_IMPL(open, -EACCES, path, info);
+		}
+
+		static void open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi)
+		{
+			ArenaScope arena;
+			FileInfo info(fi);
+			int res = doOpen(ino, info);
+			if (res != 0)
+			{
+				fuse_reply_err(req, -res);
+				return;
+			}
+			if (StatsFile::matchInode(ino) == StatsFile::NONE)
+				OpenFile::attach(fi);
+			if (fuse_reply_open(req, fi) == -ENOENT)
+			{
+				// Interrupted: the kernel will never release this file
+				doRelease(ino, fi);
+			}
+		}
+
+		static int doRelease(ino_t ino, struct fuse_file_info* fi)
+		{
+			if (StatsFile::matchInode(ino) == StatsFile::FILE)
+			{
+				StatsFile::release(fi);
+				return 0;
+			}
+			std::string& path = Arena::current()->string();
+			bool found = buildPath(ino, NULL, path);
+			OpenFile::detach(fi, found ? &path : NULL);
+			if (!app()->_ops.release)
+				return 0;
+			if (!found)
+				return -ENOENT;
+			FileInfo info(fi);
+			CALL_FS_IMPL(release, -EIO, path, info);
+		}
+
+		static void release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi)
+		{
+			ArenaScope arena;
+			fuse_reply_err(req, -doRelease(ino, fi));
+		}
+
+		// Pending writes are made before reading, so that a handle reads
+		// what it wrote
+		static void drainWrites(ino_t ino, FileHandle& handle)
+		{
+			std::string& path = Arena::current()->string();
+			if (handle.getOpenFile() && buildPath(ino, NULL, path))
+				handle.getOpenFile()->drainQuietly(path, handle.getInfo());
+		}
+
+		static int doRead(ino_t ino, ReadBuffer& buf, off_t offset, struct fuse_file_info* fi)
+		{
+			if (StatsFile::matchInode(ino) == StatsFile::FILE)
+				return StatsFile::read(fi, buf, offset);
+			if (!app()->_ops.read)
+				return -ENOSYS;
+			std::string& path = Arena::current()->string();
+			if (!buildPath(ino, NULL, path))
+				return -ENOENT;
+			FileHandle handle(fi);
+			if (handle.getOpenFile())
+				return handle.getOpenFile()->read(path, buf, offset, handle.getInfo());
+			CALL_FS_IMPL(read, -EIO, path, buf, offset, handle.getInfo());
+		}
+
+		struct ReadState : public Request::State
+		{
+			ReadState(fuse_req_t req, ino_t ino, size_t size)
+				: Request::State(req, ino), buffer(size, true)
+			{}
+			ReadBuffer buffer;
+		};
+
+		static void replyData(fuse_req_t req, ReadBuffer& buf)
+		{
+			// Asynchronous replies come from outside of the hooks: the scope
+			// provides an arena for them
+			ArenaScope arena;
+			struct fuse_bufvec* bufv = static_cast<struct fuse_bufvec*>(arena.getArena().allocate(
+				bufvecSize(buf.getSegments().size()), alignof(struct fuse_bufvec)));
+			buf.toBufvec(bufv);
+			fuse_reply_data(req, bufv, FUSE_BUF_SPLICE_MOVE);
+		}
+
+		static void read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset, struct fuse_file_info* fi)
+		{
+			ArenaScope arena;
+			if (app()->_ops.async_read && StatsFile::matchInode(ino) == StatsFile::NONE)
+			{
+				FileHandle handle(fi);
+				drainWrites(ino, handle);
+				ReadReply reply(std::make_shared<ReadState>(req, ino, size));
+				CALL_FS_ASYNC(async_read, reply, ino, offset, handle.getInfo().getHandle());
+			}
+
+			// The reply is sent before 'buf' goes away, so memory owned by the
+			// implementation can be referenced instead of copied
+			ReadBuffer buf(size, true);
+			int res = doRead(ino, buf, offset, fi);
+			if (res < 0)
+			{
+				fuse_reply_err(req, -res);
+				return;
+			}
+			replyData(req, buf);
+		}
+
+		static int doWrite(ino_t ino, WriteBuffer& buf, off_t offset, struct fuse_file_info* fi)
+		{
+			std::string& path = Arena::current()->string();
+			if (!buildPath(ino, NULL, path))
+				return -ENOENT;
+			FileHandle handle(fi);
+			if (handle.getOpenFile())
+				return handle.getOpenFile()->write(path, buf, offset, handle.getInfo());
+			CALL_FS_IMPL(write, -EIO, path, buf, offset, handle.getInfo());
+		}
+
+		static void write_buf(fuse_req_t req, fuse_ino_t ino, struct fuse_bufvec* bufv, off_t offset, struct fuse_file_info* fi)
+		{
+			ArenaScope arena;
+			WriteBuffer buf(bufv);
+			int res = doWrite(ino, buf, offset, fi);
+			if (res < 0)
+				fuse_reply_err(req, -res);
+			else
+				fuse_reply_write(req, res);
+		}
+
+		static int doFlush(ino_t ino, bool sync, bool datasync, struct fuse_file_info* fi)
+		{
+			if (StatsFile::matchInode(ino) == StatsFile::FILE)
+				return 0;
+			std::string& path = Arena::current()->string();
+			if (!buildPath(ino, NULL, path))
+				return -ENOENT;
+			FileHandle handle(fi);
+			FileInfo& info(handle.getInfo());
+			int res = handle.getOpenFile() ? handle.getOpenFile()->drain(path, info) : 0;
+			if (res != 0)
+				return res;
+			if (sync)
+			{
+				if (!app()->_ops.fsync)
+					return 0;
+				CALL_FS_IMPL(fsync, -EIO, path, datasync, info);
+			}
+			if (!app()->_ops.flush)
+				return 0;
+			CALL_FS_IMPL(flush, -EIO, path, info);
+		}
+
+		static void flush(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi)
+		{
+			ArenaScope arena;
+			fuse_reply_err(req, -doFlush(ino, false, false, fi));
+		}
+
+		static void fsync(fuse_req_t req, fuse_ino_t ino, int datasync, struct fuse_file_info* fi)
+		{
+			ArenaScope arena;
+			fuse_reply_err(req, -doFlush(ino, true, datasync != 0, fi));
+		}
+
+		// Answers a size probe (size 0) or sends the value or list (see copyXattr)
+		static void replyXattr(fuse_req_t req, int res, const std::string& data, size_t size)
+		{
+			if (res >= 0 && size > 0 && data.size() > size)
+				res = -ERANGE;
+			if (res < 0)
+				fuse_reply_err(req, -res);
+			else if (size == 0)
+				fuse_reply_xattr(req, data.size());
+			else
+				fuse_reply_buf(req, data.data(), data.size());
+		}
+
+		static int doGetxattr(ino_t ino, const std::string& name, std::string& value)
+		{
+			if (StatsFile::matchInode(ino) != StatsFile::NONE)
+				return -ENODATA;
+			std::string& path = Arena::current()->string();
+			if (!buildPath(ino, NULL, path))
+				return -ENOENT;
+			CALL_FS_IMPL(getxattr, -EIO, path, name, value);
+		}
+
+		static void getxattr(fuse_req_t req, fuse_ino_t ino, const char* name, size_t size)
+		{
+			ArenaScope arena;
+			std::string& value = arena.getArena().string();
+			replyXattr(req, doGetxattr(ino, arena.getArena().string(name), value), value, size);
+		}
+
+		static int doListxattr(ino_t ino, std::vector<std::string>& names)
+		{
+			if (StatsFile::matchInode(ino) != StatsFile::NONE)
+				return 0;
+			std::string& path = Arena::current()->string();
+			if (!buildPath(ino, NULL, path))
+				return -ENOENT;
+			CALL_FS_IMPL(listxattr, -EIO, path, names);
+		}
+
+		static void listxattr(fuse_req_t req, fuse_ino_t ino, size_t size)
+		{
+			ArenaScope arena;
+			std::vector<std::string> names;
+			int res = doListxattr(ino, names);
+			std::string& list = arena.getArena().string();
+			joinXattrNames(names, list);
+			replyXattr(req, res, list, size);
+		}
+
+		static int doSetxattr(ino_t ino, const std::string& name, const std::string& value, int flags)
+		{
+			if (StatsFile::matchInode(ino) != StatsFile::NONE)
+				return -ENOTSUP;
+			std::string& path = Arena::current()->string();
+			if (!buildPath(ino, NULL, path))
+				return -ENOENT;
+			CALL_FS_IMPL(setxattr, -EIO, path, name, value, flags);
+		}
+
+		static void setxattr(fuse_req_t req, fuse_ino_t ino, const char* name, const char* value, size_t size, int flags)
+		{
+			ArenaScope arena;
+			std::string& v = arena.getArena().string();
+			v.assign(value, size);
+			fuse_reply_err(req, -doSetxattr(ino, arena.getArena().string(name), v, flags));
+		}
+
+		static int doRemovexattr(ino_t ino, const std::string& name)
+		{
+			if (StatsFile::matchInode(ino) != StatsFile::NONE)
+				return -ENOTSUP;
+			std::string& path = Arena::current()->string();
+			if (!buildPath(ino, NULL, path))
+				return -ENOENT;
+			CALL_FS_IMPL(removexattr, -EIO, path, name);
+		}
+
+		static void removexattr(fuse_req_t req, fuse_ino_t ino, const char* name)
+		{
+			ArenaScope arena;
+			fuse_reply_err(req, -doRemovexattr(ino, arena.getArena().string(name)));
+		}
+
+	};
+
+};
+
+// ===========================================================================
+// Asynchronous replies
+// ===========================================================================
+
+using fusepp_impl::LowLevelHooks;
+
+Request::State::~State()
+{
+	fuse_req_t r = req.exchange(NULL);
+	if (!r)
+		return;
+	FUSEPP_LOG_ERROR("Request on inode %lu dropped without an answer", (unsigned long)ino);
+	if (entry)
+		LowLevelHooks::dropEntry(ino);
+	fuse_reply_err(r, EIO);
+}
+
+Request::Request()
+{
+}
+Request::Request(std::shared_ptr<State> state)
+	: _state(state)
+{
+}
+Request::~Request()
+{
+}
+
+struct fuse_req* Request::take()
+{
+	return _state ? _state->req.exchange(NULL) : NULL;
+}
+
+bool Request::isPending() const
+{
+	return _state && _state->req.load() != NULL;
+}
+
+void Request::fail(int err)
+{
+	fuse_req_t req = take();
+	if (req)
+		fuse_reply_err(req, err);
+}
+
+AttrReply::AttrReply(std::shared_ptr<State> state)
+	: Request(state)
+{
+}
+
+void AttrReply::reply(const struct stat& attr, double attrTimeout)
+{
+	fuse_req_t req = take();
+	if (!req)
+		return;
+	struct stat buf = attr;
+	buf.st_ino = _state->ino;
+	fuse_reply_attr(req, &buf, LowLevelHooks::attrTimeout(attrTimeout));
+}
+
+EntryReply::EntryReply(std::shared_ptr<State> state)
+	: Request(state)
+{
+}
+
+void EntryReply::reply(const struct stat& attr, double entryTimeout, double attrTimeout)
+{
+	fuse_req_t req = take();
+	if (!req)
+		return;
+	struct fuse_entry_param e;
+	memset(&e, 0, sizeof(e));
+	e.attr = attr;
+	e.entry_timeout = LowLevelHooks::entryTimeout(entryTimeout);
+	e.attr_timeout = LowLevelHooks::attrTimeout(attrTimeout);
+	LowLevelHooks::replyEntry(req, _state->ino, e);
+}
+
+void EntryReply::fail(int err)
+{
+	fuse_req_t req = take();
+	if (!req)
+		return;
+	LowLevelHooks::dropEntry(_state->ino);
+	LowLevelHooks::replyError(req, err);
+}
+
+DirectoryReply::DirectoryReply(std::shared_ptr<State> state)
+	: Request(state)
+{
+}
+
+FS_readdir::DirectoryFiller& DirectoryReply::getFiller()
+{
+	assert(_state);
+	return static_cast<LowLevelHooks::DirectoryState*>(_state.get())->filler;
+}
+
+void DirectoryReply::reply()
+{
+	if (take())
+		static_cast<LowLevelHooks::DirectoryState*>(_state.get())->filler.reply();
+}
+
+ReadReply::ReadReply(std::shared_ptr<State> state)
+	: Request(state)
+{
+}
+
+ReadBuffer& ReadReply::getBuffer()
+{
+	assert(_state);
+	return static_cast<LowLevelHooks::ReadState*>(_state.get())->buffer;
+}
+
+void ReadReply::reply()
+{
+	fuse_req_t req = take();
+	if (req)
+		LowLevelHooks::replyData(req, static_cast<LowLevelHooks::ReadState*>(_state.get())->buffer);
+}
+
+
+void Application::getFuseLowLevelOperations(struct fuse_lowlevel_ops* fuseOps) const
+{
+	if (!_ops.async_lookup && !_ops.lookup && !_ops.getattr)
+		throw Error("fusepp::Application::getFuseLowLevelOperations() : the file system must implement FS_async_lookup, FS_lookup or FS_getattr");
+
+	fuse_lowlevel_ops& ops = *fuseOps;
+	memset(&ops, 0, sizeof(ops));
+
+	ops.lookup = fusepp_impl::LowLevelHooks::lookup;
+	ops.forget = fusepp_impl::LowLevelHooks::forget;
+
+	// The statistics file needs the hooks whether the file system
+	// implements the operations or not
+	bool stats = Stats::isEnabled();
+	if (_ops.async_getattr || _ops.inode_getattr || _ops.getattr || stats)
+		ops.getattr = fusepp_impl::LowLevelHooks::getattr;
+	if (_ops.async_readdir || _ops.inode_readdir || _ops.readdir || stats)
+		ops.readdir = fusepp_impl::LowLevelHooks::readdir;
+	// Coalesced writes and read-ahead need every handle to go through the hooks
+	bool coalescing = _ops.write && _writeCoalescingSize > 0;
+	bool readAhead = _ops.read && _readAheadWindow > 0;
+	if (_ops.open || stats || coalescing || readAhead)
+	{
+		ops.open = fusepp_impl::LowLevelHooks::open;
+		ops.release = fusepp_impl::LowLevelHooks::release;
+	}
+	if (_ops.async_read || _ops.read || stats) ops.read = fusepp_impl::LowLevelHooks::read;
+	if (_ops.write) ops.write_buf = fusepp_impl::LowLevelHooks::write_buf;
+	if (_ops.flush || coalescing)
+	{
+		ops.flush = fusepp_impl::LowLevelHooks::flush;
+		ops.fsync = fusepp_impl::LowLevelHooks::fsync;
+	}
+	if (_ops.getxattr) ops.getxattr = fusepp_impl::LowLevelHooks::getxattr;
+	if (_ops.listxattr) ops.listxattr = fusepp_impl::LowLevelHooks::listxattr;
+	if (_ops.setxattr)
+	{
+		ops.setxattr = fusepp_impl::LowLevelHooks::setxattr;
+		ops.removexattr = fusepp_impl::LowLevelHooks::removexattr;
+	}
+	ops.init = fusepp_impl::LowLevelHooks::init;
+}
+
+bool Application::invalidateInode(ino_t ino, off_t offset, off_t length)
+{
+	// Attributes remembered on our side would otherwise outlive the kernel's
+	_inodes.dropAttr(ino);
+	std::string path;
+	if (_snapshot && _inodes.path(ino, path))
+		_snapshot->forget(path);
+	return fusepp_impl::Notifier::inode(ino, offset, length);
+}
+
+bool Application::invalidateEntry(ino_t parent, const std::string& name)
+{
+	_inodes.dropPrimed(parent, name);
+	std::string path;
+	if (_snapshot && _inodes.path(parent, path))
+		_snapshot->forget(path.size() > 1 ? path + "/" + name : "/" + name);
+	return fusepp_impl::Notifier::entry(parent, name);
+}
+
+bool Application::invalidatePath(const std::string& path)
+{
+	ino_t parent = InodeTable::ROOT, ino = InodeTable::ROOT;
+	std::string name;
+	size_t start = 1;
+	while (start < path.size())
+	{
+		size_t end = std::min(path.find('/', start), path.size());
+		if (end > start)
+		{
+			// A name the kernel did not look up is not cached either
+			name = path.substr(start, end - start);
+			parent = ino;
+			if (!_inodes.find(parent, name, ino))
+				return invalidateEntry(parent, name);
+		}
+		start = end + 1;
+	}
+	if (ino == InodeTable::ROOT)
+		return invalidateInode(ino);
+	return invalidateEntry(parent, name) && invalidateInode(ino);
+}
+
+int Application::runLowLevel(int argc, char* argv[])
+{
+	fuse_lowlevel_ops ops;
+	getFuseLowLevelOperations(&ops);
+
+	struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+	char* mountpoint = NULL;
+	int multithreaded = 0, foreground = 0;
+	int err = -1;
+
+	if (fuse_parse_cmdline(&args, &mountpoint, &multithreaded, &foreground) != -1 && mountpoint)
+	{
+		struct fuse_chan* ch = fuse_mount(mountpoint, &args);
+		if (ch)
+		{
+			struct fuse_session* se = fuse_lowlevel_new(&args, &ops, sizeof(ops), this);
+			if (se)
+			{
+				if (fuse_set_signal_handlers(se) != -1)
+				{
+					fuse_session_add_chan(se, ch);
+					if (fuse_daemonize(foreground) != -1)
+					{
+						// Started after daemonizing, which only keeps the
+						// calling thread
+						fusepp_impl::Notifier::start(ch, _invalidationRate);
+						if (_workerCount)
+							err = fusepp_impl::Workers::run(se, multithreaded ? _workerCount : 1);
+						else
+							err = multithreaded ? fuse_session_loop_mt(se) : fuse_session_loop(se);
+						fusepp_impl::Notifier::stop();
+					}
+					fuse_remove_signal_handlers(se);
+					fuse_session_remove_chan(ch);
+				}
+				fuse_session_destroy(se);
+			}
+			fuse_unmount(mountpoint, ch);
+		}
+	}
+	free(mountpoint);
+	fuse_opt_free_args(&args);
+
+	return err ? 1 : 0;
+}
@@ -0,0 +1,883 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include <fusepp/NamespaceIndex.h>
+#include <fusepp/Arena.h>
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define FUSEPP_HAVE_CRC32
+#endif
+using namespace fusepp;
+
+const size_t NamespaceIndex::MAX_READERS;
+
+namespace
+{
+	// Entries are probed 16 at a time, from the group given by the top bits
+	// of the hash of their name, so that the table is ordered by hash but
+	// for the entries pushed into the next groups. Their tags are the low 7
+	// bits of the hash, or one of the following for free slots. A probe
+	// stops at the first group with an empty slot.
+	const size_t GROUP_SIZE = 16;
+	const uint8_t EMPTY = 0x80;
+	const uint8_t DELETED = 0xfe;
+
+	static_assert(sizeof(std::atomic<uint8_t>) == 1, "the tags of a group are loaded at once");
+
+	inline uint64_t mix(uint64_t hash)
+	{
+		hash ^= hash >> 33;
+		hash *= 0xff51afd7ed558ccdULL;
+		hash ^= hash >> 33;
+		hash *= 0xc4ceb9fe1a85ec53ULL;
+		hash ^= hash >> 33;
+		return hash;
+	}
+
+	uint64_t hashPortable(const char* name, size_t length)
+	{
+		uint64_t hash = 0x9e3779b97f4a7c15ULL ^ length, word;
+		for (; length >= 8; name += 8, length -= 8)
+		{
+			memcpy(&word, name, 8);
+			hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+			hash ^= hash >> 32;
+		}
+		if (length > 0)
+		{
+			word = 0;
+			memcpy(&word, name, length);
+			hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+		}
+		return mix(hash);
+	}
+
+#ifdef FUSEPP_HAVE_CRC32
+	// Two CRC32 lanes make up 64 bits. CRC32 is linear, so the second one
+	// hashes a multiple of the data rather than the data itself.
+	__attribute__((target("sse4.2")))
+	uint64_t hashCrc32(const char* name, size_t length)
+	{
+		uint64_t low = length, high = ~(uint64_t)length & 0xffffffff, word;
+		for (; length >= 8; name += 8, length -= 8)
+		{
+			memcpy(&word, name, 8);
+			low = _mm_crc32_u64(low, word);
+			high = _mm_crc32_u64(high, word * 0x9e3779b97f4a7c15ULL);
+		}
+		if (length > 0)
+		{
+			word = 0;
+			memcpy(&word, name, length);
+			low = _mm_crc32_u64(low, word);
+			high = _mm_crc32_u64(high, word * 0x9e3779b97f4a7c15ULL);
+		}
+		return mix((high << 32) | low);
+	}
+#endif
+
+	typedef uint64_t (*HashFunction)(const char*, size_t);
+
+	HashFunction selectHash()
+	{
+#ifdef FUSEPP_HAVE_CRC32
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("sse4.2"))
+			return hashCrc32;
+#endif
+		return hashPortable;
+	}
+
+	inline uint64_t hashName(const char* name, size_t length)
+	{
+		static const HashFunction hash = selectHash();
+		return hash(name, length);
+	}
+
+	inline uint8_t tagOf(uint64_t hash)
+	{
+		return (uint8_t)(hash & 0x7f);
+	}
+
+	// Position of an entry in a listing, which does not depend on the table
+	// it is in: the hash, shifted to leave room for the 0 of the first call
+	inline off_t cookieOf(uint64_t hash)
+	{
+		return (off_t)(hash >> 2) + 1;
+	}
+
+	// Bit i of 'match' is set when tag i of the group is 'tag', and bit i of
+	// 'empty' when slot i is empty
+	inline void matchGroup(const std::atomic<uint8_t>* tags, uint8_t tag, unsigned int& match, unsigned int& empty)
+	{
+		// ThreadSanitizer cannot tell the vector load from a race
+#if defined(__SSE2__) && !defined(__SANITIZE_THREAD__)
+		__m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tags));
+		match = _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)tag)));
+		empty = _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)EMPTY)));
+		// Pairs with the release stores of the tags: the entries they
+		// stand for are visible
+		std::atomic_thread_fence(std::memory_order_acquire);
+#else
+		match = empty = 0;
+		for (size_t i = 0; i < GROUP_SIZE; ++i)
+		{
+			uint8_t t = tags[i].load(std::memory_order_acquire);
+			match |= (unsigned int)(t == tag) << i;
+			empty |= (unsigned int)(t == EMPTY) << i;
+		}
+#endif
+	}
+
+	// Reader slots, shared by all the indexes of the process. A reader
+	// announces the epoch it started in; what was unlinked in an epoch is
+	// freed once every reader announces a later one.
+	class Epochs
+	{
+	public:
+		struct Slot
+		{
+			// 0 while the owner does not read
+			std::atomic<uint64_t> epoch;
+			std::atomic<bool> taken;
+			char padding[64 - sizeof(std::atomic<uint64_t>) - sizeof(std::atomic<bool>)];
+		};
+
+		static Epochs& instance()
+		{
+			static Epochs* epochs = new Epochs;
+			return *epochs;
+		}
+
+		// Returns NULL when all the slots are taken
+		Slot* acquire()
+		{
+			for (size_t i = 0; i < NamespaceIndex::MAX_READERS; ++i)
+			{
+				bool taken = false;
+				if (_slots[i].taken.load(std::memory_order_relaxed)
+					|| !_slots[i].taken.compare_exchange_strong(taken, true))
+					continue;
+				size_t highest = _highest.load();
+				while (highest <= i && !_highest.compare_exchange_weak(highest, i + 1))
+					;
+				return &_slots[i];
+			}
+			return NULL;
+		}
+
+		void release(Slot* slot)
+		{
+			slot->epoch.store(0, std::memory_order_release);
+			slot->taken.store(false, std::memory_order_release);
+		}
+
+		// Acquire: a reader that sees an epoch also sees what was unlinked
+		// before it began
+		inline uint64_t current() const { return _epoch.load(std::memory_order_acquire); }
+
+		// Ends the current epoch and returns it
+		inline uint64_t advance() { return _epoch.fetch_add(1); }
+
+		// Oldest epoch a reader may still be in
+		uint64_t oldest() const
+		{
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (shared.load() > 0)
+				return 0;
+			uint64_t oldest = UINT64_MAX;
+			size_t highest = _highest.load();
+			for (size_t i = 0; i < highest; ++i)
+			{
+				uint64_t epoch = _slots[i].epoch.load();
+				if (epoch != 0 && epoch < oldest)
+					oldest = epoch;
+			}
+			return oldest;
+		}
+
+		// Readers that did not get a slot
+		std::atomic<unsigned int> shared;
+
+	private:
+		Epochs()
+			: shared(0), _highest(0), _epoch(1)
+		{
+			for (size_t i = 0; i < NamespaceIndex::MAX_READERS; ++i)
+			{
+				_slots[i].epoch.store(0, std::memory_order_relaxed);
+				_slots[i].taken.store(false, std::memory_order_relaxed);
+			}
+		}
+
+		Slot _slots[NamespaceIndex::MAX_READERS];
+		std::atomic<size_t> _highest;
+		std::atomic<uint64_t> _epoch;
+	};
+
+	struct ReaderHolder
+	{
+		ReaderHolder()
+			: slot(NULL), depth(0), tried(false)
+		{}
+		~ReaderHolder()
+		{
+			if (slot)
+				Epochs::instance().release(slot);
+		}
+
+		Epochs::Slot* slot;
+		unsigned int depth;
+		bool tried;
+	};
+
+	thread_local ReaderHolder t_reader;
+
+	// Nothing the calling thread reads from an index is freed while it
+	// exists. Sections nest.
+	class ReadSection
+	{
+	public:
+		ReadSection()
+		{
+			ReaderHolder& reader(t_reader);
+			if (reader.depth++ > 0)
+				return;
+			Epochs& epochs(Epochs::instance());
+			if (!reader.tried)
+			{
+				reader.slot = epochs.acquire();
+				reader.tried = true;
+			}
+			if (reader.slot)
+				reader.slot->epoch.store(epochs.current(), std::memory_order_relaxed);
+			else
+				epochs.shared.fetch_add(1, std::memory_order_relaxed);
+			// Pairs with the fence of Epochs::oldest(): either the writer
+			// sees the reader, or the reader sees what the writer unlinked
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+		}
+
+		~ReadSection()
+		{
+			ReaderHolder& reader(t_reader);
+			if (--reader.depth > 0)
+				return;
+			if (reader.slot)
+				reader.slot->epoch.store(0, std::memory_order_release);
+			else
+				Epochs::instance().shared.fetch_sub(1, std::memory_order_release);
+		}
+
+	private:
+		ReadSection(const ReadSection&);
+		ReadSection& operator=(const ReadSection&);
+	};
+};
+
+// ===========================================================================
+// Entries and tables
+// ===========================================================================
+
+struct NamespaceIndex::Node
+{
+	Node(const char* n, size_t length, uint64_t h)
+		: hash(h), name(n, length), seq(0), data(0), children(NULL)
+	{
+		memset(&attr, 0, sizeof(attr));
+	}
+
+	~Node();
+
+	// The attributes are guarded by a sequence counter like the slots of
+	// AttrCacheTable; only the writer of the index changes them
+	void read(struct stat* buf, uint64_t* value) const
+	{
+		for (;;)
+		{
+			uint32_t s = seq.load(std::memory_order_acquire);
+			if (s & 1)
+				continue;
+			*buf = attr;
+			uint64_t d = data;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (seq.load(std::memory_order_relaxed) == s)
+			{
+				if (value)
+					*value = d;
+				return;
+			}
+		}
+	}
+
+	void write(const struct stat& buf, uint64_t value)
+	{
+		uint32_t s = seq.load(std::memory_order_relaxed);
+		seq.store(s + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		attr = buf;
+		data = value;
+		seq.store(s + 2, std::memory_order_release);
+	}
+
+	inline bool isDirectory() const
+	{
+		struct stat buf;
+		read(&buf, NULL);
+		return S_ISDIR(buf.st_mode);
+	}
+
+	bool hasChildren() const;
+
+	static void destroy(void* node);
+	static void destroyTree(Node* node);
+
+	const uint64_t hash;
+	const std::string name;
+	std::atomic<uint32_t> seq;
+	struct stat attr;
+	uint64_t data;
+	std::atomic<Table*> children;
+};
+
+// Open-addressing table of the entries of a directory. Readers only load
+// the tags and the entry pointers; 'used' and 'live' belong to the writer.
+struct NamespaceIndex::Table
+{
+	Table(size_t c)
+		: capacity(c), groupMask(c / GROUP_SIZE - 1), groupBits(__builtin_ctzll(c / GROUP_SIZE)), used(0), live(0),
+		tags(new std::atomic<uint8_t>[c]), nodes(new std::atomic<Node*>[c])
+	{
+		for (size_t i = 0; i < capacity; ++i)
+		{
+			tags[i].store(EMPTY, std::memory_order_relaxed);
+			nodes[i].store(NULL, std::memory_order_relaxed);
+		}
+	}
+
+	inline size_t home(uint64_t hash) const
+	{
+		return groupBits ? (size_t)(hash >> (64 - groupBits)) : 0;
+	}
+
+	inline bool hasEmpty(size_t group) const
+	{
+		for (size_t i = group * GROUP_SIZE; i < (group + 1) * GROUP_SIZE; ++i)
+			if (tags[i].load(std::memory_order_acquire) == EMPTY)
+				return true;
+		return false;
+	}
+
+	Node* find(const char* name, size_t length, uint64_t hash) const
+	{
+		uint8_t tag = tagOf(hash);
+		size_t group = home(hash);
+		for (size_t probe = 0; probe <= groupMask; ++probe)
+		{
+			size_t base = group * GROUP_SIZE;
+			unsigned int match, empty;
+			matchGroup(&tags[base], tag, match, empty);
+			while (match)
+			{
+				size_t i = base + __builtin_ctz(match);
+				match &= match - 1;
+				Node* node = nodes[i].load(std::memory_order_acquire);
+				// memcmp() is vectorized by the C library
+				if (node && node->hash == hash && node->name.size() == length
+					&& memcmp(node->name.data(), name, length) == 0)
+					return node;
+			}
+			if (empty)
+				return NULL;
+			group = (group + 1) & groupMask;
+		}
+		return NULL;
+	}
+
+	inline bool isFull() const { return (used + 1) * 8 > capacity * 7; }
+
+	// 'node' must not be in the table, which must not be full
+	void add(Node* node)
+	{
+		size_t group = home(node->hash);
+		for (;;)
+		{
+			size_t base = group * GROUP_SIZE;
+			for (size_t i = base; i < base + GROUP_SIZE; ++i)
+			{
+				uint8_t tag = tags[i].load(std::memory_order_relaxed);
+				if (tag != EMPTY && tag != DELETED)
+					continue;
+				if (tag == EMPTY)
+					++used;
+				++live;
+				nodes[i].store(node, std::memory_order_release);
+				tags[i].store(tagOf(node->hash), std::memory_order_release);
+				return;
+			}
+			group = (group + 1) & groupMask;
+		}
+	}
+
+	void erase(const Node* node)
+	{
+		size_t group = home(node->hash);
+		for (size_t probe = 0; probe <= groupMask; ++probe)
+		{
+			size_t base = group * GROUP_SIZE;
+			for (size_t i = base; i < base + GROUP_SIZE; ++i)
+			{
+				if (nodes[i].load(std::memory_order_relaxed) != node)
+					continue;
+				// No probe went past a group that still has an empty slot,
+				// so the slot can be emptied rather than marked
+				bool empty = false;
+				for (size_t j = base; j < base + GROUP_SIZE; ++j)
+					empty = empty || tags[j].load(std::memory_order_relaxed) == EMPTY;
+				tags[i].store(empty ? EMPTY : DELETED, std::memory_order_release);
+				nodes[i].store(NULL, std::memory_order_release);
+				if (empty)
+					--used;
+				--live;
+				return;
+			}
+			group = (group + 1) & groupMask;
+		}
+	}
+
+	static void destroy(void* table)
+	{
+		delete static_cast<Table*>(table);
+	}
+
+	// The table and every entry below it
+	static void destroyTree(void* object)
+	{
+		Table* table = static_cast<Table*>(object);
+		for (size_t i = 0; i < table->capacity; ++i)
+		{
+			Node* node = table->nodes[i].load(std::memory_order_relaxed);
+			if (node)
+				Node::destroyTree(node);
+		}
+		delete table;
+	}
+
+	const size_t capacity, groupMask, groupBits;
+	size_t used, live;
+	std::unique_ptr<std::atomic<uint8_t>[]> tags;
+	std::unique_ptr<std::atomic<Node*>[]> nodes;
+};
+
+// Deleting an entry deletes its table, not the entries in it: those are
+// moved or gone by then
+NamespaceIndex::Node::~Node()
+{
+	delete children.load(std::memory_order_relaxed);
+}
+
+bool NamespaceIndex::Node::hasChildren() const
+{
+	Table* table = children.load(std::memory_order_relaxed);
+	return table && table->live > 0;
+}
+
+void NamespaceIndex::Node::destroy(void* node)
+{
+	delete static_cast<Node*>(node);
+}
+
+void NamespaceIndex::Node::destroyTree(Node* node)
+{
+	Table* table = node->children.exchange(NULL, std::memory_order_relaxed);
+	if (table)
+		Table::destroyTree(table);
+	delete node;
+}
+
+// ===========================================================================
+// NamespaceIndex implementation
+// ===========================================================================
+
+NamespaceIndex::NamespaceIndex()
+	: _root(new Node("", 0, 0)), _size(0)
+{
+	struct stat attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.st_mode = S_IFDIR | 0755;
+	attr.st_nlink = 2;
+	_root->write(attr, 0);
+}
+
+NamespaceIndex::~NamespaceIndex()
+{
+	for (std::vector<Retired>::iterator it = _retired.begin(); it != _retired.end(); ++it)
+		it->destroy(it->object);
+	Node::destroyTree(_root);
+}
+
+int NamespaceIndex::walk(const std::string& path, bool parent, const Node*& node, const char*& name, size_t& length) const
+{
+	if (path.empty() || path[0] != '/')
+		return -EINVAL;
+
+	const Node* current = _root;
+	const char* p = path.data();
+	const char* end = p + path.size();
+	name = NULL;
+	length = 0;
+	for (;;)
+	{
+		while (p != end && *p == '/')
+			++p;
+		if (p == end)
+			break;
+
+		const char* component = p;
+		p = static_cast<const char*>(memchr(p, '/', end - p));
+		if (!p)
+			p = end;
+		size_t size = p - component;
+
+		if (parent)
+		{
+			const char* rest = p;
+			while (rest != end && *rest == '/')
+				++rest;
+			if (rest == end)
+			{
+				name = component;
+				length = size;
+				break;
+			}
+		}
+
+		const Table* table = current->children.load(std::memory_order_acquire);
+		const Node* next = table ? table->find(component, size, hashName(component, size)) : NULL;
+		if (!next)
+			return table || current->isDirectory() ? -ENOENT : -ENOTDIR;
+		current = next;
+	}
+	node = current;
+	return 0;
+}
+
+int NamespaceIndex::getattr(const std::string& path, struct stat* buf, uint64_t* data) const
+{
+	ReadSection section;
+	const Node* node;
+	const char* name;
+	size_t length;
+	int res = walk(path, false, node, name, length);
+	if (res != 0)
+		return res;
+	node->read(buf, data);
+	return 0;
+}
+
+int NamespaceIndex::lookup(const std::string& parent, const std::string& name, struct stat* buf, uint64_t* data) const
+{
+	ReadSection section;
+	const Node* dir;
+	const char* unused;
+	size_t length;
+	int res = walk(parent, false, dir, unused, length);
+	if (res != 0)
+		return res;
+	const Table* table = dir->children.load(std::memory_order_acquire);
+	const Node* node = table ? table->find(name.data(), name.size(), hashName(name.data(), name.size())) : NULL;
+	if (!node)
+		return table || dir->isDirectory() ? -ENOENT : -ENOTDIR;
+	node->read(buf, data);
+	return 0;
+}
+
+int NamespaceIndex::readdir(const std::string& path, FS_readdir::DirectoryFiller& filler) const
+{
+	ReadSection section;
+	const Node* dir;
+	const char* name;
+	size_t length;
+	int res = walk(path, false, dir, name, length);
+	if (res != 0)
+		return res;
+	const Table* table = dir->children.load(std::memory_order_acquire);
+	if (!table)
+		return dir->isDirectory() ? 0 : -ENOTDIR;
+
+	// Entries are listed by increasing hash, from the one following the
+	// cookie. An entry lies between its home group and the first group
+	// with an empty slot after it: once such a group is scanned, the
+	// entries of the groups up to it are all known and can be sorted and
+	// listed. Entries pushed past the last group wrap around to the first
+	// ones, and come last.
+	if ((uint64_t)filler.getOffset() > (UINT64_MAX >> 2))
+		return 0;
+	uint64_t from = (uint64_t)filler.getOffset() << 2;
+	size_t start = table->home(from);
+	size_t groups = table->groupMask + 1;
+	ArenaVector<const Node*> pending;
+	size_t listed = 0;
+	for (size_t group = start; group <= groups; ++group)
+	{
+		bool last = group == groups;
+		if (!last)
+		{
+			for (size_t i = group * GROUP_SIZE; i < (group + 1) * GROUP_SIZE; ++i)
+			{
+				const Node* node = table->nodes[i].load(std::memory_order_acquire);
+				if (node && node->hash >= from)
+					pending.push_back(node);
+			}
+			if (!table->hasEmpty(group))
+				continue;
+		}
+		else
+		{
+			for (size_t wrapped = 0; wrapped < start; ++wrapped)
+			{
+				for (size_t i = wrapped * GROUP_SIZE; i < (wrapped + 1) * GROUP_SIZE; ++i)
+				{
+					const Node* node = table->nodes[i].load(std::memory_order_acquire);
+					if (node && node->hash >= from && table->home(node->hash) > wrapped)
+						pending.push_back(node);
+				}
+				if (table->hasEmpty(wrapped))
+					break;
+			}
+		}
+
+		// Entries that wrapped around wait for the end
+		ArenaVector<const Node*>::iterator ready = last ? pending.end()
+			: std::partition(pending.begin() + listed, pending.end(),
+				[table, group](const Node* node) { return table->home(node->hash) <= group; });
+		std::sort(pending.begin() + listed, ready,
+			[](const Node* a, const Node* b) { return a->hash < b->hash; });
+		for (; pending.begin() + listed != ready; ++listed)
+		{
+			const Node* node = pending[listed];
+			struct stat attr;
+			node->read(&attr, NULL);
+			if (!filler.add(node->name, attr, cookieOf(node->hash)))
+				return 0;
+		}
+	}
+	return 0;
+}
+
+int NamespaceIndex::insert(const std::string& path, const struct stat& attr, uint64_t data)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	const Node* parent;
+	const char* name;
+	size_t length;
+	int res = walk(path, true, parent, name, length);
+	if (res != 0)
+		return res;
+
+	Node* dir = const_cast<Node*>(parent);
+	if (!name)
+	{
+		// The root
+		if (!S_ISDIR(attr.st_mode))
+			return -ENOTDIR;
+		_root->write(attr, data);
+		return 0;
+	}
+	if (!S_ISDIR(dir->attr.st_mode))
+		return -ENOTDIR;
+
+	uint64_t hash = hashName(name, length);
+	Table* table = dir->children.load(std::memory_order_relaxed);
+	Node* node = table ? table->find(name, length, hash) : NULL;
+	if (node)
+	{
+		if (!S_ISDIR(attr.st_mode) && node->hasChildren())
+			return -ENOTEMPTY;
+		node->write(attr, data);
+		return 0;
+	}
+
+	node = new Node(name, length, hash);
+	node->write(attr, data);
+	publish(dir, node);
+	_size.fetch_add(1, std::memory_order_relaxed);
+	reclaim();
+	return 0;
+}
+
+int NamespaceIndex::remove(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	const Node* parent;
+	const char* name;
+	size_t length;
+	int res = walk(path, true, parent, name, length);
+	if (res != 0)
+		return res;
+	if (!name)
+		return -EBUSY;
+
+	Node* dir = const_cast<Node*>(parent);
+	Table* table = dir->children.load(std::memory_order_relaxed);
+	Node* node = table ? table->find(name, length, hashName(name, length)) : NULL;
+	if (!node)
+		return S_ISDIR(dir->attr.st_mode) ? -ENOENT : -ENOTDIR;
+	if (node->hasChildren())
+		return -ENOTEMPTY;
+
+	unlink(dir, node);
+	retire(node, Node::destroy);
+	_size.fetch_sub(1, std::memory_order_relaxed);
+	reclaim();
+	return 0;
+}
+
+int NamespaceIndex::rename(const std::string& from, const std::string& to)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	const Node* fromParent;
+	const Node* toParent;
+	const char* fromName;
+	const char* toName;
+	size_t fromLength, toLength;
+	int res = walk(from, true, fromParent, fromName, fromLength);
+	if (res == 0)
+		res = walk(to, true, toParent, toName, toLength);
+	if (res != 0)
+		return res;
+	if (!fromName || !toName)
+		return -EBUSY;
+
+	Node* fromDir = const_cast<Node*>(fromParent);
+	Node* toDir = const_cast<Node*>(toParent);
+	Table* fromTable = fromDir->children.load(std::memory_order_relaxed);
+	Node* node = fromTable ? fromTable->find(fromName, fromLength, hashName(fromName, fromLength)) : NULL;
+	if (!node)
+		return S_ISDIR(fromDir->attr.st_mode) ? -ENOENT : -ENOTDIR;
+	if (!S_ISDIR(toDir->attr.st_mode))
+		return -ENOTDIR;
+
+	uint64_t hash = hashName(toName, toLength);
+	Table* toTable = toDir->children.load(std::memory_order_relaxed);
+	Node* existing = toTable ? toTable->find(toName, toLength, hash) : NULL;
+	if (existing)
+		return existing == node ? 0 : -EEXIST;
+
+	// The target must not be below the entry. Paths from the kernel hold
+	// no "." or "..", so this is a prefix.
+	if (to.size() > from.size() && to.compare(0, from.size(), from) == 0 && to[from.size()] == '/')
+		return -EINVAL;
+
+	// Names are immutable: the entry is copied under its new name, and takes
+	// the table of the old one along
+	Node* moved = new Node(toName, toLength, hash);
+	moved->write(node->attr, node->data);
+	moved->children.store(node->children.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	publish(toDir, moved);
+	unlink(fromDir, node);
+	node->children.store(NULL, std::memory_order_release);
+	retire(node, Node::destroy);
+	reclaim();
+	return 0;
+}
+
+void NamespaceIndex::clear()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	Table* table = _root->children.exchange(NULL, std::memory_order_acq_rel);
+	if (table)
+		retire(table, Table::destroyTree);
+	_size.store(0, std::memory_order_relaxed);
+	reclaim();
+}
+
+void NamespaceIndex::publish(Node* parent, Node* node)
+{
+	Table* table = parent->children.load(std::memory_order_relaxed);
+	if (!table)
+	{
+		table = new Table(GROUP_SIZE);
+		table->add(node);
+		parent->children.store(table, std::memory_order_release);
+		return;
+	}
+	if (table->isFull())
+	{
+		// Grows when more than half the slots are live, otherwise only
+		// drops the deleted slots
+		size_t capacity = (table->live + 1) * 2 > table->capacity ? table->capacity * 2 : table->capacity;
+		Table* grown = new Table(capacity);
+		for (size_t i = 0; i < table->capacity; ++i)
+		{
+			Node* entry = table->nodes[i].load(std::memory_order_relaxed);
+			if (entry)
+				grown->add(entry);
+		}
+		grown->add(node);
+		parent->children.store(grown, std::memory_order_release);
+		retire(table, Table::destroy);
+		return;
+	}
+	table->add(node);
+}
+
+void NamespaceIndex::unlink(Node* parent, Node* node)
+{
+	Table* table = parent->children.load(std::memory_order_relaxed);
+	table->erase(node);
+	if (table->live == 0)
+	{
+		parent->children.store(NULL, std::memory_order_release);
+		retire(table, Table::destroy);
+	}
+}
+
+void NamespaceIndex::retire(void* object, void (*destroy)(void*))
+{
+	Retired retired = { object, destroy, Epochs::instance().advance() };
+	_retired.push_back(retired);
+}
+
+void NamespaceIndex::reclaim()
+{
+	if (_retired.empty())
+		return;
+	uint64_t oldest = Epochs::instance().oldest();
+	std::vector<Retired>::iterator kept = _retired.begin();
+	for (std::vector<Retired>::iterator it = _retired.begin(); it != _retired.end(); ++it)
+	{
+		if (it->epoch < oldest)
+			it->destroy(it->object);
+		else
+			*kept++ = *it;
+	}
+	_retired.erase(kept, _retired.end());
+}
@@ -0,0 +1,201 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include <fusepp/NegativeCache.h>
+#include "PathSlots.h"
+using namespace fusepp;
+using namespace fusepp_impl;
+
+const size_t NegativeCacheTable::MAX_PATH_LENGTH;
+const size_t NegativeCacheTable::WAYS;
+
+namespace
+{
+	// The filter is blocked: a path sets 4 bits of a single word, picked by
+	// the high half of its hash, from the bits of the low half
+	inline uint64_t filterBits(uint64_t hash)
+	{
+		return (1ULL << (hash & 63)) | (1ULL << ((hash >> 6) & 63))
+			| (1ULL << ((hash >> 12) & 63)) | (1ULL << ((hash >> 18) & 63));
+	}
+};
+
+struct NegativeCacheTable::Slot : public PathSlot<NegativeCacheTable::MAX_PATH_LENGTH>
+{
+};
+
+NegativeCacheTable::NegativeCacheTable(size_t capacity, double ttl)
+	: _capacity(0), _mask(0), _filterMask(0), _ttl(0), _ttlNs(0), _generation(0), _inserted(0)
+{
+	configure(capacity, ttl);
+}
+
+NegativeCacheTable::~NegativeCacheTable()
+{
+}
+
+void NegativeCacheTable::configure(size_t capacity, double ttl)
+{
+	size_t buckets = 1;
+	while (buckets * WAYS < capacity)
+		buckets <<= 1;
+
+	_capacity = buckets * WAYS;
+	_mask = buckets - 1;
+	_slots.reset(new Slot[_capacity]);
+	_invalidations.reset(new std::atomic<uint32_t>[buckets]);
+	for (size_t i = 0; i < buckets; ++i)
+		_invalidations[i].store(0, std::memory_order_relaxed);
+
+	// 32 bits per slot: 16 per path when the filter is reset
+	size_t words = _capacity / 2;
+	_filterMask = words - 1;
+	for (size_t f = 0; f < 2; ++f)
+	{
+		_filters[f].reset(new std::atomic<uint64_t>[words]);
+		for (size_t i = 0; i < words; ++i)
+			_filters[f][i].store(0, std::memory_order_relaxed);
+	}
+	_inserted.store(0, std::memory_order_relaxed);
+
+	_ttl = ttl;
+	_ttlNs = (int64_t)(ttl * 1e9);
+}
+
+size_t NegativeCacheTable::bucket(uint64_t hash) const
+{
+	return (size_t)(hash & _mask) * WAYS;
+}
+
+bool NegativeCacheTable::mayContain(uint64_t hash, uint32_t generation) const
+{
+	uint64_t bits = filterBits(hash);
+	return (_filters[generation & 1][(hash >> 32) & _filterMask].load() & bits) == bits;
+}
+
+bool NegativeCacheTable::contains(const std::string& path) const
+{
+	if (_ttlNs <= 0 || path.size() > MAX_PATH_LENGTH)
+		return false;
+
+	uint64_t hash = hashPath(path);
+	uint32_t generation = _generation.load(std::memory_order_acquire);
+	if (!mayContain(hash, generation))
+		return false;
+
+	const Slot* first = &_slots[bucket(hash)];
+	for (size_t i = 0; i < WAYS; ++i)
+	{
+		const Slot& slot(first[i]);
+		uint32_t seq;
+		if (!slot.beginRead(seq) || slot.hash != hash)
+			continue;
+
+		bool found = slot.matches(hash, path) && slot.generation == generation;
+		int64_t expires = slot.expires;
+		if (!slot.endRead(seq))
+			return false;
+
+		return found && expires >= now();
+	}
+	return false;
+}
+
+uint64_t NegativeCacheTable::getStamp(const std::string& path) const
+{
+	uint32_t generation = _generation.load();
+	return makeStamp(generation, _invalidations[bucket(hashPath(path)) / WAYS].load());
+}
+
+void NegativeCacheTable::put(const std::string& path)
+{
+	put(path, getStamp(path));
+}
+
+void NegativeCacheTable::put(const std::string& path, uint64_t stamp)
+{
+	if (_ttlNs <= 0 || path.size() > MAX_PATH_LENGTH)
+		return;
+
+	// A single put() per generation resets the table, and drops its own
+	// entry with the generation it was stamped with
+	if (_inserted.fetch_add(1, std::memory_order_relaxed) == 2 * _capacity)
+		clear();
+
+	uint64_t hash = hashPath(path);
+	uint32_t generation = stampGeneration(stamp);
+	int64_t t = now();
+	Slot* first = &_slots[bucket(hash)];
+
+	// When every slot is in use, the one expiring first
+	Slot* victim = findSlot(first, WAYS, hash, generation, t);
+	if (!victim)
+	{
+		victim = &first[0];
+		for (size_t i = 1; i < WAYS; ++i)
+			if (first[i].expires < victim->expires)
+				victim = &first[i];
+	}
+
+	// The bit is set before the stamp is checked again, and invalidate()
+	// bumps its counter before looking at the filter: either it finds the
+	// bit and waits for the slot, or the entry is dropped here. A new
+	// generation also drops the entry, as the bit went to the filter of
+	// the previous one.
+	uint32_t seq;
+	if (!lockForPut(*victim, seq, [this, &path, hash, generation, stamp]() {
+			_filters[generation & 1][(hash >> 32) & _filterMask].fetch_or(filterBits(hash));
+			return getStamp(path) == stamp;
+		}))
+		return;
+	victim->assign(hash, generation, t + _ttlNs, path);
+	victim->unlock(seq);
+}
+
+void NegativeCacheTable::invalidate(const std::string& path)
+{
+	if (path.size() > MAX_PATH_LENGTH)
+		return;
+
+	uint64_t hash = hashPath(path);
+	size_t index = bucket(hash);
+	_invalidations[index / WAYS].fetch_add(1);
+	if (mayContain(hash, _generation.load()))
+		erasePath(&_slots[index], WAYS, hash, path);
+}
+
+void NegativeCacheTable::clear()
+{
+	// The filter of the next generation only receives the bits of entries
+	// that are already stale, so it can be emptied before the generation
+	// starts. Readers racing with the reset may miss entries, which only
+	// costs them a call to the file system.
+	std::lock_guard<std::mutex> lock(_clearing);
+	uint32_t next = _generation.load() + 1;
+	std::atomic<uint64_t>* filter = _filters[next & 1].get();
+	for (size_t i = 0; i <= _filterMask; ++i)
+		filter[i].store(0, std::memory_order_relaxed);
+	_inserted.store(0, std::memory_order_relaxed);
+	_generation.store(next);
+}
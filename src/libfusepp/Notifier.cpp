@@ -0,0 +1,239 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+// Kernel cache invalidations: fusepp_impl::Notifier (see hooks.h)
+
+#include "hooks.h"
+#include <atomic>
+#include <map>
+#include <set>
+#include <thread>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <errno.h>
+using namespace fusepp;
+using namespace fusepp_impl;
+
+namespace
+{
+	// Data range of an inode to invalidate, as given to
+	// fuse_lowlevel_notify_inval_inode: a negative offset for the attributes
+	// only, a length of 0 up to the end of the file
+	struct Range
+	{
+		off_t offset, length;
+
+		// Smallest range covering both
+		void merge(const Range& other)
+		{
+			if (other.offset < 0)
+				return;
+			if (offset < 0)
+			{
+				*this = other;
+				return;
+			}
+			off_t start = std::min(offset, other.offset);
+			if (length == 0 || other.length == 0)
+				length = 0;
+			else
+				length = std::max(offset + length, other.offset + other.length) - start;
+			offset = start;
+		}
+	};
+
+	// Token bucket holding up to a second worth of notifications
+	class Throttle
+	{
+	public:
+		Throttle(unsigned int rate)
+			: _rate(rate), _tokens(rate), _last(std::chrono::steady_clock::now())
+		{}
+
+		void wait()
+		{
+			for (;;)
+			{
+				std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+				_tokens = std::min((double)_rate, _tokens + std::chrono::duration<double>(t - _last).count() * _rate);
+				_last = t;
+				if (_tokens >= 1)
+				{
+					_tokens -= 1;
+					return;
+				}
+				std::this_thread::sleep_for(std::chrono::duration<double>((1 - _tokens) / _rate));
+			}
+		}
+
+	private:
+		unsigned int _rate;
+		double _tokens;
+		std::chrono::steady_clock::time_point _last;
+	};
+
+	// Invalidations waiting for the thread sending them
+	class Queue
+	{
+	public:
+		static Queue& instance()
+		{
+			// Never destroyed, like the logger: it may be used until exit
+			static Queue* queue = new Queue;
+			return *queue;
+		}
+
+		void start(struct fuse_chan* ch, unsigned int rate)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			assert(!_running);
+			_running = true;
+
+			// Signals are left to the main thread, as for the workers
+			sigset_t all, previous;
+			sigfillset(&all);
+			pthread_sigmask(SIG_BLOCK, &all, &previous);
+			_thread = std::thread(&Queue::run, this, ch, std::max(rate, 1u));
+			pthread_sigmask(SIG_SETMASK, &previous, NULL);
+		}
+
+		void stop()
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				if (!_running)
+					return;
+				_running = false;
+				_pending.notify_one();
+			}
+			_thread.join();
+
+			// What is still pending is moot once the file system is unmounted
+			std::lock_guard<std::mutex> lock(_mutex);
+			_inodes.clear();
+			_entries.clear();
+		}
+
+		bool addInode(ino_t ino, const Range& range)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (!_running)
+				return false;
+
+			std::pair<Inodes::iterator,bool> inserted = _inodes.insert(std::make_pair(ino, range));
+			if (!inserted.second)
+				inserted.first->second.merge(range);
+			_pending.notify_one();
+			return true;
+		}
+
+		bool addEntry(ino_t parent, const std::string& name)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (!_running)
+				return false;
+
+			_entries.insert(std::make_pair(parent, name));
+			_pending.notify_one();
+			return true;
+		}
+
+	private:
+		typedef std::map<ino_t,Range> Inodes;
+		typedef std::set<std::pair<ino_t,std::string> > Entries;
+
+		Queue() : _running(false) {}
+
+		static void report(const char* what, int res)
+		{
+			// ENOENT only means the kernel no longer caches it
+			if (res && res != -ENOENT)
+				FUSEPP_LOG_DEBUG("Invalidation of %s failed: %s", what, strerror(-res));
+		}
+
+		void run(struct fuse_chan* ch, unsigned int rate)
+		{
+			Throttle throttle(rate);
+			std::unique_lock<std::mutex> lock(_mutex);
+			while (_running)
+			{
+				if (_inodes.empty() && _entries.empty())
+				{
+					_pending.wait(lock);
+					continue;
+				}
+
+				Inodes inodes;
+				Entries entries;
+				inodes.swap(_inodes);
+				entries.swap(_entries);
+				lock.unlock();
+
+				// Names first, so that a lookup following the invalidation
+				// of an inode does not find it under a stale name
+				for (Entries::const_iterator it = entries.begin(); it != entries.end() && _running; ++it)
+				{
+					throttle.wait();
+					report("entry", fuse_lowlevel_notify_inval_entry(ch, it->first, it->second.c_str(), it->second.size()));
+				}
+				for (Inodes::const_iterator it = inodes.begin(); it != inodes.end() && _running; ++it)
+				{
+					throttle.wait();
+					report("inode", fuse_lowlevel_notify_inval_inode(ch, it->first, it->second.offset, it->second.length));
+				}
+
+				lock.lock();
+			}
+		}
+
+		std::mutex _mutex;
+		std::condition_variable _pending;
+		std::atomic<bool> _running;
+		std::thread _thread;
+		Inodes _inodes;
+		Entries _entries;
+	};
+};
+
+void Notifier::start(struct fuse_chan* ch, unsigned int rate)
+{
+	Queue::instance().start(ch, rate);
+}
+
+void Notifier::stop()
+{
+	Queue::instance().stop();
+}
+
+bool Notifier::inode(ino_t ino, off_t offset, off_t length)
+{
+	Range range = { offset, length };
+	return Queue::instance().addInode(ino, range);
+}
+
+bool Notifier::entry(ino_t parent, const std::string& name)
+{
+	return Queue::instance().addEntry(parent, name);
+}
@@ -0,0 +1,334 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "hooks.h"
+#include <map>
+#include <set>
+#include <thread>
+#include <pthread.h>
+#include <signal.h>
+#include <errno.h>
+using namespace fusepp;
+using namespace fusepp_impl;
+
+namespace
+{
+	// The deadlines of the open files holding data back (see Flusher)
+	class Timer
+	{
+	public:
+		static Timer& instance()
+		{
+			// Never destroyed: open files may still refer to it after main()
+			static Timer* timer = new Timer;
+			return *timer;
+		}
+
+		void start()
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_running)
+				return;
+			_running = true;
+
+			// Signals are left to the main thread, as for the workers
+			sigset_t all, previous;
+			sigfillset(&all);
+			pthread_sigmask(SIG_BLOCK, &all, &previous);
+			_thread = std::thread(&Timer::run, this);
+			pthread_sigmask(SIG_SETMASK, &previous, NULL);
+		}
+
+		void stop()
+		{
+			std::thread thread;
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_running = false;
+				_thread.swap(thread);
+				_changed.notify_one();
+			}
+			if (thread.joinable())
+				thread.join();
+		}
+
+		void schedule(OpenFile* file, uint64_t deadline)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (!_running)
+				return;
+			std::map<OpenFile*, uint64_t>::iterator it = _files.find(file);
+			if (it != _files.end())
+			{
+				_deadlines.erase(std::make_pair(it->second, file));
+				it->second = deadline;
+			}
+			else
+				_files[file] = deadline;
+			_deadlines.insert(std::make_pair(deadline, file));
+			_changed.notify_one();
+		}
+
+		void cancel(OpenFile* file)
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			std::map<OpenFile*, uint64_t>::iterator it = _files.find(file);
+			if (it != _files.end())
+			{
+				_deadlines.erase(std::make_pair(it->second, file));
+				_files.erase(it);
+			}
+			while (_flushing == file)
+				_flushed.wait(lock);
+		}
+
+	private:
+		Timer() : _flushing(NULL), _running(false) {}
+
+		void run()
+		{
+			try {
+				Workers::createContext();
+			} catch (...) {
+				// Already reported; attempted again on first use
+			}
+			std::unique_lock<std::mutex> lock(_mutex);
+			for (;;)
+			{
+				if (_deadlines.empty())
+				{
+					if (!_running)
+						break;
+					_changed.wait(lock);
+					continue;
+				}
+				// Once stopped, whatever is left is written without waiting
+				std::pair<uint64_t, OpenFile*> first = *_deadlines.begin();
+				uint64_t now = OpTimer::now();
+				if (_running && first.first > now)
+				{
+					_changed.wait_for(lock, std::chrono::nanoseconds(first.first - now));
+					continue;
+				}
+				_deadlines.erase(_deadlines.begin());
+				_files.erase(first.second);
+
+				// The file waits in cancel() until it is written
+				bool force = !_running;
+				_flushing = first.second;
+				lock.unlock();
+				first.second->flushExpired(force);
+				lock.lock();
+				_flushing = NULL;
+				_flushed.notify_all();
+			}
+			lock.unlock();
+			Workers::destroyContext();
+		}
+
+		std::mutex _mutex;
+		std::condition_variable _changed, _flushed;
+		std::map<OpenFile*, uint64_t> _files;
+		std::set<std::pair<uint64_t, OpenFile*> > _deadlines;
+		OpenFile* _flushing;
+		std::thread _thread;
+		bool _running;
+	};
+};
+
+OpenFile::OpenFile(uint64_t handle)
+	: _handle(handle), _offset(0), _started(0), _error(0),
+	_readEnd(0), _window(0), _generation(0), _prefetching(false), _prefetchOffset(0), _prefetchEnd(0)
+{
+}
+
+OpenFile::~OpenFile()
+{
+	Flusher::cancel(this);
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (_prefetching)
+		_prefetched.wait(lock);
+	dropChunks();
+}
+
+// Never destroyed: files still open when unmounted are never released
+HandleTable<OpenFile>* const OpenFile::_s_files(new HandleTable<OpenFile>);
+
+void OpenFile::attach(struct fuse_file_info* fi)
+{
+	if (isEnabled())
+		fi->fh = _s_files->create(fi->fh);
+}
+
+void OpenFile::detach(struct fuse_file_info* fi, const std::string* path)
+{
+	OpenFile* file = get(fi);
+	if (!file)
+		return;
+	uint64_t handle = fi->fh;
+	fi->fh = file->_handle;
+	if (path)
+	{
+		FileInfo info(fi);
+		file->drainQuietly(*path, info);
+	}
+	_s_files->destroy(handle);
+}
+
+int OpenFile::writeThrough(const std::string& path, WriteBuffer& buf, off_t offset, FileInfo& info)
+{
+	CALL_FS_IMPL(write, -EIO, path, buf, offset, info);
+}
+
+int OpenFile::takeError()
+{
+	int err = _error;
+	_error = 0;
+	return err;
+}
+
+int OpenFile::writePending(const std::string& path, FileInfo& info)
+{
+	// The file system may take the data in several calls
+	size_t done = 0;
+	while (done < _pending.size())
+	{
+		struct fuse_bufvec bufv = FUSE_BUFVEC_INIT(_pending.size() - done);
+		bufv.buf[0].mem = &_pending[done];
+		WriteBuffer buf(&bufv);
+		int res = writeThrough(path, buf, _offset + done, info);
+		if (res <= 0)
+		{
+			_pending.clear();
+			return res < 0 ? res : -EIO;
+		}
+		done += res;
+	}
+	_pending.clear();
+	return 0;
+}
+
+int OpenFile::write(const std::string& path, WriteBuffer& buf, off_t offset, FileInfo& info)
+{
+	const Application* app = Application::_s_instance;
+	size_t size = buf.getSize();
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	int err = takeError();
+	if (err)
+		return err;
+
+	// What was read ahead may be overwritten
+	dropChunks();
+
+	if (!_pending.empty())
+	{
+		bool contiguous = offset == _offset + (off_t)_pending.size();
+		bool fits = _pending.size() + size <= app->_writeCoalescingSize;
+		bool recent = OpTimer::now() - _started <= (uint64_t)(app->_writeCoalescingWindow * 1e9);
+		if (!contiguous || !fits || !recent)
+		{
+			int res = writePending(path, info);
+			if (res < 0)
+				return res;
+		}
+	}
+	if (size >= app->_writeCoalescingSize)
+		return writeThrough(path, buf, offset, info);
+
+	if (_pending.empty())
+	{
+		_pending.reserve(app->_writeCoalescingSize);
+		_offset = offset;
+		_started = OpTimer::now();
+		_pendingPath = path;
+		_pendingInfo = *info.get();
+		Flusher::schedule(this, _started + (uint64_t)(app->_writeCoalescingWindow * 1e9));
+	}
+	size_t used = _pending.size();
+	_pending.resize(used + size);
+	ssize_t copied = buf.copyTo(&_pending[used], size);
+	_pending.resize(used + std::max(copied, (ssize_t)0));
+	if (copied < 0)
+		return (int)copied;
+
+	if (_pending.size() == app->_writeCoalescingSize)
+	{
+		int res = writePending(path, info);
+		if (res < 0)
+			return res;
+	}
+	return (int)copied;
+}
+
+int OpenFile::drain(const std::string& path, FileInfo& info)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	int res = writePending(path, info);
+	int err = takeError();
+	return res < 0 ? res : err;
+}
+
+void OpenFile::drainQuietly(const std::string& path, FileInfo& info)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	int res = writePending(path, info);
+	if (res < 0 && !_error)
+		_error = res;
+}
+
+void OpenFile::flushExpired(bool force)
+{
+	const Application* app = Application::_s_instance;
+	std::lock_guard<std::mutex> lock(_mutex);
+	// A later write may have written the data and started over
+	if (_pending.empty())
+		return;
+	if (!force && OpTimer::now() - _started < (uint64_t)(app->_writeCoalescingWindow * 1e9))
+		return;
+	FileInfo info(&_pendingInfo);
+	int res = writePending(_pendingPath, info);
+	if (res < 0 && !_error)
+		_error = res;
+}
+
+void Flusher::start()
+{
+	Timer::instance().start();
+}
+
+void Flusher::stop()
+{
+	Timer::instance().stop();
+}
+
+void Flusher::schedule(OpenFile* file, uint64_t deadline)
+{
+	Timer::instance().schedule(file, deadline);
+}
+
+void Flusher::cancel(OpenFile* file)
+{
+	Timer::instance().cancel(file);
+}
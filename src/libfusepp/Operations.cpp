@@ -0,0 +1,234 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include <fusepp/Operations.h>
+#include <stddef.h>
+using namespace fusepp;
+
+Operations::Operations()
+	: target(NULL), getattr(NULL), readdir(NULL), lookup(NULL), forget(NULL),
+	inode_getattr(NULL), inode_readdir(NULL), open(NULL), release(NULL), read(NULL), write(NULL), flush(NULL), fsync(NULL),
+	getxattr(NULL), listxattr(NULL), setxattr(NULL), removexattr(NULL),
+	async_lookup(NULL), async_getattr(NULL), async_readdir(NULL), async_read(NULL), worker_context(NULL)
+{
+}
+
+namespace
+{
+	// The FS_* interfaces of a file system, resolved once. The dynamic thunks
+	// below only need a virtual call to reach the implementation.
+	struct DynamicTarget
+	{
+		FileSystemPtr fs;
+		FS_getattr* getattr;
+		FS_readdir* readdir;
+		FS_lookup* lookup;
+		FS_inode_getattr* inode_getattr;
+		FS_inode_readdir* inode_readdir;
+		FS_open* open;
+		FS_read* read;
+		FS_write* write;
+		FS_flush* flush;
+		FS_getxattr* getxattr;
+		FS_listxattr* listxattr;
+		FS_setxattr* setxattr;
+		FS_async_lookup* async_lookup;
+		FS_async_getattr* async_getattr;
+		FS_async_readdir* async_readdir;
+		FS_async_read* async_read;
+		FS_worker* worker;
+	};
+
+	inline DynamicTarget* dyn(void* target)
+	{
+		return static_cast<DynamicTarget*>(target);
+	}
+
+	int dynamic_getattr(void* target, const std::string& path, struct stat* buf)
+	{
+		return dyn(target)->getattr->getattr(path, buf);
+	}
+
+	int dynamic_readdir(void* target, const std::string& path, FS_readdir::DirectoryFiller& filler)
+	{
+		return dyn(target)->readdir->readdir(path, filler);
+	}
+
+	int dynamic_lookup(void* target, ino_t parent, const std::string& name, ino_t ino, struct stat* buf)
+	{
+		return dyn(target)->lookup->lookup(parent, name, ino, buf);
+	}
+
+	void dynamic_forget(void* target, ino_t ino)
+	{
+		DynamicTarget* dt = dyn(target);
+		if (dt->lookup)
+			dt->lookup->forget(ino);
+		else
+			dt->async_lookup->forget(ino);
+	}
+
+	int dynamic_inode_getattr(void* target, ino_t ino, struct stat* buf)
+	{
+		return dyn(target)->inode_getattr->getattr(ino, buf);
+	}
+
+	int dynamic_inode_readdir(void* target, ino_t ino, FS_readdir::DirectoryFiller& filler)
+	{
+		return dyn(target)->inode_readdir->readdir(ino, filler);
+	}
+
+	int dynamic_open(void* target, const std::string& path, FileInfo& fi)
+	{
+		return dyn(target)->open->open(path, fi);
+	}
+
+	int dynamic_release(void* target, const std::string& path, FileInfo& fi)
+	{
+		return dyn(target)->open->release(path, fi);
+	}
+
+	int dynamic_read(void* target, const std::string& path, ReadBuffer& buf, off_t offset, FileInfo& fi)
+	{
+		return dyn(target)->read->read(path, buf, offset, fi);
+	}
+
+	int dynamic_write(void* target, const std::string& path, WriteBuffer& buf, off_t offset, FileInfo& fi)
+	{
+		return dyn(target)->write->write(path, buf, offset, fi);
+	}
+
+	int dynamic_flush(void* target, const std::string& path, FileInfo& fi)
+	{
+		return dyn(target)->flush->flush(path, fi);
+	}
+
+	int dynamic_fsync(void* target, const std::string& path, bool datasync, FileInfo& fi)
+	{
+		return dyn(target)->flush->fsync(path, datasync, fi);
+	}
+
+	int dynamic_getxattr(void* target, const std::string& path, const std::string& name, std::string& value)
+	{
+		return dyn(target)->getxattr->getxattr(path, name, value);
+	}
+
+	int dynamic_listxattr(void* target, const std::string& path, std::vector<std::string>& names)
+	{
+		return dyn(target)->listxattr->listxattr(path, names);
+	}
+
+	int dynamic_setxattr(void* target, const std::string& path, const std::string& name, const std::string& value, int flags)
+	{
+		return dyn(target)->setxattr->setxattr(path, name, value, flags);
+	}
+
+	int dynamic_removexattr(void* target, const std::string& path, const std::string& name)
+	{
+		return dyn(target)->setxattr->removexattr(path, name);
+	}
+
+	void dynamic_async_lookup(void* target, ino_t parent, const std::string& name, ino_t ino, EntryReply reply)
+	{
+		dyn(target)->async_lookup->lookup(parent, name, ino, reply);
+	}
+
+	void dynamic_async_getattr(void* target, ino_t ino, AttrReply reply)
+	{
+		dyn(target)->async_getattr->getattr(ino, reply);
+	}
+
+	void dynamic_async_readdir(void* target, ino_t ino, DirectoryReply reply)
+	{
+		dyn(target)->async_readdir->readdir(ino, reply);
+	}
+
+	void dynamic_async_read(void* target, ino_t ino, off_t offset, uint64_t handle, ReadReply reply)
+	{
+		dyn(target)->async_read->read(ino, offset, handle, reply);
+	}
+
+	WorkerContext* dynamic_worker_context(void* target)
+	{
+		return dyn(target)->worker->createWorkerContext();
+	}
+};
+
+Operations Operations::bindDynamic(FileSystemPtr fs)
+{
+	std::shared_ptr<DynamicTarget> dt(new DynamicTarget);
+	dt->fs = fs;
+	dt->getattr = dynamic_cast<FS_getattr*>(fs.get());
+	dt->readdir = dynamic_cast<FS_readdir*>(fs.get());
+	dt->lookup = dynamic_cast<FS_lookup*>(fs.get());
+	dt->inode_getattr = dynamic_cast<FS_inode_getattr*>(fs.get());
+	dt->inode_readdir = dynamic_cast<FS_inode_readdir*>(fs.get());
+	dt->open = dynamic_cast<FS_open*>(fs.get());
+	dt->read = dynamic_cast<FS_read*>(fs.get());
+	dt->write = dynamic_cast<FS_write*>(fs.get());
+	dt->flush = dynamic_cast<FS_flush*>(fs.get());
+	dt->getxattr = dynamic_cast<FS_getxattr*>(fs.get());
+	dt->listxattr = dynamic_cast<FS_listxattr*>(fs.get());
+	dt->setxattr = dynamic_cast<FS_setxattr*>(fs.get());
+	dt->async_lookup = dynamic_cast<FS_async_lookup*>(fs.get());
+	dt->async_getattr = dynamic_cast<FS_async_getattr*>(fs.get());
+	dt->async_readdir = dynamic_cast<FS_async_readdir*>(fs.get());
+	dt->async_read = dynamic_cast<FS_async_read*>(fs.get());
+	dt->worker = dynamic_cast<FS_worker*>(fs.get());
+
+	Operations ops;
+	ops.target = dt.get();
+	ops.holder = dt;
+	if (dt->getattr) ops.getattr = dynamic_getattr;
+	if (dt->readdir) ops.readdir = dynamic_readdir;
+	if (dt->lookup) ops.lookup = dynamic_lookup;
+	if (dt->lookup || dt->async_lookup) ops.forget = dynamic_forget;
+	if (dt->inode_getattr) ops.inode_getattr = dynamic_inode_getattr;
+	if (dt->inode_readdir) ops.inode_readdir = dynamic_inode_readdir;
+	if (dt->open)
+	{
+		ops.open = dynamic_open;
+		ops.release = dynamic_release;
+	}
+	if (dt->read) ops.read = dynamic_read;
+	if (dt->write) ops.write = dynamic_write;
+	if (dt->flush)
+	{
+		ops.flush = dynamic_flush;
+		ops.fsync = dynamic_fsync;
+	}
+	if (dt->getxattr) ops.getxattr = dynamic_getxattr;
+	if (dt->listxattr) ops.listxattr = dynamic_listxattr;
+	if (dt->setxattr)
+	{
+		ops.setxattr = dynamic_setxattr;
+		ops.removexattr = dynamic_removexattr;
+	}
+	if (dt->async_lookup) ops.async_lookup = dynamic_async_lookup;
+	if (dt->async_getattr) ops.async_getattr = dynamic_async_getattr;
+	if (dt->async_readdir) ops.async_readdir = dynamic_async_readdir;
+	if (dt->async_read) ops.async_read = dynamic_async_read;
+	if (dt->worker) ops.worker_context = dynamic_worker_context;
+	return ops;
+}
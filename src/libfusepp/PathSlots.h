@@ -0,0 +1,185 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+// Internal header: the fixed-size path tables of AttrCacheTable and
+// NegativeCacheTable. Their slots are grouped in buckets of a few ways and
+// protected by sequence counters (seqlock): readers copy a slot and retry if
+// a writer touched it meanwhile, writers lock a single slot. Every bucket
+// counts its invalidations, and together with the generation of the table
+// (bumped by clear()) this makes the stamp that a value read from the file
+// system is put with: the put is dropped if the stamp changed meanwhile.
+
+#ifndef _FUSEPP_IMPL_PATHSLOTS_H
+#define _FUSEPP_IMPL_PATHSLOTS_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <stdint.h>
+#include <string.h>
+
+namespace fusepp_impl
+{
+	// FNV-1a
+	inline uint64_t hashPath(const std::string& path)
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		for (std::string::const_iterator it = path.begin(); it != path.end(); ++it)
+		{
+			hash ^= (unsigned char)*it;
+			hash *= 1099511628211ULL;
+		}
+		// 0 marks empty slots
+		return hash ? hash : 1;
+	}
+
+	inline int64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	inline uint64_t makeStamp(uint32_t generation, uint32_t invalidations)
+	{
+		return ((uint64_t)generation << 32) | invalidations;
+	}
+
+	inline uint32_t stampGeneration(uint64_t stamp)
+	{
+		return (uint32_t)(stamp >> 32);
+	}
+
+	// A path and when it expires; the tables derive their slots from it
+	template <size_t MAX_PATH_LENGTH>
+	struct PathSlot
+	{
+		PathSlot() : seq(0), generation(0), hash(0), expires(0), length(0) {}
+
+		inline bool matches(uint64_t h, const std::string& p) const
+		{
+			return hash == h && length == p.size() && memcmp(path, p.data(), length) == 0;
+		}
+
+		// An optimistic read starts with beginRead(), which fails while a
+		// writer holds the slot, and is only valid if endRead() succeeds
+		inline bool beginRead(uint32_t& s) const
+		{
+			s = seq.load(std::memory_order_acquire);
+			return !(s & 1);
+		}
+		inline bool endRead(uint32_t s) const
+		{
+			std::atomic_thread_fence(std::memory_order_acquire);
+			return seq.load(std::memory_order_relaxed) == s;
+		}
+
+		// Fails if another writer holds the slot
+		bool lock(uint32_t& s)
+		{
+			s = seq.load(std::memory_order_relaxed);
+			if (s & 1)
+				return false;
+			if (!seq.compare_exchange_strong(s, s + 1, std::memory_order_acquire))
+				return false;
+			std::atomic_thread_fence(std::memory_order_release);
+			return true;
+		}
+		inline void unlock(uint32_t s)
+		{
+			seq.store(s + 2, std::memory_order_release);
+		}
+
+		// The slot must be locked
+		void assign(uint64_t h, uint32_t g, int64_t e, const std::string& p)
+		{
+			hash = h;
+			generation = g;
+			expires = e;
+			length = p.size();
+			memcpy(path, p.data(), p.size());
+		}
+
+		std::atomic<uint32_t> seq;
+		uint32_t generation;
+		uint64_t hash;
+		int64_t expires;
+		size_t length;
+		char path[MAX_PATH_LENGTH];
+	};
+
+	// The slot already holding 'hash' in the bucket starting at 'first', or
+	// else a free or stale one, or NULL when all of them are in use
+	template <class Slot>
+	Slot* findSlot(Slot* first, size_t ways, uint64_t hash, uint32_t generation, int64_t t)
+	{
+		for (size_t i = 0; i < ways; ++i)
+			if (first[i].hash == hash)
+				return &first[i];
+		for (size_t i = 0; i < ways; ++i)
+			if (first[i].hash == 0 || first[i].expires < t || first[i].generation != generation)
+				return &first[i];
+		return NULL;
+	}
+
+	// Locks 'slot' to put a path in it, unless another writer owns it
+	// (dropping the entry is harmless) or 'current' returns false. Once the
+	// slot is locked, an invalidation either shows in the stamp that
+	// 'current' checks, or waits for the slot and clears it afterwards.
+	template <class Slot, class Current>
+	bool lockForPut(Slot& slot, uint32_t& seq, Current current)
+	{
+		if (!slot.lock(seq))
+			return false;
+		if (!current())
+		{
+			slot.unlock(seq);
+			return false;
+		}
+		return true;
+	}
+
+	// Clears 'path' from the bucket starting at 'first'. Every slot is
+	// checked under its lock, since a writer may be filling any of them with
+	// this path.
+	template <class Slot>
+	void erasePath(Slot* first, size_t ways, uint64_t hash, const std::string& path)
+	{
+		for (size_t i = 0; i < ways; ++i)
+		{
+			Slot& slot(first[i]);
+			// Spin: an invalidation must not be lost to a concurrent writer
+			uint32_t seq;
+			while (!slot.lock(seq))
+				;
+			if (slot.matches(hash, path))
+			{
+				slot.hash = 0;
+				slot.expires = 0;
+			}
+			slot.unlock(seq);
+		}
+	}
+};
+
+#endif //_FUSEPP_IMPL_PATHSLOTS_H
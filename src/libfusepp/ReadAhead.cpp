@@ -0,0 +1,326 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+// Read-ahead part of fusepp_impl::OpenFile (see hooks.h)
+
+#include "hooks.h"
+#include <fusepp/Stats.h>
+#include <functional>
+#include <thread>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+using namespace fusepp;
+using namespace fusepp_impl;
+
+namespace
+{
+	class Pool
+	{
+	public:
+		static Pool& instance()
+		{
+			// Never destroyed: open files may still refer to it after main()
+			static Pool* pool = new Pool;
+			return *pool;
+		}
+
+		void start(unsigned int count)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_running)
+				return;
+			_running = true;
+
+			// Signals are left to the main thread, as for the workers
+			sigset_t all, previous;
+			sigfillset(&all);
+			pthread_sigmask(SIG_BLOCK, &all, &previous);
+			for (unsigned int i = 0; i < count; ++i)
+				_threads.push_back(std::thread(&Pool::run, this));
+			pthread_sigmask(SIG_SETMASK, &previous, NULL);
+		}
+
+		void stop()
+		{
+			std::vector<std::thread> threads;
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_running = false;
+				_threads.swap(threads);
+				_ready.notify_all();
+			}
+			for (size_t i = 0; i < threads.size(); ++i)
+				threads[i].join();
+		}
+
+		bool submit(const std::function<void()>& task)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (!_running)
+				return false;
+			_tasks.push_back(task);
+			_ready.notify_one();
+			return true;
+		}
+
+	private:
+		Pool() : _running(false) {}
+
+		void run()
+		{
+			try {
+				Workers::createContext();
+			} catch (...) {
+				// Already reported; attempted again on first use
+			}
+			for (;;)
+			{
+				std::function<void()> task;
+				{
+					std::unique_lock<std::mutex> lock(_mutex);
+					// The open files wait for the prefetches submitted: they
+					// all run before stopping
+					while (_tasks.empty() && _running)
+						_ready.wait(lock);
+					if (_tasks.empty())
+						break;
+					task = _tasks.front();
+					_tasks.pop_front();
+				}
+				task();
+			}
+			Workers::destroyContext();
+		}
+
+		std::mutex _mutex;
+		std::condition_variable _ready;
+		std::deque<std::function<void()> > _tasks;
+		std::vector<std::thread> _threads;
+		bool _running;
+	};
+
+	// Copies the content of 'buf', wherever its segments are
+	bool copyOut(const ReadBuffer& buf, std::vector<char>& data)
+	{
+		data.resize(buf.getFilled());
+		size_t used = 0;
+		const std::vector<ReadBuffer::Segment>& segments(buf.getSegments());
+		for (size_t i = 0; i < segments.size(); ++i)
+		{
+			const ReadBuffer::Segment& seg(segments[i]);
+			if (seg.fd == -1)
+				memcpy(&data[used], seg.mem, seg.size);
+			else
+			{
+				for (size_t done = 0; done < seg.size; )
+				{
+					ssize_t res = pread(seg.fd, &data[used + done], seg.size - done, seg.pos + done);
+					if (res < 0 && errno == EINTR)
+						continue;
+					if (res <= 0)
+						return false;
+					done += res;
+				}
+			}
+			used += seg.size;
+		}
+		return true;
+	}
+};
+
+int OpenFile::readThrough(const std::string& path, ReadBuffer& buf, off_t offset, FileInfo& info)
+{
+	CALL_FS_IMPL(read, -EIO, path, buf, offset, info);
+}
+
+int OpenFile::read(const std::string& path, ReadBuffer& buf, off_t offset, FileInfo& info)
+{
+	const Application* app = Application::_s_instance;
+	size_t size = buf.getSize();
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	// A handle reads what it wrote
+	int res = writePending(path, info);
+	if (res < 0 && !_error)
+		_error = res;
+
+	if (app->_readAheadWindow == 0 || size == 0)
+	{
+		lock.unlock();
+		return readThrough(path, buf, offset, info);
+	}
+
+	bool sequential = offset == _readEnd;
+	if (!sequential)
+		dropChunks();
+	_readEnd = offset + (off_t)size;
+	if (sequential)
+	{
+		// The data may be on its way
+		while (_prefetching && _prefetchOffset <= offset && offset < _prefetchEnd)
+			_prefetched.wait(lock);
+		if (serve(buf, offset, size))
+		{
+			Stats::count(Stats::READAHEAD_HITS);
+			_window = std::min(std::max(2 * _window, 2 * size), app->_readAheadWindow);
+			schedule(path, *info.get(), _readEnd);
+			return 0;
+		}
+		Stats::count(Stats::READAHEAD_MISSES);
+		if (_window == 0)
+			_window = std::min(2 * size, app->_readAheadWindow);
+	}
+	lock.unlock();
+
+	res = readThrough(path, buf, offset, info);
+	// A short read is the end of the file: nothing to read ahead
+	if (!sequential || res < 0 || buf.getFilled() < size)
+		return res;
+	lock.lock();
+	schedule(path, *info.get(), offset + (off_t)size);
+	return res;
+}
+
+bool OpenFile::serve(ReadBuffer& buf, off_t offset, size_t size)
+{
+	// Chunks the reader went past were used up; the last one is kept to
+	// answer reads at the end of the file
+	while (!_chunks.empty() && (_chunks.front().end() < offset || (_chunks.front().end() == offset && !_chunks.front().last)))
+		_chunks.pop_front();
+	if (_chunks.empty() || _chunks.front().offset > offset)
+		return false;
+
+	off_t end = offset + (off_t)size;
+	off_t covered = offset;
+	bool last = false;
+	for (std::deque<Chunk>::const_iterator it = _chunks.begin(); it != _chunks.end() && covered < end && !last; ++it)
+	{
+		if (it->offset > covered)
+			break;
+		covered = it->end();
+		last = it->last;
+	}
+	if (covered < end && !last)
+		return false;
+
+	for (std::deque<Chunk>::const_iterator it = _chunks.begin(); it != _chunks.end() && offset < end; ++it)
+	{
+		off_t to = std::min(end, it->end());
+		if (to > offset)
+		{
+			buf.reference(&(*it->data)[offset - it->offset], (size_t)(to - offset), it->data);
+			offset = to;
+		}
+		if (it->last)
+			break;
+	}
+	return true;
+}
+
+void OpenFile::dropChunks()
+{
+	uint64_t wasted = 0;
+	for (std::deque<Chunk>::const_iterator it = _chunks.begin(); it != _chunks.end(); ++it)
+		wasted += (uint64_t)std::max((off_t)0, it->end() - std::max(it->offset, _readEnd));
+	_chunks.clear();
+	++_generation;
+	if (wasted)
+	{
+		Stats::count(Stats::READAHEAD_WASTED_BYTES, wasted);
+		_window /= 2;
+	}
+}
+
+void OpenFile::schedule(const std::string& path, const struct fuse_file_info& fi, off_t position)
+{
+	if (_window == 0 || _prefetching)
+		return;
+	off_t from = position;
+	if (!_chunks.empty())
+	{
+		if (_chunks.back().last)
+			return;
+		from = std::max(from, _chunks.back().end());
+	}
+
+	// Prefetch again once half of the window was read
+	size_t ahead = (size_t)(from - position);
+	if (ahead >= _window / 2)
+		return;
+	size_t size = _window - ahead;
+	_prefetching = true;
+	_prefetchOffset = from;
+	_prefetchEnd = from + (off_t)size;
+	if (!Prefetcher::submit(std::bind(&OpenFile::prefetch, this, path, fi, from, size, _generation)))
+		_prefetching = false;
+}
+
+void Prefetcher::start(unsigned int threads)
+{
+	Pool::instance().start(threads);
+}
+
+void Prefetcher::stop()
+{
+	Pool::instance().stop();
+}
+
+bool Prefetcher::submit(const std::function<void()>& task)
+{
+	return Pool::instance().submit(task);
+}
+
+void OpenFile::prefetch(const std::string& path, struct fuse_file_info fi, off_t offset, size_t size, uint32_t generation)
+{
+	std::shared_ptr<std::vector<char> > data;
+	{
+		ArenaScope arena;
+		FileInfo info(&fi);
+		ReadBuffer buf(size, true);
+		if (readThrough(path, buf, offset, info) == 0)
+		{
+			data = std::make_shared<std::vector<char> >();
+			if (!copyOut(buf, *data))
+				data.reset();
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	_prefetching = false;
+	if (data)
+	{
+		Stats::count(Stats::READAHEAD_PREFETCHED_BYTES, data->size());
+		if (generation == _generation && (_chunks.empty() || _chunks.back().end() == offset))
+		{
+			Chunk chunk = { offset, data, data->size() < size };
+			_chunks.push_back(chunk);
+		}
+		else
+			Stats::count(Stats::READAHEAD_WASTED_BYTES, data->size());
+	}
+	_prefetched.notify_all();
+}
@@ -0,0 +1,524 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <fusepp/Snapshot.h>
+#include <fusepp/Log.h>
+#include "hooks.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+using namespace fusepp;
+
+const size_t NamespaceSnapshot::MAX_RECORDED;
+const size_t NamespaceSnapshot::SHARDS;
+
+// One entry of the file; its path is in the strings that follow the records
+struct NamespaceSnapshot::Record
+{
+	uint64_t pathOffset;
+	uint32_t pathLength;
+	uint32_t mode;
+	uint64_t ino, size, blocks;
+	uint32_t nlink, uid, gid, rdev;
+	int64_t atime, mtime, ctime;
+};
+
+namespace
+{
+	const char MAGIC[8] = { 'F', 'U', 'S', 'E', 'P', 'P', 'N', 'S' };
+	const uint32_t VERSION = 1;
+
+	// The records follow the header, then the strings
+	struct FileHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t recordSize;
+		uint64_t count;
+		uint64_t stringsSize;
+	};
+
+	inline int compare(const char* a, size_t aLength, const char* b, size_t bLength)
+	{
+		int res = memcmp(a, b, std::min(aLength, bLength));
+		if (res != 0)
+			return res;
+		return aLength < bLength ? -1 : (aLength > bLength ? 1 : 0);
+	}
+
+	class ReadLock
+	{
+	public:
+		ReadLock(pthread_rwlock_t& lock) : _lock(lock) { pthread_rwlock_rdlock(&_lock); }
+		~ReadLock() { pthread_rwlock_unlock(&_lock); }
+	private:
+		pthread_rwlock_t& _lock;
+	};
+
+	class WriteLock
+	{
+	public:
+		WriteLock(pthread_rwlock_t& lock) : _lock(lock) { pthread_rwlock_wrlock(&_lock); }
+		~WriteLock() { pthread_rwlock_unlock(&_lock); }
+	private:
+		pthread_rwlock_t& _lock;
+	};
+
+	bool writeAll(int fd, const void* data, size_t size)
+	{
+		const char* p = static_cast<const char*>(data);
+		while (size > 0)
+		{
+			ssize_t res = ::write(fd, p, size);
+			if (res < 0 && errno == EINTR)
+				continue;
+			if (res <= 0)
+				return false;
+			p += res;
+			size -= res;
+		}
+		return true;
+	}
+
+	// Saves the snapshot of the Application every interval, from a thread
+	// of its own, while it is mounted
+	class Saver
+	{
+	public:
+		static Saver& instance()
+		{
+			static Saver* saver = new Saver;
+			return *saver;
+		}
+
+		void start(NamespaceSnapshot* snapshot, const std::string& file, double interval)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_snapshot)
+				return;
+			_snapshot = snapshot;
+			_file = file;
+			_interval = interval;
+			_running = true;
+
+			// Signals are left to the main thread, as for the workers
+			sigset_t all, previous;
+			sigfillset(&all);
+			pthread_sigmask(SIG_BLOCK, &all, &previous);
+			_thread = std::thread(&Saver::run, this);
+			pthread_sigmask(SIG_SETMASK, &previous, NULL);
+		}
+
+		void stop()
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				if (!_snapshot)
+					return;
+				_running = false;
+				_wakeup.notify_one();
+			}
+			_thread.join();
+
+			// Once unmounted, nothing changes anymore: this one is complete
+			_snapshot->save(_file);
+			_snapshot = NULL;
+		}
+
+	private:
+		Saver() : _snapshot(NULL), _interval(0), _running(false) {}
+
+		void run()
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			while (_running)
+			{
+				if (_interval <= 0)
+					_wakeup.wait(lock);
+				else if (_wakeup.wait_for(lock, std::chrono::duration<double>(_interval)) == std::cv_status::timeout && _running)
+				{
+					lock.unlock();
+					_snapshot->save(_file);
+					lock.lock();
+				}
+			}
+		}
+
+		std::mutex _mutex;
+		std::condition_variable _wakeup;
+		std::thread _thread;
+		NamespaceSnapshot* _snapshot;
+		std::string _file;
+		double _interval;
+		bool _running;
+	};
+};
+
+NamespaceSnapshot::NamespaceSnapshot()
+	: _recorded(0)
+{
+	memset(&_base, 0, sizeof(_base));
+	pthread_rwlock_init(&_rebasing, NULL);
+}
+
+NamespaceSnapshot::~NamespaceSnapshot()
+{
+	unmap(_base);
+	pthread_rwlock_destroy(&_rebasing);
+}
+
+void NamespaceSnapshot::unmap(Mapping& mapping)
+{
+	if (mapping.map)
+		munmap(mapping.map, mapping.size);
+	memset(&mapping, 0, sizeof(mapping));
+}
+
+size_t NamespaceSnapshot::getLoadedCount() const
+{
+	ReadLock lock(_rebasing);
+	return _base.count;
+}
+
+// ===========================================================================
+// Loading
+// ===========================================================================
+
+bool NamespaceSnapshot::map(const std::string& file, Mapping& mapping)
+{
+	memset(&mapping, 0, sizeof(mapping));
+	int fd = ::open(file.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	void* map = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(FileHeader))
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED)
+		return false;
+	mapping.map = map;
+	mapping.size = st.st_size;
+
+	const FileHeader* header = static_cast<const FileHeader*>(map);
+	size_t available = mapping.size - sizeof(FileHeader);
+	if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != VERSION || header->recordSize != sizeof(Record)
+		|| header->count > available / sizeof(Record) || header->stringsSize != available - header->count * sizeof(Record))
+	{
+		FUSEPP_LOG_WARNING("Ignoring the namespace snapshot %s: not a snapshot of this version", file.c_str());
+		unmap(mapping);
+		return false;
+	}
+	mapping.records = reinterpret_cast<const Record*>(header + 1);
+	mapping.count = header->count;
+	mapping.strings = reinterpret_cast<const char*>(mapping.records + mapping.count);
+	mapping.stringsSize = header->stringsSize;
+
+	// A damaged file must not lead find() astray
+	for (size_t i = 0; i < mapping.count; ++i)
+	{
+		const Record& record(mapping.records[i]);
+		bool valid = record.pathOffset <= mapping.stringsSize && record.pathLength <= mapping.stringsSize - record.pathOffset;
+		if (valid && i > 0)
+		{
+			const Record& previous(mapping.records[i - 1]);
+			valid = compare(mapping.strings + previous.pathOffset, previous.pathLength,
+				mapping.strings + record.pathOffset, record.pathLength) < 0;
+		}
+		if (!valid)
+		{
+			FUSEPP_LOG_WARNING("Ignoring the namespace snapshot %s: damaged at entry %lu", file.c_str(), (unsigned long)i);
+			unmap(mapping);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool NamespaceSnapshot::load(const std::string& file)
+{
+	unmap(_base);
+	_taken.reset();
+	if (!map(file, _base))
+		return false;
+
+	_taken.reset(new std::atomic<uint8_t>[_base.count]);
+	for (size_t i = 0; i < _base.count; ++i)
+		_taken[i].store(0, std::memory_order_relaxed);
+	FUSEPP_LOG_INFO("Loaded %lu entries from the namespace snapshot %s", (unsigned long)_base.count, file.c_str());
+	return true;
+}
+
+const char* NamespaceSnapshot::pathAt(size_t index, size_t& length) const
+{
+	length = _base.records[index].pathLength;
+	return _base.strings + _base.records[index].pathOffset;
+}
+
+ssize_t NamespaceSnapshot::find(const std::string& path) const
+{
+	size_t low = 0, high = _base.count;
+	while (low < high)
+	{
+		size_t middle = low + (high - low) / 2;
+		size_t length;
+		const char* p = pathAt(middle, length);
+		int res = compare(p, length, path.data(), path.size());
+		if (res == 0)
+			return (ssize_t)middle;
+		if (res < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return -1;
+}
+
+bool NamespaceSnapshot::take(const std::string& path, struct stat& attr)
+{
+	ReadLock lock(_rebasing);
+	if (_base.count == 0)
+		return false;
+	ssize_t index = find(path);
+	if (index < 0 || _taken[index].exchange(1, std::memory_order_relaxed))
+		return false;
+
+	const Record& record(_base.records[index]);
+	memset(&attr, 0, sizeof(attr));
+	attr.st_mode = record.mode;
+	attr.st_ino = record.ino;
+	attr.st_size = record.size;
+	attr.st_blocks = record.blocks;
+	attr.st_nlink = record.nlink;
+	attr.st_uid = record.uid;
+	attr.st_gid = record.gid;
+	attr.st_rdev = record.rdev;
+	attr.st_atime = record.atime;
+	attr.st_mtime = record.mtime;
+	attr.st_ctime = record.ctime;
+	return true;
+}
+
+// ===========================================================================
+// Recording
+// ===========================================================================
+
+NamespaceSnapshot::Shard& NamespaceSnapshot::shard(const std::string& path)
+{
+	return _shards[std::hash<std::string>()(path) % SHARDS];
+}
+
+void NamespaceSnapshot::update(const std::string& path, const struct stat* attr)
+{
+	Shard& s(shard(path));
+	std::lock_guard<std::mutex> lock(s.mutex);
+	RecordedMap::iterator it = s.entries.find(path);
+	if (it == s.entries.end())
+	{
+		if (_recorded.load(std::memory_order_relaxed) >= MAX_RECORDED)
+			return;
+		_recorded.fetch_add(1, std::memory_order_relaxed);
+		it = s.entries.insert(RecordedMap::value_type(path, Recorded())).first;
+	}
+	it->second.gone = attr == NULL;
+	if (attr)
+		it->second.attr = *attr;
+}
+
+void NamespaceSnapshot::record(const std::string& path, const struct stat& attr)
+{
+	update(path, &attr);
+}
+
+void NamespaceSnapshot::forget(const std::string& path)
+{
+	{
+		// What was loaded must not be served anymore either
+		ReadLock lock(_rebasing);
+		ssize_t index = _base.count ? find(path) : -1;
+		if (index >= 0)
+			_taken[index].store(1, std::memory_order_relaxed);
+	}
+	update(path, NULL);
+}
+
+void NamespaceSnapshot::restore(const std::vector<std::pair<std::string,Recorded> >& entries)
+{
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		Shard& s(shard(entries[i].first));
+		std::lock_guard<std::mutex> lock(s.mutex);
+		if (s.entries.insert(entries[i]).second)
+			_recorded.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+// ===========================================================================
+// Saving
+// ===========================================================================
+
+bool NamespaceSnapshot::save(const std::string& file)
+{
+	std::lock_guard<std::mutex> saving(_saving);
+
+	// The recorded entries are taken out of the shards: those recorded from
+	// now on go to the next save
+	typedef std::pair<std::string,Recorded> Entry;
+	std::vector<Entry> recorded;
+	for (size_t i = 0; i < SHARDS; ++i)
+	{
+		std::lock_guard<std::mutex> lock(_shards[i].mutex);
+		recorded.insert(recorded.end(), _shards[i].entries.begin(), _shards[i].entries.end());
+		_recorded.fetch_sub(_shards[i].entries.size(), std::memory_order_relaxed);
+		RecordedMap().swap(_shards[i].entries);
+	}
+	std::sort(recorded.begin(), recorded.end(),
+		[](const Entry& a, const Entry& b) { return a.first < b.first; });
+
+	// Merge both sorted sequences, the recorded entries taking precedence.
+	// Only save() replaces the mapping, so reading it needs no lock here.
+	// Every record remembers the loaded entry it comes from, if any.
+	std::vector<Record> records;
+	std::vector<ssize_t> origins;
+	std::string strings;
+	records.reserve(_base.count + recorded.size());
+	origins.reserve(_base.count + recorded.size());
+	size_t i = 0, j = 0;
+	while (i < _base.count || j < recorded.size())
+	{
+		size_t length = 0;
+		const char* path = i < _base.count ? pathAt(i, length) : NULL;
+		int res = !path ? 1 : (j == recorded.size() ? -1 : compare(path, length, recorded[j].first.data(), recorded[j].first.size()));
+		Record record;
+		ssize_t origin = -1;
+		if (res < 0)
+		{
+			origin = (ssize_t)i;
+			record = _base.records[i++];
+		}
+		else
+		{
+			if (res == 0)
+				++i;
+			const Entry& entry(recorded[j++]);
+			if (entry.second.gone)
+				continue;
+			const struct stat& attr(entry.second.attr);
+			memset(&record, 0, sizeof(record));
+			record.mode = attr.st_mode;
+			record.ino = attr.st_ino;
+			record.size = attr.st_size;
+			record.blocks = attr.st_blocks;
+			record.nlink = attr.st_nlink;
+			record.uid = attr.st_uid;
+			record.gid = attr.st_gid;
+			record.rdev = attr.st_rdev;
+			record.atime = attr.st_atime;
+			record.mtime = attr.st_mtime;
+			record.ctime = attr.st_ctime;
+			path = entry.first.data();
+			length = entry.first.size();
+		}
+		record.pathOffset = strings.size();
+		record.pathLength = length;
+		strings.append(path, length);
+		records.push_back(record);
+		origins.push_back(origin);
+	}
+
+	FileHeader header;
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.recordSize = sizeof(Record);
+	header.count = records.size();
+	header.stringsSize = strings.size();
+
+	// Written aside and renamed, so that the file is always complete
+	std::string temporary = file + ".tmp";
+	int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		FUSEPP_LOG_ERROR("Could not write the namespace snapshot %s: %s", temporary.c_str(), strerror(errno));
+		restore(recorded);
+		return false;
+	}
+	bool written = writeAll(fd, &header, sizeof(header))
+		&& writeAll(fd, records.empty() ? NULL : &records[0], records.size() * sizeof(Record))
+		&& writeAll(fd, strings.data(), strings.size())
+		&& fsync(fd) == 0;
+	int err = errno;
+	::close(fd);
+	if (!written || rename(temporary.c_str(), file.c_str()) != 0)
+	{
+		FUSEPP_LOG_ERROR("Could not write the namespace snapshot %s: %s", file.c_str(), strerror(written ? errno : err));
+		unlink(temporary.c_str());
+		restore(recorded);
+		return false;
+	}
+	FUSEPP_LOG_DEBUG("Saved %lu entries to the namespace snapshot %s", (unsigned long)records.size(), file.c_str());
+
+	// The new file becomes the base. Entries that come from the file system
+	// were answered by it already; loaded ones keep their state.
+	Mapping saved;
+	if (!map(file, saved))
+	{
+		FUSEPP_LOG_ERROR("Could not map the namespace snapshot %s after saving it", file.c_str());
+		restore(recorded);
+		return false;
+	}
+	std::unique_ptr<std::atomic<uint8_t>[]> taken(new std::atomic<uint8_t>[saved.count]);
+	WriteLock lock(_rebasing);
+	for (size_t k = 0; k < saved.count; ++k)
+		taken[k].store(origins[k] < 0 ? 1 : _taken[origins[k]].load(std::memory_order_relaxed), std::memory_order_relaxed);
+	unmap(_base);
+	_base = saved;
+	_taken.swap(taken);
+	return true;
+}
+
+// ===========================================================================
+// fusepp_impl::Snapshots
+// ===========================================================================
+
+void fusepp_impl::Snapshots::start()
+{
+	Application* app = Application::_s_instance;
+	NamespaceSnapshot* snapshot = app->_snapshot.get();
+	if (!snapshot)
+		return;
+	snapshot->load(app->_snapshotFile);
+	Saver::instance().start(snapshot, app->_snapshotFile, app->_snapshotInterval);
+}
+
+void fusepp_impl::Snapshots::stop()
+{
+	if (Application::_s_instance && Application::_s_instance->_snapshot)
+		Saver::instance().stop();
+}
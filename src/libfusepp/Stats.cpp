@@ -0,0 +1,279 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include <fusepp/Stats.h>
+#include <stdio.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+using namespace fusepp;
+
+namespace
+{
+	const unsigned int SUB_BITS = 4;
+	const unsigned int SUB_BUCKETS = 1 << SUB_BITS;
+
+	const char* const NAMES[] = { "getattr", "readdir", "lookup", "open", "release", "read", "write", "flush", "fsync",
+		"getxattr", "listxattr", "setxattr", "removexattr" };
+	const char* const COUNTER_NAMES[] = { "readahead_hits", "readahead_misses", "readahead_prefetched_bytes", "readahead_wasted_bytes",
+		"singleflight_shared", "singleflight_timeouts", "lock_contended", "lock_wait_nanos",
+		"xattr_cache_hits", "xattr_cache_misses" };
+
+	// Only the owning thread writes; plain loads and stores are enough and
+	// let readers see consistent values
+	struct Counters
+	{
+		std::atomic<uint64_t> count, errors, totalNanos, maxNanos;
+		std::atomic<uint64_t> histogram[Stats::HISTOGRAM_BUCKETS];
+	};
+
+	inline void increment(std::atomic<uint64_t>& value, uint64_t n)
+	{
+		value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+	struct ThreadCounters
+	{
+		ThreadCounters();
+		~ThreadCounters();
+
+		Counters ops[Stats::OPERATION_COUNT];
+		std::atomic<uint64_t> counters[Stats::COUNTER_COUNT];
+	};
+
+	class Registry
+	{
+	public:
+		static Registry& instance()
+		{
+			// Never destroyed: threads may exit after static destruction
+			static Registry* registry = new Registry;
+			return *registry;
+		}
+
+		void add(ThreadCounters* counters)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_threads.push_back(counters);
+		}
+
+		// The counts of exiting threads are kept
+		void remove(ThreadCounters* counters)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			for (unsigned int op = 0; op < Stats::OPERATION_COUNT; ++op)
+				merge(counters->ops[op], _retired[op]);
+			for (unsigned int counter = 0; counter < Stats::COUNTER_COUNT; ++counter)
+				_retiredCounters[counter] += counters->counters[counter].load(std::memory_order_relaxed);
+			_threads.erase(std::remove(_threads.begin(), _threads.end(), counters), _threads.end());
+		}
+
+		Stats::Summary summarize(Stats::Operation op)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			Stats::Summary summary = _retired[op];
+			for (size_t i = 0; i < _threads.size(); ++i)
+				merge(_threads[i]->ops[op], summary);
+			return summary;
+		}
+
+		uint64_t sum(Stats::Counter counter)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			uint64_t value = _retiredCounters[counter];
+			for (size_t i = 0; i < _threads.size(); ++i)
+				value += _threads[i]->counters[counter].load(std::memory_order_relaxed);
+			return value;
+		}
+
+	private:
+		Registry()
+		{
+			for (unsigned int op = 0; op < Stats::OPERATION_COUNT; ++op)
+				_retired[op].histogram.resize(Stats::HISTOGRAM_BUCKETS);
+			for (unsigned int counter = 0; counter < Stats::COUNTER_COUNT; ++counter)
+				_retiredCounters[counter] = 0;
+		}
+
+		static void merge(const Counters& counters, Stats::Summary& summary)
+		{
+			summary.count += counters.count.load(std::memory_order_relaxed);
+			summary.errors += counters.errors.load(std::memory_order_relaxed);
+			summary.totalNanos += counters.totalNanos.load(std::memory_order_relaxed);
+			summary.maxNanos = std::max(summary.maxNanos, counters.maxNanos.load(std::memory_order_relaxed));
+			for (unsigned int i = 0; i < Stats::HISTOGRAM_BUCKETS; ++i)
+				summary.histogram[i] += counters.histogram[i].load(std::memory_order_relaxed);
+		}
+
+		std::mutex _mutex;
+		std::vector<ThreadCounters*> _threads;
+		Stats::Summary _retired[Stats::OPERATION_COUNT];
+		uint64_t _retiredCounters[Stats::COUNTER_COUNT];
+	};
+
+	ThreadCounters::ThreadCounters()
+	{
+		for (unsigned int op = 0; op < Stats::OPERATION_COUNT; ++op)
+		{
+			Counters& c = ops[op];
+			c.count = c.errors = c.totalNanos = c.maxNanos = 0;
+			for (unsigned int i = 0; i < Stats::HISTOGRAM_BUCKETS; ++i)
+				c.histogram[i] = 0;
+		}
+		for (unsigned int counter = 0; counter < Stats::COUNTER_COUNT; ++counter)
+			counters[counter] = 0;
+		Registry::instance().add(this);
+	}
+
+	ThreadCounters::~ThreadCounters()
+	{
+		Registry::instance().remove(this);
+	}
+
+	thread_local std::unique_ptr<ThreadCounters> t_counters;
+
+	inline ThreadCounters& threadCounters()
+	{
+		if (!t_counters)
+			t_counters.reset(new ThreadCounters);
+		return *t_counters;
+	}
+};
+
+// ===========================================================================
+// Stats implementation
+// ===========================================================================
+
+std::atomic<bool> Stats::_s_enabled(false);
+const unsigned int Stats::HISTOGRAM_BUCKETS;
+const char* const Stats::STATS_DIRECTORY = "/.fusepp";
+const char* const Stats::STATS_PATH = "/.fusepp/stats";
+
+void Stats::setEnabled(bool enabled)
+{
+	_s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+const char* Stats::getName(Operation op)
+{
+	return op < OPERATION_COUNT ? NAMES[op] : "unknown";
+}
+
+const char* Stats::getName(Counter counter)
+{
+	return counter < COUNTER_COUNT ? COUNTER_NAMES[counter] : "unknown";
+}
+
+unsigned int Stats::getBucket(uint64_t nanos)
+{
+	if (nanos < SUB_BUCKETS)
+		return (unsigned int)nanos;
+	unsigned int exponent = 63 - __builtin_clzll(nanos);
+	unsigned int bucket = (exponent - SUB_BITS + 1) * SUB_BUCKETS + (unsigned int)((nanos >> (exponent - SUB_BITS)) & (SUB_BUCKETS - 1));
+	return std::min(bucket, HISTOGRAM_BUCKETS - 1);
+}
+
+uint64_t Stats::getBucketLowerBound(unsigned int bucket)
+{
+	if (bucket < SUB_BUCKETS)
+		return bucket;
+	unsigned int exponent = bucket / SUB_BUCKETS + SUB_BITS - 1;
+	return ((uint64_t)1 << exponent) | ((uint64_t)(bucket % SUB_BUCKETS) << (exponent - SUB_BITS));
+}
+
+void Stats::record(Operation op, uint64_t nanos, bool error)
+{
+	Counters& c = threadCounters().ops[op];
+	increment(c.count, 1);
+	if (error)
+		increment(c.errors, 1);
+	increment(c.totalNanos, nanos);
+	if (nanos > c.maxNanos.load(std::memory_order_relaxed))
+		c.maxNanos.store(nanos, std::memory_order_relaxed);
+	increment(c.histogram[getBucket(nanos)], 1);
+}
+
+void Stats::count(Counter counter, uint64_t n)
+{
+	increment(threadCounters().counters[counter], n);
+}
+
+uint64_t Stats::getCounter(Counter counter)
+{
+	return Registry::instance().sum(counter);
+}
+
+Stats::Summary::Summary()
+	: count(0), errors(0), totalNanos(0), maxNanos(0)
+{
+}
+
+uint64_t Stats::Summary::getPercentile(double q) const
+{
+	if (!count)
+		return 0;
+	uint64_t rank = std::max((uint64_t)1, (uint64_t)(q * count + 0.5));
+	uint64_t seen = 0;
+	for (unsigned int i = 0; i < histogram.size(); ++i)
+	{
+		seen += histogram[i];
+		if (seen >= rank)
+		{
+			if (i + 1 >= HISTOGRAM_BUCKETS)
+				return maxNanos;
+			return std::min(maxNanos, getBucketLowerBound(i + 1) - 1);
+		}
+	}
+	return maxNanos;
+}
+
+Stats::Summary Stats::getSummary(Operation op)
+{
+	return Registry::instance().summarize(op);
+}
+
+std::string Stats::report()
+{
+	std::string out = "operation count errors mean_us p50_us p99_us p999_us max_us\n";
+	for (unsigned int op = 0; op < OPERATION_COUNT; ++op)
+	{
+		Summary s = getSummary(static_cast<Operation>(op));
+		char line[256];
+		snprintf(line, sizeof(line), "%s %llu %llu %.1f %.1f %.1f %.1f %.1f\n", NAMES[op],
+			(unsigned long long)s.count, (unsigned long long)s.errors,
+			s.count ? s.totalNanos / 1000.0 / s.count : 0.0,
+			s.getPercentile(0.5) / 1000.0, s.getPercentile(0.99) / 1000.0,
+			s.getPercentile(0.999) / 1000.0, s.maxNanos / 1000.0);
+		out += line;
+	}
+	out += "\ncounter value\n";
+	for (unsigned int counter = 0; counter < COUNTER_COUNT; ++counter)
+	{
+		char line[128];
+		snprintf(line, sizeof(line), "%s %llu\n", COUNTER_NAMES[counter],
+			(unsigned long long)getCounter(static_cast<Counter>(counter)));
+		out += line;
+	}
+	return out;
+}
@@ -0,0 +1,140 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include <fusepp/Stats.h>
+#include <fusepp/InodeTable.h>
+#include "hooks.h"
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <string>
+using namespace fusepp;
+using fusepp_impl::StatsFile;
+
+namespace
+{
+	const char* const DIRECTORY_NAME = ".fusepp";
+	const char* const FILE_NAME = "stats";
+
+	std::atomic<ino_t> s_directoryIno(0), s_fileIno(0);
+};
+
+// ===========================================================================
+// StatsFile implementation
+// ===========================================================================
+
+StatsFile::Kind StatsFile::matchPath(const char* path)
+{
+	if (strcmp(path, Stats::STATS_DIRECTORY) == 0)
+		return DIRECTORY;
+	if (strcmp(path, Stats::STATS_PATH) == 0)
+		return FILE;
+	return NONE;
+}
+
+StatsFile::Kind StatsFile::matchEntry(ino_t parent, const char* name)
+{
+	if (!Stats::isEnabled())
+		return NONE;
+	if (parent == InodeTable::ROOT && strcmp(name, DIRECTORY_NAME) == 0)
+		return DIRECTORY;
+	if (parent == s_directoryIno.load(std::memory_order_relaxed) && strcmp(name, FILE_NAME) == 0)
+		return FILE;
+	return NONE;
+}
+
+StatsFile::Kind StatsFile::matchInode(ino_t ino)
+{
+	if (!Stats::isEnabled())
+		return NONE;
+	if (ino == s_fileIno.load(std::memory_order_relaxed))
+		return FILE;
+	if (ino == s_directoryIno.load(std::memory_order_relaxed))
+		return DIRECTORY;
+	return NONE;
+}
+
+void StatsFile::setInode(Kind kind, ino_t ino)
+{
+	if (kind == DIRECTORY)
+		s_directoryIno.store(ino);
+	else if (kind == FILE)
+		s_fileIno.store(ino);
+}
+
+void StatsFile::forget(ino_t ino)
+{
+	ino_t expected = ino;
+	s_directoryIno.compare_exchange_strong(expected, 0);
+	expected = ino;
+	s_fileIno.compare_exchange_strong(expected, 0);
+}
+
+void StatsFile::getAttr(Kind kind, struct stat* buf)
+{
+	memset(buf, 0, sizeof(*buf));
+	buf->st_uid = getuid();
+	buf->st_gid = getgid();
+	if (kind == DIRECTORY)
+	{
+		buf->st_mode = S_IFDIR | 0555;
+		buf->st_nlink = 2;
+	}
+	else
+	{
+		// The size is unknown until the file is opened: it is read with
+		// direct I/O, until the end
+		buf->st_mode = S_IFREG | 0444;
+		buf->st_nlink = 1;
+	}
+}
+
+void StatsFile::fill(FS_readdir::DirectoryFiller& filler)
+{
+	filler.add(FILE_NAME);
+}
+
+int StatsFile::open(struct fuse_file_info* fi)
+{
+	if ((fi->flags & O_ACCMODE) != O_RDONLY)
+		return -EACCES;
+	fi->fh = reinterpret_cast<uint64_t>(new std::string(Stats::report()));
+	fi->direct_io = 1;
+	return 0;
+}
+
+int StatsFile::read(struct fuse_file_info* fi, ReadBuffer& buf, off_t offset)
+{
+	const std::string* content = reinterpret_cast<const std::string*>(fi->fh);
+	if (offset >= 0 && (size_t)offset < content->size())
+		buf.reference(content->data() + offset, content->size() - offset, std::shared_ptr<const void>());
+	return 0;
+}
+
+void StatsFile::release(struct fuse_file_info* fi)
+{
+	delete reinterpret_cast<std::string*>(fi->fh);
+	fi->fh = 0;
+}
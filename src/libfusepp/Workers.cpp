@@ -0,0 +1,195 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include <fusepp/Worker.h>
+#include <fusepp/Application.h>
+#include "hooks.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <string.h>
+#include <errno.h>
+#include <memory>
+#include <atomic>
+#include <vector>
+using namespace fusepp;
+
+namespace
+{
+	thread_local std::unique_ptr<WorkerContext> t_context;
+
+	struct Pool
+	{
+		struct fuse_session* se;
+		struct fuse_chan* ch;
+		sem_t finished;
+		std::atomic<int> error;
+	};
+
+	// Same loop as libfuse's multithreaded one, with a worker context. The
+	// worker can only be cancelled while waiting for a request.
+	void* worker(void* arg)
+	{
+		Pool* pool = static_cast<Pool*>(arg);
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+		try {
+			fusepp_impl::Workers::createContext();
+		} catch (...) {
+			// Already reported; attempted again on first use
+		}
+
+		size_t bufsize = fuse_chan_bufsize(pool->ch);
+		std::vector<char> buffer(bufsize);
+		while (!fuse_session_exited(pool->se))
+		{
+			struct fuse_chan* ch = pool->ch;
+			struct fuse_buf fbuf;
+			memset(&fbuf, 0, sizeof(fbuf));
+			fbuf.mem = &buffer[0];
+			fbuf.size = bufsize;
+
+			pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+			int res = fuse_session_receive_buf(pool->se, &fbuf, &ch);
+			pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+			if (res == -EINTR)
+				continue;
+			if (res <= 0)
+			{
+				if (res < 0)
+					pool->error = res;
+				fuse_session_exit(pool->se);
+				break;
+			}
+			fuse_session_process_buf(pool->se, &fbuf, ch);
+		}
+
+		t_context.reset();
+		sem_post(&pool->finished);
+		return NULL;
+	}
+};
+
+// ===========================================================================
+// WorkerContext implementation
+// ===========================================================================
+
+WorkerContext::~WorkerContext()
+{
+}
+
+WorkerContext& WorkerContext::current()
+{
+	WorkerContext* context = t_context.get();
+	if (!context)
+		context = fusepp_impl::Workers::createContext();
+	if (!context)
+		throw Error("fusepp::WorkerContext::current() : the file system does not implement FS_worker");
+	return *context;
+}
+
+// ===========================================================================
+// Workers implementation
+// ===========================================================================
+
+WorkerContext* fusepp_impl::Workers::createContext()
+{
+	Application* app = Application::_s_instance;
+	if (!app || !app->_ops.worker_context)
+		return NULL;
+	if (!t_context)
+	{
+		try {
+			t_context.reset(app->_ops.worker_context(app->_ops.target));
+		} catch (fusepp::Error& err) {
+			FUSEPP_LOG_ERROR("Worker context creation failed: %s", err.getReason().c_str());
+			throw;
+		} catch (std::exception& err) {
+			FUSEPP_LOG_ERROR("Worker context creation failed: %s", err.what());
+			throw;
+		}
+	}
+	return t_context.get();
+}
+
+void fusepp_impl::Workers::destroyContext()
+{
+	t_context.reset();
+}
+
+int fusepp_impl::Workers::run(struct fuse_session* se, unsigned int count)
+{
+	Pool pool;
+	pool.se = se;
+	pool.ch = fuse_session_next_chan(se, NULL);
+	pool.error = 0;
+	sem_init(&pool.finished, 0, 0);
+
+	const Application* app = Application::_s_instance;
+	bool readAhead = app->_readAheadWindow > 0 && app->_ops.read;
+	bool coalescing = app->_writeCoalescingSize > 0 && app->_ops.write;
+	if (readAhead)
+		fusepp_impl::Prefetcher::start(app->_readAheadThreads);
+	if (coalescing)
+		fusepp_impl::Flusher::start();
+
+	// Signals are left to the main thread, whose handlers (installed by
+	// libfuse) make the session exit
+	sigset_t all, previous;
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &previous);
+	std::vector<pthread_t> threads;
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		pthread_t thread;
+		int res = pthread_create(&thread, NULL, worker, &pool);
+		if (res != 0)
+		{
+			FUSEPP_LOG_ERROR("Could not start worker %u: %s", i, strerror(res));
+			break;
+		}
+		threads.push_back(thread);
+	}
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+	if (threads.empty())
+		pool.error = -1;
+	else
+	{
+		while (!fuse_session_exited(se))
+			sem_wait(&pool.finished);
+	}
+
+	for (size_t i = 0; i < threads.size(); ++i)
+		pthread_cancel(threads[i]);
+	for (size_t i = 0; i < threads.size(); ++i)
+		pthread_join(threads[i], NULL);
+	if (readAhead)
+		fusepp_impl::Prefetcher::stop();
+	if (coalescing)
+		fusepp_impl::Flusher::stop();
+
+	sem_destroy(&pool.finished);
+	fuse_session_reset(se);
+	return pool.error < 0 ? -1 : 0;
+}
@@ -0,0 +1,282 @@
+/*
+fusepp, An extensible C++ wrapper to FUSE, the Filesystem in Userspace
+Copyright (C) 2014 University of Lausanne, Switzerland
+Author: Thibault Genessay
+https://github.com/tibogens/fusepp
+
+This file is part of fusepp.
+
+fusepp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+fusepp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include <fusepp/XattrCache.h>
+#include <algorithm>
+#include <chrono>
+using namespace fusepp;
+
+const size_t XattrCacheTable::SHARDS;
+
+namespace
+{
+	inline int64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	inline bool contains(const std::vector<std::string>& names, const std::string& name)
+	{
+		return std::find(names.begin(), names.end(), name) != names.end();
+	}
+
+	inline void erase(std::vector<std::string>& names, const std::string& name)
+	{
+		names.erase(std::remove(names.begin(), names.end(), name), names.end());
+	}
+};
+
+XattrCacheTable::Entry::Entry()
+	: expires(0), complete(false)
+{
+}
+
+XattrCacheTable::Shard::Shard()
+	: invalidations(0)
+{
+}
+
+XattrCacheTable::XattrCacheTable(size_t capacity, double ttl)
+	: _capacity(0), _shardCapacity(0), _ttl(0), _ttlNs(0)
+{
+	configure(capacity, ttl);
+}
+
+XattrCacheTable::~XattrCacheTable()
+{
+}
+
+void XattrCacheTable::configure(size_t capacity, double ttl)
+{
+	_shardCapacity = std::max(capacity / SHARDS, (size_t)1);
+	_capacity = _shardCapacity * SHARDS;
+	_shards.reset(new Shard[SHARDS]);
+	_ttl = ttl;
+	_ttlNs = (int64_t)(ttl * 1e9);
+}
+
+size_t XattrCacheTable::index(const std::string& path) const
+{
+	return std::hash<std::string>()(path) % SHARDS;
+}
+
+uint64_t XattrCacheTable::getStamp(const std::string& path) const
+{
+	Shard& s(_shards[index(path)]);
+	std::lock_guard<std::mutex> lock(s.mutex);
+	return s.invalidations;
+}
+
+void XattrCacheTable::getStamps(Stamps& stamps) const
+{
+	for (size_t i = 0; i < SHARDS; ++i)
+	{
+		std::lock_guard<std::mutex> lock(_shards[i].mutex);
+		stamps.shards[i] = _shards[i].invalidations;
+	}
+}
+
+XattrCacheTable::Entry* XattrCacheTable::update(Shard& shard, const std::string& path, uint64_t stamp)
+{
+	if (shard.invalidations != stamp)
+		return NULL;
+	int64_t t = now();
+	EntryMap::iterator it = shard.entries.find(path);
+	if (it == shard.entries.end())
+	{
+		if (shard.entries.size() >= _shardCapacity)
+			shard.entries.erase(shard.entries.begin());
+		it = shard.entries.insert(std::make_pair(path, Entry())).first;
+	}
+	else if (it->second.expires >= t)
+	{
+		// What is added later does not extend the life of what is known
+		return &it->second;
+	}
+	else
+	{
+		it->second = Entry();
+	}
+	it->second.expires = t + _ttlNs;
+	return &it->second;
+}
+
+bool XattrCacheTable::get(const std::string& path, const std::string& name, std::string& value, int& res) const
+{
+	if (_ttlNs <= 0)
+		return false;
+
+	Shard& s(_shards[index(path)]);
+	std::lock_guard<std::mutex> lock(s.mutex);
+	EntryMap::const_iterator it = s.entries.find(path);
+	if (it == s.entries.end() || it->second.expires < now())
+		return false;
+
+	const Entry& entry(it->second);
+	for (FS_listxattr::Xattrs::const_iterator v = entry.values.begin(); v != entry.values.end(); ++v)
+	{
+		if (v->first == name)
+		{
+			value = v->second;
+			res = 0;
+			return true;
+		}
+	}
+	if (contains(entry.missing, name) || (entry.complete && !contains(entry.names, name)))
+	{
+		res = -ENODATA;
+		return true;
+	}
+	return false;
+}
+
+bool XattrCacheTable::list(const std::string& path, std::vector<std::string>& names) const
+{
+	if (_ttlNs <= 0)
+		return false;
+
+	Shard& s(_shards[index(path)]);
+	std::lock_guard<std::mutex> lock(s.mutex);
+	EntryMap::const_iterator it = s.entries.find(path);
+	if (it == s.entries.end() || !it->second.complete || it->second.expires < now())
+		return false;
+	names = it->second.names;
+	return true;
+}
+
+void XattrCacheTable::putValue(const std::string& path, const std::string& name, const std::string& value, uint64_t stamp)
+{
+	if (_ttlNs <= 0)
+		return;
+
+	Shard& s(_shards[index(path)]);
+	std::lock_guard<std::mutex> lock(s.mutex);
+	Entry* e = update(s, path, stamp);
+	if (!e)
+		return;
+	Entry& entry(*e);
+	erase(entry.missing, name);
+	if (entry.complete && !contains(entry.names, name))
+		entry.names.push_back(name);
+	for (FS_listxattr::Xattrs::iterator v = entry.values.begin(); v != entry.values.end(); ++v)
+	{
+		if (v->first == name)
+		{
+			v->second = value;
+			return;
+		}
+	}
+	entry.values.push_back(std::make_pair(name, value));
+}
+
+void XattrCacheTable::putMissing(const std::string& path, const std::string& name, uint64_t stamp)
+{
+	if (_ttlNs <= 0)
+		return;
+
+	Shard& s(_shards[index(path)]);
+	std::lock_guard<std::mutex> lock(s.mutex);
+	Entry* e = update(s, path, stamp);
+	if (!e)
+		return;
+	Entry& entry(*e);
+	for (FS_listxattr::Xattrs::iterator v = entry.values.begin(); v != entry.values.end(); ++v)
+	{
+		if (v->first == name)
+		{
+			entry.values.erase(v);
+			break;
+		}
+	}
+	if (entry.complete)
+		erase(entry.names, name);
+	else if (!contains(entry.missing, name))
+		entry.missing.push_back(name);
+}
+
+void XattrCacheTable::putList(const std::string& path, const std::vector<std::string>& names, uint64_t stamp)
+{
+	if (_ttlNs <= 0)
+		return;
+
+	Shard& s(_shards[index(path)]);
+	std::lock_guard<std::mutex> lock(s.mutex);
+	Entry* e = update(s, path, stamp);
+	if (!e)
+		return;
+	Entry& entry(*e);
+	entry.complete = true;
+	entry.names = names;
+	// Missing names are now those not listed
+	entry.missing.clear();
+	FS_listxattr::Xattrs::iterator v = entry.values.begin();
+	while (v != entry.values.end())
+	{
+		if (contains(names, v->first))
+			++v;
+		else
+			v = entry.values.erase(v);
+	}
+}
+
+void XattrCacheTable::putAll(const std::string& path, const FS_listxattr::Xattrs& xattrs, const Stamps& stamps)
+{
+	if (_ttlNs <= 0)
+		return;
+
+	size_t i = index(path);
+	Shard& s(_shards[i]);
+	std::lock_guard<std::mutex> lock(s.mutex);
+	Entry* e = update(s, path, stamps.shards[i]);
+	if (!e)
+		return;
+	Entry& entry(*e);
+	entry.complete = true;
+	entry.names.clear();
+	for (FS_listxattr::Xattrs::const_iterator v = xattrs.begin(); v != xattrs.end(); ++v)
+		entry.names.push_back(v->first);
+	entry.values = xattrs;
+	entry.missing.clear();
+	// A complete picture: it lives for a full time-to-live
+	entry.expires = now() + _ttlNs;
+}
+
+void XattrCacheTable::invalidate(const std::string& path)
+{
+	Shard& s(_shards[index(path)]);
+	std::lock_guard<std::mutex> lock(s.mutex);
+	++s.invalidations;
+	s.entries.erase(path);
+}
+
+void XattrCacheTable::clear()
+{
+	for (size_t i = 0; i < SHARDS; ++i)
+	{
+		std::lock_guard<std::mutex> lock(_shards[i].mutex);
+		++_shards[i].invalidations;
+		_shards[i].entries.clear();
+	}
+}
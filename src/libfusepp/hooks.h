@@ -22,14 +22,399 @@ along with fusepp.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 
-#include <fusepp/FileSystem.h>
+// Internal header shared by the translation units that talk to libfuse.
+// It is not installed: clients only ever see the fusepp headers.
+
+#ifndef _FUSEPP_IMPL_HOOKS_H
+#define _FUSEPP_IMPL_HOOKS_H
+
+#define FUSE_USE_VERSION 29
 #include <fuse.h>
-using namespace fusepp;
+#include <fuse_lowlevel.h>
+#include <assert.h>
+#include <string.h>
+#include <fusepp/Log.h>
+#include <algorithm>
+#include <fusepp/Application.h>
+#include <fusepp/Error.h>
+#include <fusepp/Stats.h>
+#include <fusepp/HandleTable.h>
+#include <fusepp/Arena.h>
+#include <fusepp/Snapshot.h>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <vector>
 
-FileSystem::FileSystem()
+namespace fusepp_impl
 {
-}
 
-FileSystem::~FileSystem()
-{
-}
+// Operations are resolved once when the Application is created (see
+// fusepp::Operations); hooks only go through the bound table.
+#define GET_FS_OPS() \
+	assert(fusepp::Application::_s_instance); \
+	const fusepp::Operations& ops = fusepp::Application::_s_instance->_ops
+
+#define CALL_FS_IMPL_BEGIN() \
+	try {
+
+#define CALL_FS_IMPL_END(errval) \
+	} catch (fusepp::Error& err) { \
+		FUSEPP_LOG_ERROR("Unhandled fusepp::Error: %s", err.getReason().c_str()); \
+	} catch (std::exception& err) { \
+		FUSEPP_LOG_ERROR("Unhandled std::exception: %s", err.what()); \
+	} catch (...) { \
+		FUSEPP_LOG_ERROR("Unhandled (unknown) exception!"); \
+	} \
+	return errval
+
+#define CALL_FS_IMPL(op, errval, ...) \
+	GET_FS_OPS(); \
+	assert(ops.op); \
+	fusepp_impl::OpTimer timer(fusepp_impl::stats_op::op); \
+	CALL_FS_IMPL_BEGIN() \
+		return timer.done(ops.op(ops.target, __VA_ARGS__)); \
+	CALL_FS_IMPL_END(errval)
+
+// Asynchronous operations answer through 'reply' (a fusepp::Request). If the
+// implementation throws, the request fails with EIO.
+#define CALL_FS_ASYNC(op, reply, ...) \
+	GET_FS_OPS(); \
+	assert(ops.op); \
+	CALL_FS_IMPL_BEGIN() \
+		ops.op(ops.target, __VA_ARGS__, reply); \
+		return; \
+	CALL_FS_IMPL_END(reply.fail(EIO))
+
+	// Operation counted by fusepp::Stats for each slot of fusepp::Operations
+	namespace stats_op
+	{
+		const fusepp::Stats::Operation getattr = fusepp::Stats::GETATTR;
+		const fusepp::Stats::Operation inode_getattr = fusepp::Stats::GETATTR;
+		const fusepp::Stats::Operation readdir = fusepp::Stats::READDIR;
+		const fusepp::Stats::Operation inode_readdir = fusepp::Stats::READDIR;
+		const fusepp::Stats::Operation lookup = fusepp::Stats::LOOKUP;
+		const fusepp::Stats::Operation open = fusepp::Stats::OPEN;
+		const fusepp::Stats::Operation release = fusepp::Stats::RELEASE;
+		const fusepp::Stats::Operation read = fusepp::Stats::READ;
+		const fusepp::Stats::Operation write = fusepp::Stats::WRITE;
+		const fusepp::Stats::Operation flush = fusepp::Stats::FLUSH;
+		const fusepp::Stats::Operation fsync = fusepp::Stats::FSYNC;
+		const fusepp::Stats::Operation getxattr = fusepp::Stats::GETXATTR;
+		const fusepp::Stats::Operation listxattr = fusepp::Stats::LISTXATTR;
+		const fusepp::Stats::Operation setxattr = fusepp::Stats::SETXATTR;
+		const fusepp::Stats::Operation removexattr = fusepp::Stats::REMOVEXATTR;
+	};
+
+	// Records the duration of a call into the file system, as an error
+	// unless done() is given a non-negative result
+	class OpTimer
+	{
+	public:
+		inline OpTimer(fusepp::Stats::Operation op)
+			: _op(op), _error(true), _start(fusepp::Stats::isEnabled() ? now() : 0)
+		{}
+		inline ~OpTimer()
+		{
+			if (_start)
+				fusepp::Stats::record(_op, now() - _start, _error);
+		}
+		inline int done(int res)
+		{
+			_error = res < 0;
+			return res;
+		}
+		static inline uint64_t now()
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+	private:
+		fusepp::Stats::Operation _op;
+		bool _error;
+		uint64_t _start;
+	};
+
+	// The statistics file (fusepp::Stats::STATS_PATH) and its directory,
+	// served by the hooks themselves. In low-level mode they are known by the
+	// inode numbers they got when the kernel looked them up.
+	class StatsFile
+	{
+	public:
+		enum Kind
+		{
+			NONE,
+			DIRECTORY,
+			FILE,
+		};
+
+		static inline Kind match(const char* path)
+		{
+			// Cheap rejection of everything but "/.*"
+			if (!fusepp::Stats::isEnabled() || path[0] != '/' || path[1] != '.')
+				return NONE;
+			return matchPath(path);
+		}
+		static Kind matchPath(const char* path);
+		static Kind matchEntry(ino_t parent, const char* name);
+		static Kind matchInode(ino_t ino);
+		static void setInode(Kind kind, ino_t ino);
+		static void forget(ino_t ino);
+
+		static void getAttr(Kind kind, struct stat* buf);
+		static void fill(fusepp::FS_readdir::DirectoryFiller& filler);
+		// The statistics are taken when the file is opened, and kept in the
+		// file handle until it is released
+		static int open(struct fuse_file_info* fi);
+		static int read(struct fuse_file_info* fi, fusepp::ReadBuffer& buf, off_t offset);
+		static void release(struct fuse_file_info* fi);
+	};
+
+	// What the hooks keep about a file while writes are coalesced or reads
+	// are anticipated (see Application::setWriteCoalescing and setReadAhead).
+	// Its handle in a HandleTable takes the place of the handle set by the
+	// file system in fuse_file_info::fh, and the file system is given its
+	// own handle back through FileHandle.
+	class OpenFile
+	{
+	public:
+		static inline bool isEnabled()
+		{
+			const fusepp::Application* app = fusepp::Application::_s_instance;
+			return (app->_writeCoalescingSize > 0 && app->_ops.write)
+				|| (app->_readAheadWindow > 0 && app->_ops.read);
+		}
+
+		// Replaces fi->fh with an OpenFile holding it, when enabled
+		static void attach(struct fuse_file_info* fi);
+		// Puts the handle of the file system back in fi->fh and destroys
+		// the OpenFile, if any. What is pending is written to 'path' first,
+		// or dropped if 'path' is NULL.
+		static void detach(struct fuse_file_info* fi, const std::string* path);
+		static inline OpenFile* get(const struct fuse_file_info* fi)
+		{
+			return isEnabled() ? _s_files->get(fi->fh) : NULL;
+		}
+
+		OpenFile(uint64_t handle);
+		// Waits for the prefetch and the timed write in progress, if any
+		~OpenFile();
+
+		inline uint64_t getHandle() const { return _handle; }
+
+		// Appends to the pending data when the write continues it, writes
+		// the pending data (and this write, if it is too large) otherwise.
+		// Returns the number of bytes taken or a negative errno.
+		int write(const std::string& path, fusepp::WriteBuffer& buf, off_t offset, fusepp::FileInfo& info);
+
+		// Writes the pending data. Returns 0, or the error of a write that
+		// was not reported yet.
+		int drain(const std::string& path, fusepp::FileInfo& info);
+		// Same, but keeps the error for the next write, flush or fsync
+		void drainQuietly(const std::string& path, fusepp::FileInfo& info);
+		// Writes the pending data if its window is over, or anyway when
+		// 'force' is set, as drainQuietly() does (see Flusher)
+		void flushExpired(bool force);
+
+		// Serves the read from prefetched data when possible, and reads
+		// ahead when the handle is read sequentially (see ReadAhead.cpp)
+		int read(const std::string& path, fusepp::ReadBuffer& buf, off_t offset, fusepp::FileInfo& info);
+
+		static int writeThrough(const std::string& path, fusepp::WriteBuffer& buf, off_t offset, fusepp::FileInfo& info);
+		static int readThrough(const std::string& path, fusepp::ReadBuffer& buf, off_t offset, fusepp::FileInfo& info);
+
+	private:
+		// Prefetched data, in order of offset and without gaps
+		struct Chunk
+		{
+			off_t offset;
+			std::shared_ptr<std::vector<char> > data;
+			// The file ends with the chunk
+			bool last;
+			inline off_t end() const { return offset + (off_t)data->size(); }
+		};
+
+		static fusepp::HandleTable<OpenFile>* const _s_files;
+
+		int writePending(const std::string& path, fusepp::FileInfo& info);
+		int takeError();
+
+		bool serve(fusepp::ReadBuffer& buf, off_t offset, size_t size);
+		void dropChunks();
+		void schedule(const std::string& path, const struct fuse_file_info& fi, off_t position);
+		void prefetch(const std::string& path, struct fuse_file_info fi, off_t offset, size_t size, uint32_t generation);
+
+		uint64_t _handle;
+		std::mutex _mutex;
+
+		std::vector<char> _pending;
+		off_t _offset;
+		uint64_t _started;
+		int _error;
+		// Where the pending data goes when written after its window
+		std::string _pendingPath;
+		struct fuse_file_info _pendingInfo;
+
+		std::deque<Chunk> _chunks;
+		off_t _readEnd;
+		size_t _window;
+		// Changes whenever the prefetched data is dropped, so that a prefetch
+		// in progress at that time is dropped as well
+		uint32_t _generation;
+		bool _prefetching;
+		off_t _prefetchOffset, _prefetchEnd;
+		std::condition_variable _prefetched;
+	};
+
+	// The file information handed to the file system: the one libfuse gave,
+	// with the handle of the file system in place of the OpenFile
+	class FileHandle
+	{
+	public:
+		inline FileHandle(struct fuse_file_info* fi)
+			: _fi(*fi), _file(OpenFile::get(fi)), _info(&_fi)
+		{
+			if (_file)
+				_fi.fh = _file->getHandle();
+		}
+		inline OpenFile* getOpenFile() const { return _file; }
+		inline fusepp::FileInfo& getInfo() { return _info; }
+	private:
+		struct fuse_file_info _fi;
+		OpenFile* _file;
+		fusepp::FileInfo _info;
+	};
+
+	// Lets libfuse move file contents between /dev/fuse and the descriptors
+	// handed out by ReadBuffer/WriteBuffer with splice(), when available
+	inline void enableSplice(struct fuse_conn_info* conn)
+	{
+		conn->want |= conn->capable & (FUSE_CAP_SPLICE_READ | FUSE_CAP_SPLICE_WRITE | FUSE_CAP_SPLICE_MOVE);
+	}
+
+	inline size_t bufvecSize(size_t segments)
+	{
+		return sizeof(struct fuse_bufvec) + (std::max((size_t)1, segments) - 1) * sizeof(struct fuse_buf);
+	}
+
+	// Extended attribute lists are sent as NUL-terminated names, back to back
+	inline void joinXattrNames(const std::vector<std::string>& names, std::string& list)
+	{
+		list.clear();
+		for (std::vector<std::string>::const_iterator it = names.begin(); it != names.end(); ++it)
+			list.append(it->c_str(), it->size() + 1);
+	}
+
+	// The kernel first asks for the size of a value or list with 'size' 0,
+	// then for the data. Returns the size, or -ERANGE when 'data' grew since.
+	inline int copyXattr(const std::string& data, char* buf, size_t size)
+	{
+		if (size == 0)
+			return (int)data.size();
+		if (data.size() > size)
+			return -ERANGE;
+		memcpy(buf, data.data(), data.size());
+		return (int)data.size();
+	}
+
+	// Fixed pool of threads serving a session, used in place of the libfuse
+	// loops when the Application has a worker count
+	class Workers
+	{
+	public:
+		// Returns when the session exits: 0 on success, -1 on error
+		static int run(struct fuse_session* se, unsigned int count);
+
+		static fusepp::WorkerContext* createContext();
+		// Destroys the context of the calling thread, if any
+		static void destroyContext();
+	};
+
+	// Runs the prefetches of the open files (see Application::setReadAhead)
+	// on threads of its own, which have a worker context like the workers.
+	// Runs between start() and stop(), around the workers; stop() waits for
+	// the prefetches already submitted.
+	class Prefetcher
+	{
+	public:
+		static void start(unsigned int threads);
+		static void stop();
+
+		// Returns false when not running
+		static bool submit(const std::function<void()>& task);
+	};
+
+	// Writes the data held back by the open files once their window is over
+	// (see Application::setWriteCoalescing), from a thread of its own which
+	// has a worker context like the workers. Runs between start() and stop(),
+	// around the workers; stop() writes whatever is still pending.
+	class Flusher
+	{
+	public:
+		static void start();
+		static void stop();
+
+		// Has 'file' write its pending data at 'deadline' (see OpTimer::now()),
+		// in place of the deadline it had, if any. Does nothing when not
+		// running: the data then waits for the next call on the handle.
+		static void schedule(OpenFile* file, uint64_t deadline);
+		// Once it returns, 'file' is not used by the thread anymore
+		static void cancel(OpenFile* file);
+	};
+
+	// Loads the snapshot of the Application (see Application::setSnapshot)
+	// when the file system is mounted, saves it periodically from a thread
+	// of its own and once more when it is unmounted
+	class Snapshots
+	{
+	public:
+		static void start();
+		static void stop();
+
+		static inline fusepp::NamespaceSnapshot* get()
+		{
+			return fusepp::Application::_s_instance->_snapshot.get();
+		}
+
+		// The attributes of 'path' from the snapshot, the first time only
+		static inline bool take(const std::string& path, struct stat* buf)
+		{
+			fusepp::NamespaceSnapshot* snapshot = get();
+			return snapshot && snapshot->take(path, *buf);
+		}
+
+		// Keeps the result of a getattr() or lookup of 'path' for the next save
+		static inline void record(const std::string& path, int res, const struct stat& buf)
+		{
+			fusepp::NamespaceSnapshot* snapshot = get();
+			if (!snapshot)
+				return;
+			if (res == 0)
+				snapshot->record(path, buf);
+			else if (res == -ENOENT)
+				snapshot->forget(path);
+		}
+	};
+
+	// Sends the invalidations requested through Application::invalidateInode
+	// and invalidateEntry to the kernel from a thread of its own, so that
+	// they can be requested while serving a request. Pending invalidations
+	// of the same inode or entry are merged, and at most 'rate' are sent
+	// per second. Runs between start() and stop(), around a low-level
+	// session.
+	class Notifier
+	{
+	public:
+		static void start(struct fuse_chan* ch, unsigned int rate);
+		static void stop();
+
+		// Return false when not running
+		static bool inode(ino_t ino, off_t offset, off_t length);
+		static bool entry(ino_t parent, const std::string& name);
+	};
+
+};
+
+#endif //_FUSEPP_IMPL_HOOKS_H
@@ -32,51 +32,89 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <fusepp/Application.h>
+#include <fusepp/NamespaceIndex.h>
+#include <fusepp/HandleTable.h>
 #include <unistd.h>
 #include <sys/types.h>
-#include <iostream>
+#include <fusepp/Log.h>
+#include <string.h>
 
 
-class MinimalFileSystem : public fusepp::FS_getattr, public fusepp::FS_readdir
+class MinimalFileSystem : public fusepp::FS_getattr, public fusepp::FS_readdir,
+	public fusepp::FS_open, public fusepp::FS_read
 {
 public:
+	MinimalFileSystem()
+		: _foo(std::make_shared<const std::string>("Hello from fusepp!\n"))
+	{
+		struct stat attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.st_uid = getuid();
+		attr.st_gid = getgid();
+		attr.st_mode = S_IFDIR | 0755;
+		_index.insert("/", attr);
+		_index.insert("/bar", attr);
+		attr.st_mode = S_IFREG | 0644;
+		attr.st_size = _foo->size();
+		_index.insert("/foo", attr);
+	}
+
 	int getattr(const std::string& path, struct stat* buf)
 	{
-		std::cout << "getattr(" << path << ")" << std::endl;
-		if (path == "/" || path == "/bar")
-		{
-			buf->st_mode = S_IFDIR | 0755;
-			buf->st_uid = getuid();
-			buf->st_gid = getgid();
-			return 0;
-		}
-		else if (path == "/foo")
-		{
-			buf->st_mode = S_IFREG | 0644;
-			buf->st_uid = getuid();
-			buf->st_gid = getgid();
-			return 0;
-		}
-		return -ENOENT;
+		FUSEPP_LOG_DEBUG("getattr(%s)", path.c_str());
+		return _index.getattr(path, buf);
 	}
 
 	int readdir(const std::string& path, DirectoryFiller& filler)
 	{
-		std::cout << "readdir(" << path << ")" << std::endl;
-		if (path == "/")
-		{
-			filler.add("foo");
-			filler.add("bar");
-		}
+		FUSEPP_LOG_DEBUG("readdir(%s)", path.c_str());
+		return _index.readdir(path, filler);
+	}
+
+	int open(const std::string& path, fusepp::FileInfo& fi)
+	{
+		if (path != "/foo")
+			return -ENOENT;
+		// The file keeps reading the content it was opened with
+		OpenFoo foo = { _foo };
+		fi.setHandle(_files.create(foo));
 		return 0;
 	}
+
+	int read(const std::string& path, fusepp::ReadBuffer& buf, off_t offset, fusepp::FileInfo& fi)
+	{
+		OpenFoo* foo = _files.get(fi.getHandle());
+		if (!foo)
+			return -EBADF;
+		if ((size_t)offset < foo->content->size())
+			buf.reference(foo->content->data() + offset, foo->content->size() - offset, foo->content);
+		return 0;
+	}
+
+	int release(const std::string& path, fusepp::FileInfo& fi)
+	{
+		_files.destroy(fi.getHandle());
+		return 0;
+	}
+
+private:
+	struct OpenFoo
+	{
+		std::shared_ptr<const std::string> content;
+	};
+
+	fusepp::NamespaceIndex _index;
+	std::shared_ptr<const std::string> _foo;
+	fusepp::HandleTable<OpenFoo> _files;
 };
 
 
 int main(int argc, char* argv[])
 {
-	fusepp::FileSystemPtr fs(new MinimalFileSystem());
-	fusepp::ApplicationPtr app(new fusepp::Application(fs));
+	std::shared_ptr<MinimalFileSystem> fs(new MinimalFileSystem());
+	fusepp::ApplicationPtr app(new fusepp::StaticApplication<MinimalFileSystem>(fs));
+	// cat <mountpoint>/.fusepp/stats
+	app->setStatsEnabled(true);
 	
 	return app->run(argc, argv);
 }
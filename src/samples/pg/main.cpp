@@ -32,16 +32,26 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <fusepp/Application.h>
+#include <fusepp/AttrCache.h>
+#include <fusepp/NegativeCache.h>
+#include <fusepp/SingleFlight.h>
+#include <fusepp/Stack.h>
+#include <fusepp/Trace.h>
+#include <fusepp/Worker.h>
+#include <fusepp/XattrCache.h>
+#include <fusepp/Log.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <iostream>
-#include <pthread.h>
+#include <sstream>
 #include <fusepp/Error.h>
 #include <assert.h>
+#include <string.h>
 #include <fusepp/pg/Database.h>
 #include <fusepp/pg/Query.h>
 
-struct TLSData
+// Each worker has its own connection to the database
+struct PostgresContext : public fusepp::WorkerContext
 {
 	fusepp::DatabasePtr db;
 };
@@ -63,71 +73,40 @@ std::ostream& operator<<(std::ostream& stream, const struct stat& buf)
 		return stream;
 }
 
-class PostgresFileSystem : public fusepp::FS_getattr, public fusepp::FS_readdir
+class PostgresFileSystem : public fusepp::FS_getattr, public fusepp::FS_readdir, public fusepp::FS_getxattr,
+	public fusepp::FS_listxattr, public fusepp::FS_worker
 {
 public:
 
 	PostgresFileSystem(const std::string& dbname, const std::string& host, const std::string& port, const std::string& username, const std::string& password)
 		: _dbname(dbname), _host(host), _port(port), _username(username), _password(password)
 	{
-
-		if (pthread_key_create(&_tls, tls_destroy) != 0)
-			throw fusepp::Error("pthread_key_create() failed with error %d", errno);
 	}
 
-	~PostgresFileSystem()
+	fusepp::WorkerContext* createWorkerContext()
 	{
-		if (pthread_key_delete(_tls) != 0)
-			throw fusepp::Error("pthread_key_delete() failed with error %d", errno);
-	}
-
-	static void tls_destroy(void* value)
-	{
-		do_tls_destroy(value, false);
-	}
-
-	static void do_tls_destroy(void* value, bool explicit_call)
-	{
-		assert(value);
-		TLSData* data = static_cast<TLSData*>(value);
-		delete data;
+		std::unique_ptr<PostgresContext> context(new PostgresContext);
+		context->db.reset(new fusepp::Database());
+		if (!context->db->connect(_host, _port, _dbname, _username, _password))
+			throw fusepp::Error("Database connection failed");
+		return context.release();
 	}
 
 private:
-	pthread_key_t _tls;
+	static const unsigned int READDIR_BATCH = 1024;
+	static const char* const TYPE_XATTR;
 	std::string _dbname, _host, _port, _username, _password;
 
-	TLSData* get_tls_data()
-	{
-		TLSData* data = NULL;
-		void* ptr = pthread_getspecific(_tls);
-		if (!ptr)
-		{
-			data = new TLSData;
-			pthread_setspecific(_tls, data);
-		}
-		else
-		{
-			data = static_cast<TLSData*>(ptr);
-		}
-		if (!data->db)
-		{
-			data->db.reset(new fusepp::Database());
-			if (!data->db->connect(_host, _port, _dbname, _username, _password))
-			{
-				data->db.reset();
-				throw fusepp::Error("Database connection failed");
-			}
-		}
-		return data;
-	}
-
 public:
 	int getattr(const std::string& path, struct stat* buf)
 	{
-		TLSData* data = get_tls_data();
-		if (path == "/print.jpg")
-			std::cout << "stat of '" << path << "' before: " << *buf << std::endl;
+		PostgresContext& context = fusepp::getWorkerContext<PostgresContext>();
+		if (path == "/print.jpg" && fusepp::Log::isEnabled(fusepp::Log::LEVEL_DEBUG))
+		{
+			std::ostringstream ss;
+			ss << *buf;
+			FUSEPP_LOG_DEBUG("stat of '%s' before: %s", path.c_str(), ss.str().c_str());
+		}
 		if (path == "/")
 		{
 			buf->st_mode = S_IFDIR | 0755;
@@ -137,7 +116,7 @@ public:
 		}
 		//else
 		//{
-		//	fusepp::Query q(data->db, fusepp::Query::ONLY_ONE_ROW);
+		//	fusepp::Query q(context.db, fusepp::Query::ONLY_ONE_ROW);
 		//	q << "select * from imagev where dfsa;";
 		//	q.execute(true);
 
@@ -147,26 +126,109 @@ public:
 
 	int readdir(const std::string& path, DirectoryFiller& filler)
 	{
-		TLSData* data = get_tls_data();
-		fusepp::Query q(data->db);
-		q << "select * from imagev where typeid <> (select id from imagetype where short = 'THUMBNAIL') order by name asc;";
-		q.execute(true);
-		for (unsigned int i = 0; i < q.getRowsCount(); ++i)
+		// The listing is streamed: the cookie of an entry is its rank, so
+		// that a call resumes where the previous one stopped
+		off_t offset = filler.getOffset();
+		fusepp::Query q(fusepp::getWorkerContext<PostgresContext>().db);
+		q << "select * from imagev where typeid <> (select id from imagetype where short = 'THUMBNAIL') order by name asc"
+			<< " offset " << offset << " limit " << READDIR_BATCH << ";";
+		// A failed listing is an expected errno, not an exception
+		fusepp::Result<unsigned int> rows = q.tryExecute();
+		if (!rows)
+			return rows.toStatus();
+		// Passing the attributes along saves a query per entry when the
+		// kernel looks the entries up right after listing them
+		struct stat attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.st_mode = S_IFREG | 0444;
+		attr.st_nlink = 1;
+		attr.st_uid = getuid();
+		attr.st_gid = getgid();
+		// The names go through one string of the request's arena rather than
+		// a std::string per entry
+		fusepp::ArenaScope arena;
+		std::string& name = arena.getArena().string();
+		int idColumn = q.getColumnIndex("id"), nameColumn = q.getColumnIndex("name");
+		for (unsigned int i = 0; i < *rows; ++i)
 		{
-			filler.add(q.at(i, "name"), q.ati(i, "id"));
+			attr.st_ino = q.ati(i, idColumn);
+			name.assign(q.atc(i, nameColumn));
+			if (!filler.add(name, attr, offset + i + 1))
+				break;
+		}
+		return 0;
+	}
+
+	// The type of an image is exposed as an extended attribute
+	int getxattr(const std::string& path, const std::string& name, std::string& value)
+	{
+		if (name != TYPE_XATTR || path == "/")
+			return -ENODATA;
+		fusepp::Query q(fusepp::getWorkerContext<PostgresContext>().db, fusepp::Query::ONLY_ONE_ROW);
+		q << "select t.short from imagev i join imagetype t on t.id = i.typeid where i.name = '";
+		// Quotes are doubled in SQL string literals
+		for (std::string::const_iterator it = path.begin() + 1; it != path.end(); ++it)
+		{
+			if (*it == '\'')
+				q << '\'';
+			q << *it;
+		}
+		q << "';";
+		fusepp::Result<unsigned int> rows = q.tryExecute();
+		if (!rows)
+			return rows.toStatus();
+		value.assign(q.atc(0, 0));
+		return 0;
+	}
+
+	int listxattr(const std::string& path, std::vector<std::string>& names)
+	{
+		if (path != "/")
+			names.push_back(TYPE_XATTR);
+		return 0;
+	}
+
+	// Called by XattrCache when the directory is listed: the types of the
+	// first entries come with a single query
+	int listxattrs(const std::string& path, XattrFiller& filler)
+	{
+		fusepp::Query q(fusepp::getWorkerContext<PostgresContext>().db);
+		q << "select i.name, t.short from imagev i join imagetype t on t.id = i.typeid"
+			<< " where t.short <> 'THUMBNAIL' order by i.name asc limit " << READDIR_BATCH << ";";
+		fusepp::Result<unsigned int> rows = q.tryExecute();
+		if (!rows)
+			return rows.toStatus();
+		Xattrs xattrs(1, std::make_pair(std::string(TYPE_XATTR), std::string()));
+		for (unsigned int i = 0; i < *rows; ++i)
+		{
+			xattrs[0].second.assign(q.atc(i, 1));
+			filler.add(q.atc(i, 0), xattrs);
 		}
 		return 0;
 	}
 	
 };
 
+const char* const PostgresFileSystem::TYPE_XATTR = "user.type";
+
 
 int main(int argc, char* argv[])
 {
 	char buffer[256];
-	std::cout << "current directory=" << getcwd(buffer, 256) << std::endl;
-	fusepp::FileSystemPtr fs(new PostgresFileSystem("pianos", "127.0.0.1", "5432", "tibo", ""));
-	fusepp::ApplicationPtr app(new fusepp::Application(fs));
+	FUSEPP_LOG_INFO("current directory=%s", getcwd(buffer, 256));
+	// Shells and runtimes probe many names that do not exist here: they are
+	// answered without a query, and concurrent listings of the same directory
+	// share one. File managers ask for the extended attributes of every
+	// file they show: those are prefetched when the directory is listed.
+	// The layers are bound at compile time.
+	typedef fusepp::Stack<PostgresFileSystem, fusepp::Trace, fusepp::XattrCache, fusepp::NegativeCache,
+		fusepp::AttrCache, fusepp::SingleFlight> LayeredFileSystem;
+	std::shared_ptr<LayeredFileSystem> fs(std::make_shared<LayeredFileSystem>("pianos", "127.0.0.1", "5432", "tibo", ""));
+	fusepp::ApplicationPtr app(new fusepp::StaticApplication<LayeredFileSystem>(fs));
+	app->setWorkerCount(8);
+	app->setNegativeTimeout(1.0);
+	// After a restart, the attributes known before answer the first calls
+	app->setSnapshot("pianos.snapshot");
 	
 	return app->run(argc, argv);
 }
@@ -0,0 +1,162 @@
+/*
+Copyright (c) 2014, University of Lausanne, Switzerland 
+All rights reserved. 
+
+Redistribution and use in source and binary forms, with or without 
+modification, are permitted provided that the following conditions are 
+met: 
+
+1. Redistributions of source code must retain the above copyright 
+notice, this list of conditions and the following disclaimer. 
+
+2. Redistributions in binary form must reproduce the above copyright 
+notice, this list of conditions and the following disclaimer in the 
+documentation and/or other materials provided with the distribution. 
+
+3. Neither the name of the copyright holder nor the names of its 
+contributors may be used to endorse or promote products derived from 
+this software without specific prior written permission. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS 
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED 
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A 
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED 
+TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+
+// Arena hands out aligned memory and serves the next request from the same
+// blocks once it is reset.
+
+#include <fusepp/Arena.h>
+#include "check.h"
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+using namespace fusepp;
+
+namespace
+{
+
+bool isAligned(const void* p, size_t align)
+{
+	return (reinterpret_cast<uintptr_t>(p) & (align - 1)) == 0;
+}
+
+void testAlignment()
+{
+	Arena arena;
+	const size_t aligns[] = { 1, 2, 8, 16, 64, alignof(std::max_align_t) };
+	for (size_t i = 0; i < 1000; ++i)
+	{
+		size_t align = aligns[i % (sizeof(aligns) / sizeof(aligns[0]))];
+		// Odd sizes misalign the next allocation unless it is padded
+		void* p = arena.allocate(i % 7 + 1, align);
+		CHECK(isAligned(p, align));
+		memset(p, 0xff, i % 7 + 1);
+	}
+	CHECK(isAligned(arena.allocate(1), alignof(std::max_align_t)));
+}
+
+void testReuse()
+{
+	Arena arena;
+	// Several blocks, then one larger than a block
+	std::vector<void*> first;
+	for (int i = 0; i < 10; ++i)
+		first.push_back(arena.allocate(Arena::BLOCK_SIZE / 3));
+	void* large = arena.allocate(4 * Arena::BLOCK_SIZE);
+	CHECK(large);
+	CHECK(arena.getUsed() >= 4 * Arena::BLOCK_SIZE);
+
+	for (int round = 0; round < 3; ++round)
+	{
+		arena.reset();
+		CHECK_EQUAL(0, arena.getUsed());
+		// Same sizes, same addresses: the blocks were kept
+		for (int i = 0; i < 10; ++i)
+			CHECK(arena.allocate(Arena::BLOCK_SIZE / 3) == first[i]);
+	}
+
+	// Only the last allocation is given back
+	arena.reset();
+	void* a = arena.allocate(100, 1);
+	void* b = arena.allocate(100, 1);
+	arena.deallocate(a, 100);
+	CHECK_EQUAL(200, arena.getUsed());
+	arena.deallocate(b, 100);
+	CHECK_EQUAL(100, arena.getUsed());
+	CHECK(arena.allocate(100, 1) == b);
+}
+
+void testStrings()
+{
+	Arena arena;
+	std::string& s = arena.string("a string that does not fit in the small buffer");
+	const void* data = s.data();
+	size_t capacity = s.capacity();
+	CHECK(&arena.string() != &s);
+
+	arena.reset();
+	std::string& again = arena.string();
+	CHECK(&again == &s);
+	CHECK(again.empty());
+	CHECK_EQUAL(capacity, again.capacity());
+	again.assign("short");
+	CHECK(again.data() == data);
+
+	// Large strings are released
+	arena.reset();
+	arena.string().assign(100000, 'x');
+	arena.reset();
+	CHECK(arena.string().capacity() < 100000);
+}
+
+void testScopes()
+{
+	CHECK(Arena::current() == NULL);
+	{
+		ArenaScope outer;
+		CHECK(Arena::current() == &outer.getArena());
+		outer.getArena().allocate(10);
+		{
+			ArenaScope inner;
+			CHECK(&inner.getArena() == &outer.getArena());
+			inner.getArena().allocate(10);
+		}
+		// Only the outermost scope resets
+		CHECK(outer.getArena().getUsed() >= 20);
+
+		ArenaVector<int> v;
+		for (int i = 0; i < 1000; ++i)
+			v.push_back(i);
+		CHECK(v.get_allocator().getArena() == &outer.getArena());
+		CHECK_EQUAL(999, v.back());
+	}
+	CHECK(Arena::current() == NULL);
+	ArenaScope scope;
+	CHECK_EQUAL(0, scope.getArena().getUsed());
+
+	// Without an arena, the allocator uses the heap
+	ArenaVector<int> heap(ArenaAllocator<int>((Arena*)NULL));
+	heap.push_back(1);
+	CHECK(heap.get_allocator().getArena() == NULL);
+}
+
+};
+
+int main(int argc, char** argv)
+{
+	testAlignment();
+	testReuse();
+	testStrings();
+	testScopes();
+	return 0;
+}
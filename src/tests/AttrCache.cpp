@@ -0,0 +1,157 @@
+/*
+Copyright (c) 2014, University of Lausanne, Switzerland 
+All rights reserved. 
+
+Redistribution and use in source and binary forms, with or without 
+modification, are permitted provided that the following conditions are 
+met: 
+
+1. Redistributions of source code must retain the above copyright 
+notice, this list of conditions and the following disclaimer. 
+
+2. Redistributions in binary form must reproduce the above copyright 
+notice, this list of conditions and the following disclaimer in the 
+documentation and/or other materials provided with the distribution. 
+
+3. Neither the name of the copyright holder nor the names of its 
+contributors may be used to endorse or promote products derived from 
+this software without specific prior written permission. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS 
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED 
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A 
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED 
+TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+
+// AttrCache must never keep a value read before an invalidation of its path:
+// a thread changes the attributes of files and invalidates them while others
+// read them through the cache.
+
+#include <fusepp/AttrCache.h>
+#include "check.h"
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace fusepp;
+
+namespace
+{
+
+const int FILES = 4;
+const int THREADS = 4;
+const int UPDATES = 20000;
+
+// The size of every file is its version, bumped before each invalidation
+class VersionFileSystem : public FS_getattr
+{
+public:
+	VersionFileSystem()
+	{
+		for (int i = 0; i < FILES; ++i)
+			versions[i].store(0);
+	}
+
+	int getattr(const std::string& path, struct stat* buf)
+	{
+		memset(buf, 0, sizeof(*buf));
+		buf->st_size = versions[path[1] - '0'].load();
+		// Widen the window between reading and caching the value
+		std::this_thread::yield();
+		return 0;
+	}
+
+	std::atomic<long> versions[FILES];
+};
+
+void testStamps()
+{
+	AttrCacheTable table(64, 60.0);
+	struct stat attr, buf;
+	memset(&attr, 0, sizeof(attr));
+	attr.st_size = 1;
+
+	uint64_t stamp = table.getStamp("/a");
+	table.invalidate("/a");
+	table.put("/a", attr, stamp);
+	CHECK(!table.get("/a", &buf));
+
+	stamp = table.getStamp("/a");
+	table.clear();
+	table.put("/a", attr, stamp);
+	CHECK(!table.get("/a", &buf));
+
+	table.put("/a", attr, table.getStamp("/a"));
+	CHECK(table.get("/a", &buf));
+	CHECK_EQUAL(1, buf.st_size);
+	table.invalidate("/a");
+	CHECK(!table.get("/a", &buf));
+}
+
+void testConcurrentInvalidations()
+{
+	AttrCache<VersionFileSystem> fs;
+	fs.getAttrCache().configure(64, 60.0);
+	std::atomic<long> published[FILES];
+	for (int i = 0; i < FILES; ++i)
+		published[i].store(0);
+	std::atomic<bool> done(false);
+	std::atomic<long> stale(0);
+
+	std::vector<std::thread> readers;
+	for (int t = 0; t < THREADS; ++t)
+		readers.push_back(std::thread([&, t]() {
+			std::string path("/0");
+			for (unsigned k = t; !done.load(); ++k)
+			{
+				int file = k % FILES;
+				path[1] = '0' + file;
+				// Every version invalidated before the call must be seen
+				long expected = published[file].load();
+				struct stat buf;
+				CHECK_EQUAL(0, fs.getattr(path, &buf));
+				if (buf.st_size < expected)
+					stale++;
+			}
+		}));
+
+	std::string path("/0");
+	for (int k = 0; k < UPDATES; ++k)
+	{
+		int file = k % FILES;
+		path[1] = '0' + file;
+		long version = fs.versions[file].fetch_add(1) + 1;
+		fs.invalidate(path);
+		published[file].store(version);
+	}
+	done.store(true);
+	for (size_t i = 0; i < readers.size(); ++i)
+		readers[i].join();
+
+	CHECK_EQUAL(0, stale.load());
+	for (int i = 0; i < FILES; ++i)
+	{
+		path[1] = '0' + i;
+		struct stat buf;
+		CHECK_EQUAL(0, fs.getattr(path, &buf));
+		CHECK_EQUAL(fs.versions[i].load(), buf.st_size);
+	}
+}
+
+};
+
+int main(int argc, char** argv)
+{
+	testStamps();
+	testConcurrentInvalidations();
+	return 0;
+}
@@ -0,0 +1,117 @@
+/*
+Copyright (c) 2014, University of Lausanne, Switzerland 
+All rights reserved. 
+
+Redistribution and use in source and binary forms, with or without 
+modification, are permitted provided that the following conditions are 
+met: 
+
+1. Redistributions of source code must retain the above copyright 
+notice, this list of conditions and the following disclaimer. 
+
+2. Redistributions in binary form must reproduce the above copyright 
+notice, this list of conditions and the following disclaimer in the 
+documentation and/or other materials provided with the distribution. 
+
+3. Neither the name of the copyright holder nor the names of its 
+contributors may be used to endorse or promote products derived from 
+this software without specific prior written permission. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS 
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED 
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A 
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED 
+TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+
+// Handles of a HandleTable: a slot is reused once its object was destroyed,
+// and the handles of the objects it held before are refused.
+
+#include <fusepp/HandleTable.h>
+#include "check.h"
+#include <stdint.h>
+#include <vector>
+using namespace fusepp;
+
+namespace
+{
+
+int g_live = 0;
+
+struct Object
+{
+	Object(int v) : value(v) { ++g_live; }
+	~Object() { --g_live; }
+	int value;
+};
+
+void testReuse()
+{
+	HandleTable<Object> table;
+	uint64_t first = table.create(1);
+	CHECK(first != 0);
+	CHECK_EQUAL(1, table.get(first)->value);
+	CHECK(table.destroy(first));
+	CHECK_EQUAL(0, g_live);
+	CHECK(!table.get(first));
+	CHECK(!table.destroy(first));
+
+	// Same slot, another generation
+	uint64_t second = table.create(2);
+	CHECK_EQUAL((uint32_t)first, (uint32_t)second);
+	CHECK(second != first);
+	CHECK(!table.get(first));
+	CHECK(!table.destroy(first));
+	CHECK_EQUAL(2, table.get(second)->value);
+	CHECK_EQUAL(1, table.getSize());
+	CHECK(table.destroy(second));
+	CHECK_EQUAL(0, table.getSize());
+
+	// Handles that never existed
+	CHECK(!table.get(0));
+	CHECK(!table.get(((uint64_t)1 << 32) | 12345));
+	CHECK(!table.get(~(uint64_t)0));
+}
+
+void testPages()
+{
+	const size_t COUNT = 3 * HandleTable<Object>::PAGE_SIZE + 7;
+	{
+		HandleTable<Object> table;
+		std::vector<uint64_t> handles;
+		for (size_t i = 0; i < COUNT; ++i)
+			handles.push_back(table.create((int)i));
+		for (size_t i = 0; i < COUNT; i += 2)
+			CHECK(table.destroy(handles[i]));
+		CHECK_EQUAL(COUNT / 2, table.getSize());
+
+		// The freed slots are taken again before any new one
+		for (size_t i = 0; i < COUNT; i += 2)
+		{
+			uint64_t handle = table.create(-1);
+			CHECK((uint32_t)handle < COUNT);
+			CHECK(!table.get(handles[i]));
+		}
+		for (size_t i = 1; i < COUNT; i += 2)
+			CHECK_EQUAL((int)i, table.get(handles[i])->value);
+		CHECK_EQUAL(COUNT, g_live);
+	}
+	// The table destroys what is left
+	CHECK_EQUAL(0, g_live);
+}
+
+};
+
+int main(int argc, char** argv)
+{
+	testReuse();
+	testPages();
+	return 0;
+}
@@ -0,0 +1,151 @@
+/*
+Copyright (c) 2014, University of Lausanne, Switzerland 
+All rights reserved. 
+
+Redistribution and use in source and binary forms, with or without 
+modification, are permitted provided that the following conditions are 
+met: 
+
+1. Redistributions of source code must retain the above copyright 
+notice, this list of conditions and the following disclaimer. 
+
+2. Redistributions in binary form must reproduce the above copyright 
+notice, this list of conditions and the following disclaimer in the 
+documentation and/or other materials provided with the distribution. 
+
+3. Neither the name of the copyright holder nor the names of its 
+contributors may be used to endorse or promote products derived from 
+this software without specific prior written permission. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS 
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED 
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A 
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED 
+TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+
+// Threads updating data under the locks of LockManager: every update must
+// be seen, whatever the stripes the paths and ranges fall on.
+
+#include <fusepp/LockManager.h>
+#include "check.h"
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace fusepp;
+
+namespace
+{
+
+const int THREADS = 8;
+const int ROUNDS = 5000;
+
+void testPaths(LockManager& manager)
+{
+	long counters[4] = { 0 };
+	std::vector<std::thread> threads;
+	for (int i = 0; i < THREADS; ++i)
+		threads.push_back(std::thread([&manager, &counters, i]() {
+			for (int k = 0; k < ROUNDS; ++k)
+			{
+				// The guard must not depend on the temporary it was given
+				PathLock lock(manager, "/file" + std::to_string(i % 4));
+				counters[i % 4]++;
+			}
+		}));
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+	for (int i = 0; i < 4; ++i)
+		CHECK_EQUAL(ROUNDS * THREADS / 4, counters[i]);
+}
+
+void testPairs(LockManager& manager)
+{
+	// Opposite orders on both ends of a rename must not deadlock, and the
+	// pair must exclude the single locks
+	const std::string a("/a"), b("/b");
+	long moves = 0;
+	std::vector<std::thread> threads;
+	for (int i = 0; i < THREADS; ++i)
+		threads.push_back(std::thread([&, i]() {
+			for (int k = 0; k < ROUNDS; ++k)
+			{
+				if (i % 2)
+				{
+					manager.lock(a, b);
+					moves++;
+					manager.unlock(a, b);
+				}
+				else
+				{
+					manager.lock(b, a);
+					moves++;
+					manager.unlock(b, a);
+				}
+				PathLock lock(manager, a);
+				moves++;
+			}
+		}));
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+	CHECK_EQUAL(2 * ROUNDS * THREADS, moves);
+
+	// Same path twice: one lock only
+	manager.lock(a, a);
+	manager.unlock(a, a);
+	PathLock lock(manager, a);
+}
+
+void testRanges(LockManager& manager)
+{
+	const std::string path("/data");
+	unsigned char data[1000];
+	memset(data, 0, sizeof(data));
+	std::vector<std::thread> threads;
+	for (int i = 0; i < THREADS; ++i)
+		threads.push_back(std::thread([&]() {
+			for (int k = 0; k < ROUNDS; ++k)
+			{
+				off_t offset = (k % 10) * 100;
+				RangeLock lock(manager, path, offset, 100);
+				for (int j = 0; j < 100; ++j)
+					data[offset + j]++;
+			}
+			for (int k = 0; k < ROUNDS; ++k)
+			{
+				// Whole file, shared: no exclusive range may be held
+				RangeLock lock(manager, path, 0, 0, false);
+				volatile unsigned char c = data[k % 1000];
+				(void)c;
+			}
+		}));
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+	for (int i = 0; i < 1000; ++i)
+		CHECK_EQUAL((ROUNDS / 10 * THREADS) % 256, data[i]);
+}
+
+};
+
+int main(int argc, char** argv)
+{
+	LockManager manager(3);
+	CHECK_EQUAL(4, manager.getStripes());
+	testPaths(manager);
+	testPairs(manager);
+	testRanges(manager);
+
+	LockManager large;
+	CHECK_EQUAL(LockManager::DEFAULT_STRIPES, large.getStripes());
+	testPaths(large);
+	testRanges(large);
+	return 0;
+}
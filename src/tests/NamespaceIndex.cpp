@@ -0,0 +1,275 @@
+/*
+Copyright (c) 2014, University of Lausanne, Switzerland 
+All rights reserved. 
+
+Redistribution and use in source and binary forms, with or without 
+modification, are permitted provided that the following conditions are 
+met: 
+
+1. Redistributions of source code must retain the above copyright 
+notice, this list of conditions and the following disclaimer. 
+
+2. Redistributions in binary form must reproduce the above copyright 
+notice, this list of conditions and the following disclaimer in the 
+documentation and/or other materials provided with the distribution. 
+
+3. Neither the name of the copyright holder nor the names of its 
+contributors may be used to endorse or promote products derived from 
+this software without specific prior written permission. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS 
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED 
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A 
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED 
+TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+
+// NamespaceIndex: paths resolved while another thread inserts, removes and
+// renames entries, and directories listed across several replies while they
+// grow.
+
+#include <fusepp/NamespaceIndex.h>
+#include "check.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace fusepp;
+
+namespace
+{
+
+// Reply of at most 'room' entries, streamed
+class Filler : public FS_readdir::DirectoryFiller
+{
+public:
+	Filler(off_t offset, size_t room)
+		: FS_readdir::DirectoryFiller(offset), last(offset), _room(room)
+	{}
+
+	void add(const std::string& name, ino_t id)
+	{
+		CHECK(!"listings are streamed");
+	}
+	bool add(const std::string& name, ino_t id, off_t cookie)
+	{
+		CHECK(!"listings carry the attributes");
+		return false;
+	}
+	bool add(const std::string& name, const struct stat& attr, off_t cookie, double entryTimeout, double attrTimeout)
+	{
+		CHECK(cookie > last);
+		if (names.size() == _room)
+			return false;
+		names.push_back(name);
+		sizes.push_back(attr.st_size);
+		last = cookie;
+		return true;
+	}
+
+	std::vector<std::string> names;
+	std::vector<off_t> sizes;
+	off_t last;
+
+private:
+	size_t _room;
+};
+
+struct stat makeAttr(mode_t mode, off_t size = 0)
+{
+	struct stat attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.st_mode = mode;
+	attr.st_size = size;
+	return attr;
+}
+
+std::string pathOf(const char* prefix, int i)
+{
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%s%d", prefix, i);
+	return buf;
+}
+
+// Lists 'path' in replies of 'room' entries, calling 'between' after each
+void list(const NamespaceIndex& index, const std::string& path, size_t room, std::vector<std::string>& names,
+	void (*between)(NamespaceIndex&, int) = NULL, NamespaceIndex* changed = NULL)
+{
+	off_t offset = 0;
+	for (int reply = 0; ; ++reply)
+	{
+		Filler filler(offset, room);
+		CHECK_EQUAL(0, index.readdir(path, filler));
+		names.insert(names.end(), filler.names.begin(), filler.names.end());
+		if (filler.names.empty())
+			return;
+		offset = filler.last;
+		if (between)
+			between(*changed, reply);
+	}
+}
+
+void testTree()
+{
+	NamespaceIndex index;
+	struct stat buf;
+	uint64_t data;
+	CHECK_EQUAL(0, index.getattr("/", &buf));
+	CHECK(S_ISDIR(buf.st_mode));
+	CHECK_EQUAL(0, index.insert("/a", makeAttr(S_IFDIR | 0755)));
+	CHECK_EQUAL(0, index.insert("/a/f", makeAttr(S_IFREG | 0644, 5), 42));
+	CHECK_EQUAL(0, index.getattr("/a//f/", &buf, &data));
+	CHECK_EQUAL(5, buf.st_size);
+	CHECK_EQUAL(42, data);
+	CHECK_EQUAL(0, index.lookup("/a", "f", &buf));
+	CHECK_EQUAL(-ENOENT, index.getattr("/a/g", &buf));
+	CHECK_EQUAL(-ENOTDIR, index.getattr("/a/f/x", &buf));
+	CHECK_EQUAL(-ENOTDIR, index.insert("/a/f/x", makeAttr(S_IFREG)));
+	CHECK_EQUAL(-ENOENT, index.insert("/b/x", makeAttr(S_IFREG)));
+	CHECK_EQUAL(-EINVAL, index.insert("relative", makeAttr(S_IFREG)));
+	CHECK_EQUAL(-ENOTEMPTY, index.remove("/a"));
+	CHECK_EQUAL(-ENOTEMPTY, index.insert("/a", makeAttr(S_IFREG)));
+	CHECK_EQUAL(-EINVAL, index.rename("/a", "/a/z"));
+	CHECK_EQUAL(0, index.rename("/a", "/c"));
+	CHECK_EQUAL(0, index.getattr("/c/f", &buf));
+	CHECK_EQUAL(-ENOENT, index.getattr("/a", &buf));
+	CHECK_EQUAL(0, index.insert("/d", makeAttr(S_IFREG)));
+	CHECK_EQUAL(-EEXIST, index.rename("/d", "/c"));
+	CHECK_EQUAL(0, index.rename("/c/f", "/g"));
+	CHECK_EQUAL(0, index.remove("/c"));
+	CHECK_EQUAL(-EBUSY, index.remove("/"));
+	CHECK_EQUAL(2, index.getSize());
+	index.clear();
+	CHECK_EQUAL(0, index.getSize());
+	CHECK_EQUAL(-ENOENT, index.getattr("/g", &buf));
+}
+
+void grow(NamespaceIndex& index, int reply)
+{
+	// Enough new entries to resize the table during the first replies
+	if (reply >= 20)
+		return;
+	for (int i = 0; i < 1000; ++i)
+		index.insert(pathOf("/dir/new-", reply * 1000 + i), makeAttr(S_IFREG));
+}
+
+void testListing()
+{
+	const int FILES = 20000;
+	NamespaceIndex index;
+	Filler missing(0, 1);
+	CHECK_EQUAL(-ENOENT, index.readdir("/dir", missing));
+	CHECK_EQUAL(0, index.insert("/dir", makeAttr(S_IFDIR | 0755)));
+	std::vector<std::string> names;
+	list(index, "/dir", 10, names);
+	CHECK(names.empty());
+
+	for (int i = 0; i < FILES; ++i)
+		CHECK_EQUAL(0, index.insert(pathOf("/dir/file-", i), makeAttr(S_IFREG, i)));
+	for (int i = 0; i < FILES; i += 2)
+		CHECK_EQUAL(0, index.remove(pathOf("/dir/file-", i)));
+
+	// Every entry once, whatever the size of the replies
+	const size_t rooms[] = { 1, 7, 100, FILES };
+	for (size_t r = 0; r < sizeof(rooms) / sizeof(rooms[0]); ++r)
+	{
+		names.clear();
+		list(index, "/dir", rooms[r], names);
+		CHECK_EQUAL(FILES / 2, names.size());
+		std::set<std::string> unique(names.begin(), names.end());
+		CHECK_EQUAL(FILES / 2, unique.size());
+		for (int i = 1; i < FILES; i += 2)
+			CHECK(unique.count(pathOf("file-", i)));
+	}
+
+	// The entries present from start to end are listed once while the
+	// table grows under the listing
+	names.clear();
+	list(index, "/dir", 50, names, grow, &index);
+	std::map<std::string, int> seen;
+	for (size_t i = 0; i < names.size(); ++i)
+		seen[names[i]]++;
+	for (std::map<std::string, int>::iterator it = seen.begin(); it != seen.end(); ++it)
+		CHECK_EQUAL(1, it->second);
+	for (int i = 1; i < FILES; i += 2)
+		CHECK(seen.count(pathOf("file-", i)));
+}
+
+void testConcurrentChanges()
+{
+	const int STABLE = 1000;
+	NamespaceIndex index;
+	CHECK_EQUAL(0, index.insert("/stable", makeAttr(S_IFDIR | 0755)));
+	CHECK_EQUAL(0, index.insert("/churn", makeAttr(S_IFDIR | 0755)));
+	for (int i = 0; i < STABLE; ++i)
+		CHECK_EQUAL(0, index.insert(pathOf("/stable/f", i), makeAttr(S_IFREG, i), i));
+
+	std::atomic<bool> done(false);
+	std::vector<std::thread> readers;
+	for (int t = 0; t < 4; ++t)
+		readers.push_back(std::thread([&, t]() {
+			struct stat buf;
+			uint64_t data;
+			for (int k = t; !done.load(); ++k)
+			{
+				int i = k % STABLE;
+				CHECK_EQUAL(0, index.getattr(pathOf("/stable/f", i), &buf, &data));
+				CHECK_EQUAL(i, data);
+				CHECK_EQUAL(i, buf.st_size);
+
+				// Entries being moved keep their data
+				if (index.getattr(pathOf("/churn/d", k % 10) + pathOf("/f", k % 100), &buf, &data) == 0)
+					CHECK_EQUAL(k % 100, data);
+				if (k % 100 == 0)
+				{
+					std::vector<std::string> names;
+					list(index, "/stable", 64, names);
+					CHECK_EQUAL(STABLE, names.size());
+					names.clear();
+					list(index, "/churn", 3, names);
+				}
+			}
+		}));
+
+	for (int round = 0; round < 50; ++round)
+	{
+		for (int d = 0; d < 10; ++d)
+			CHECK_EQUAL(0, index.insert(pathOf("/churn/d", d), makeAttr(S_IFDIR | 0755)));
+		for (int i = 0; i < 1000; ++i)
+			CHECK_EQUAL(0, index.insert(pathOf("/churn/d", i % 10) + pathOf("/f", i % 100), makeAttr(S_IFREG), i % 100));
+		CHECK_EQUAL(0, index.rename("/churn/d3", "/churn/moved"));
+		CHECK_EQUAL(0, index.rename("/churn/moved", "/churn/d3"));
+		for (int d = 0; d < 10; ++d)
+		{
+			for (int i = 0; i < 100; ++i)
+				index.remove(pathOf("/churn/d", d) + pathOf("/f", i));
+			CHECK_EQUAL(0, index.remove(pathOf("/churn/d", d)));
+		}
+	}
+	done.store(true);
+	for (size_t i = 0; i < readers.size(); ++i)
+		readers[i].join();
+	CHECK_EQUAL(STABLE + 2, index.getSize());
+}
+
+};
+
+int main(int argc, char** argv)
+{
+	testTree();
+	testListing();
+	testConcurrentChanges();
+	return 0;
+}
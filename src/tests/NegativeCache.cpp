@@ -0,0 +1,198 @@
+/*
+Copyright (c) 2014, University of Lausanne, Switzerland 
+All rights reserved. 
+
+Redistribution and use in source and binary forms, with or without 
+modification, are permitted provided that the following conditions are 
+met: 
+
+1. Redistributions of source code must retain the above copyright 
+notice, this list of conditions and the following disclaimer. 
+
+2. Redistributions in binary form must reproduce the above copyright 
+notice, this list of conditions and the following disclaimer in the 
+documentation and/or other materials provided with the distribution. 
+
+3. Neither the name of the copyright holder nor the names of its 
+contributors may be used to endorse or promote products derived from 
+this software without specific prior written permission. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS 
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED 
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A 
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED 
+TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+
+// NegativeCache must forget a path as soon as it is created, even when the
+// creation races with a getattr() that found it missing, or with a reset of
+// the table and its Bloom filter.
+
+#include <fusepp/NegativeCache.h>
+#include "check.h"
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace fusepp;
+
+namespace
+{
+
+const int FILES = 4;
+const int THREADS = 4;
+const int UPDATES = 4000;
+
+// Files exist while their version is odd
+class ToggleFileSystem : public FS_getattr
+{
+public:
+	ToggleFileSystem()
+	{
+		for (int i = 0; i < FILES; ++i)
+			versions[i].store(0);
+	}
+
+	int getattr(const std::string& path, struct stat* buf)
+	{
+		bool exists = (versions[path[1] - '0'].load() & 1) != 0;
+		std::this_thread::yield();
+		if (!exists)
+			return -ENOENT;
+		memset(buf, 0, sizeof(*buf));
+		return 0;
+	}
+
+	std::atomic<long> versions[FILES];
+};
+
+std::string pathOf(const char* prefix, int i)
+{
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%s%d", prefix, i);
+	return buf;
+}
+
+void testStamps()
+{
+	NegativeCacheTable table(64, 60.0);
+	CHECK(!table.contains("/a"));
+	table.put("/a");
+	CHECK(table.contains("/a"));
+	CHECK(!table.contains("/b"));
+	table.invalidate("/a");
+	CHECK(!table.contains("/a"));
+
+	uint64_t stamp = table.getStamp("/a");
+	table.invalidate("/a");
+	table.put("/a", stamp);
+	CHECK(!table.contains("/a"));
+
+	stamp = table.getStamp("/a");
+	table.clear();
+	table.put("/a", stamp);
+	CHECK(!table.contains("/a"));
+}
+
+void testFilter()
+{
+	// The exact table has the last word: paths never put are not found,
+	// whatever the state of the filter
+	NegativeCacheTable table(64, 60.0);
+	int dropped = 0;
+	for (int i = 0; i < 1000; ++i)
+	{
+		std::string path(pathOf("/x", i));
+		table.put(path);
+		if (!table.contains(path))
+			dropped++;
+	}
+	// Only the put() that resets the table drops its own entry
+	CHECK_EQUAL(1000 / (2 * table.getCapacity() + 1), dropped);
+	for (int i = 0; i < 10000; ++i)
+		CHECK(!table.contains(pathOf("/y", i)));
+
+	// Resets keep the entries put after them
+	for (int round = 0; round < 4; ++round)
+	{
+		table.clear();
+		CHECK(!table.contains(pathOf("/x", 999)));
+		table.put("/z");
+		CHECK(table.contains("/z"));
+		table.invalidate("/z");
+		CHECK(!table.contains("/z"));
+	}
+}
+
+void testConcurrentCreations()
+{
+	NegativeCache<ToggleFileSystem> fs;
+	fs.getNegativeCache().configure(256, 60.0);
+	std::atomic<long> created[FILES];
+	// None exists yet
+	for (int i = 0; i < FILES; ++i)
+		created[i].store(-1);
+	std::atomic<bool> done(false);
+	std::atomic<long> stale(0);
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < THREADS; ++t)
+		threads.push_back(std::thread([&, t]() {
+			for (unsigned k = t; !done.load(); ++k)
+			{
+				int file = k % FILES;
+				// Missing although it was not deleted since it was created
+				long version = created[file].load();
+				struct stat buf;
+				if (fs.getattr(pathOf("/", file), &buf) == -ENOENT
+					&& fs.versions[file].load() == version)
+					stale++;
+				// Unrelated misses share the table
+				fs.getattr(pathOf("/missing", k % 64), &buf);
+			}
+		}));
+	threads.push_back(std::thread([&]() {
+		while (!done.load())
+		{
+			fs.getNegativeCache().clear();
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+	}));
+
+	for (int k = 0; k < UPDATES; ++k)
+	{
+		int file = k % FILES;
+		long version = fs.versions[file].fetch_add(1) + 1;
+		if (version & 1)
+		{
+			fs.invalidateNegative(pathOf("/", file));
+			created[file].store(version);
+		}
+		// Let the readers see every state
+		std::this_thread::sleep_for(std::chrono::microseconds(10));
+	}
+	done.store(true);
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+	CHECK_EQUAL(0, stale.load());
+}
+
+};
+
+int main(int argc, char** argv)
+{
+	testStamps();
+	testFilter();
+	testConcurrentCreations();
+	return 0;
+}
@@ -0,0 +1,268 @@
+/*
+Copyright (c) 2014, University of Lausanne, Switzerland 
+All rights reserved. 
+
+Redistribution and use in source and binary forms, with or without 
+modification, are permitted provided that the following conditions are 
+met: 
+
+1. Redistributions of source code must retain the above copyright 
+notice, this list of conditions and the following disclaimer. 
+
+2. Redistributions in binary form must reproduce the above copyright 
+notice, this list of conditions and the following disclaimer in the 
+documentation and/or other materials provided with the distribution. 
+
+3. Neither the name of the copyright holder nor the names of its 
+contributors may be used to endorse or promote products derived from 
+this software without specific prior written permission. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS 
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED 
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A 
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED 
+TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+
+// Identical calls made concurrently through SingleFlight reach the file
+// system once, unless they wait for too long.
+
+#include <fusepp/SingleFlight.h>
+#include "check.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <string.h>
+#include <sys/stat.h>
+using namespace fusepp;
+
+namespace
+{
+
+const int ENTRIES = 100;
+
+// Counts the calls and holds the first one until open() is called, so that
+// others can be made while it runs
+class SlowFileSystem : public FS_getattr, public FS_readdir
+{
+public:
+	SlowFileSystem()
+		: _calls(0), _open(false)
+	{}
+
+	int getattr(const std::string& path, struct stat* buf)
+	{
+		enter();
+		memset(buf, 0, sizeof(*buf));
+		buf->st_mode = S_IFREG | 0644;
+		buf->st_size = 42;
+		return 0;
+	}
+
+	// A streamed listing, which stops where the filler is full
+	int readdir(const std::string& path, DirectoryFiller& filler)
+	{
+		enter();
+		for (int i = 0; i < ENTRIES; ++i)
+		{
+			if (!filler.add(std::to_string(i), (ino_t)(i + 2), (off_t)(i + 1)))
+				break;
+		}
+		return 0;
+	}
+
+	void open()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_open = true;
+		_changed.notify_all();
+	}
+
+	void waitForCalls(int calls)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		while (_calls < calls)
+			_changed.wait(lock);
+	}
+
+	int getCalls()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _calls;
+	}
+
+private:
+	void enter()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		bool first = ++_calls == 1;
+		_changed.notify_all();
+		while (first && !_open)
+			_changed.wait(lock);
+	}
+
+	std::mutex _mutex;
+	std::condition_variable _changed;
+	int _calls;
+	bool _open;
+};
+
+typedef SingleFlight<SlowFileSystem> SharedFileSystem;
+
+// Takes 'capacity' entries at most, as the kernel's buffer does
+class CountingFiller : public FS_readdir::DirectoryFiller
+{
+public:
+	CountingFiller(size_t capacity)
+		: _capacity(capacity)
+	{}
+
+	void add(const std::string& name, ino_t id)
+	{
+		names.push_back(name);
+	}
+	bool add(const std::string& name, ino_t id, off_t cookie)
+	{
+		if (names.size() == _capacity)
+			return false;
+		names.push_back(name);
+		return true;
+	}
+	bool add(const std::string& name, const struct stat& attr, off_t cookie, double entryTimeout, double attrTimeout)
+	{
+		return add(name, attr.st_ino, cookie);
+	}
+
+	std::vector<std::string> names;
+
+private:
+	size_t _capacity;
+};
+
+// Time left to the calls started to reach SingleFlight and wait there
+void settle()
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+}
+
+void testShared()
+{
+	const int CALLS = 8;
+	SharedFileSystem fs;
+	uint64_t shared = Stats::getCounter(Stats::SINGLEFLIGHT_SHARED);
+
+	std::vector<int> results(CALLS, -1);
+	std::vector<off_t> sizes(CALLS, 0);
+	std::vector<std::thread> threads;
+	for (int i = 0; i < CALLS; ++i)
+	{
+		threads.push_back(std::thread([&, i]() {
+			struct stat buf;
+			results[i] = fs.getattr("/a", &buf);
+			sizes[i] = buf.st_size;
+		}));
+		// The first one runs, the others wait for it
+		if (i == 0)
+			fs.waitForCalls(1);
+	}
+	settle();
+	fs.open();
+	for (int i = 0; i < CALLS; ++i)
+		threads[i].join();
+
+	CHECK_EQUAL(1, fs.getCalls());
+	CHECK_EQUAL(CALLS - 1, Stats::getCounter(Stats::SINGLEFLIGHT_SHARED) - shared);
+	for (int i = 0; i < CALLS; ++i)
+	{
+		CHECK_EQUAL(0, results[i]);
+		CHECK_EQUAL(42, sizes[i]);
+	}
+}
+
+void testTimeout()
+{
+	SharedFileSystem fs;
+	fs.setSingleFlightTimeout(0.05);
+	uint64_t shared = Stats::getCounter(Stats::SINGLEFLIGHT_SHARED);
+	uint64_t timeouts = Stats::getCounter(Stats::SINGLEFLIGHT_TIMEOUTS);
+
+	int first = -1;
+	std::thread slow([&]() {
+		struct stat buf;
+		first = fs.getattr("/a", &buf);
+	});
+	fs.waitForCalls(1);
+
+	// Gives up on the first call, which is still held, and runs on its own
+	struct stat buf;
+	CHECK_EQUAL(0, fs.getattr("/a", &buf));
+	CHECK_EQUAL(42, buf.st_size);
+	CHECK_EQUAL(2, fs.getCalls());
+	CHECK_EQUAL(1, Stats::getCounter(Stats::SINGLEFLIGHT_TIMEOUTS) - timeouts);
+
+	fs.open();
+	slow.join();
+	CHECK_EQUAL(0, first);
+	CHECK_EQUAL(0, Stats::getCounter(Stats::SINGLEFLIGHT_SHARED) - shared);
+}
+
+// Lists the directory with a filler of 'runningCapacity' entries, and again
+// with one of 'sharingCapacity' entries while the first call runs
+void listConcurrently(size_t runningCapacity, size_t sharingCapacity, size_t& running, size_t& sharing)
+{
+	SharedFileSystem fs;
+	uint64_t shared = Stats::getCounter(Stats::SINGLEFLIGHT_SHARED);
+
+	CountingFiller first(runningCapacity), second(sharingCapacity);
+	int firstResult = -1, secondResult = -1;
+	std::thread runner([&]() { firstResult = fs.readdir("/", first); });
+	fs.waitForCalls(1);
+	std::thread follower([&]() { secondResult = fs.readdir("/", second); });
+	settle();
+	fs.open();
+	runner.join();
+	follower.join();
+
+	CHECK_EQUAL(0, firstResult);
+	CHECK_EQUAL(0, secondResult);
+	CHECK_EQUAL(1, fs.getCalls());
+	CHECK_EQUAL(1, Stats::getCounter(Stats::SINGLEFLIGHT_SHARED) - shared);
+	for (size_t i = 0; i < second.names.size(); ++i)
+		CHECK(second.names[i] == first.names[i]);
+	running = first.names.size();
+	sharing = second.names.size();
+}
+
+void testStreamed()
+{
+	// The call that shares gets what the running one took, and no more
+	size_t running, sharing;
+	listConcurrently(10, ENTRIES, running, sharing);
+	CHECK_EQUAL(10, running);
+	CHECK_EQUAL(10, sharing);
+
+	// Nor more than its own filler takes
+	listConcurrently(ENTRIES, 10, running, sharing);
+	CHECK_EQUAL(ENTRIES, running);
+	CHECK_EQUAL(10, sharing);
+}
+
+};
+
+int main(int argc, char** argv)
+{
+	testShared();
+	testTimeout();
+	testStreamed();
+	return 0;
+}
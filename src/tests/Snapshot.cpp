@@ -0,0 +1,150 @@
+/*
+Copyright (c) 2014, University of Lausanne, Switzerland 
+All rights reserved. 
+
+Redistribution and use in source and binary forms, with or without 
+modification, are permitted provided that the following conditions are 
+met: 
+
+1. Redistributions of source code must retain the above copyright 
+notice, this list of conditions and the following disclaimer. 
+
+2. Redistributions in binary form must reproduce the above copyright 
+notice, this list of conditions and the following disclaimer in the 
+documentation and/or other materials provided with the distribution. 
+
+3. Neither the name of the copyright holder nor the names of its 
+contributors may be used to endorse or promote products derived from 
+this software without specific prior written permission. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS 
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED 
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A 
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED 
+TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+
+// Saving a NamespaceSnapshot makes the saved entries its base, and loading
+// a truncated or damaged file leaves it empty.
+
+#include <fusepp/Snapshot.h>
+#include "check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string>
+using namespace fusepp;
+
+namespace
+{
+
+struct stat fileAttr(off_t size)
+{
+	struct stat attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.st_mode = S_IFREG | 0644;
+	attr.st_nlink = 1;
+	attr.st_size = size;
+	return attr;
+}
+
+void testSave(const std::string& file)
+{
+	struct stat attr;
+	NamespaceSnapshot snapshot;
+	for (int i = 0; i < 10; ++i)
+		snapshot.record("/file" + std::to_string(i), fileAttr(i));
+	CHECK(snapshot.save(file));
+	CHECK_EQUAL(10, snapshot.getLoadedCount());
+
+	// The file system answered these already
+	CHECK(!snapshot.take("/file3", attr));
+
+	// Nothing is left in the shards: saving again writes the same entries
+	snapshot.forget("/file4");
+	snapshot.record("/other", fileAttr(100));
+	CHECK(snapshot.save(file));
+	CHECK_EQUAL(10, snapshot.getLoadedCount());
+	CHECK(snapshot.save(file));
+	CHECK_EQUAL(10, snapshot.getLoadedCount());
+
+	NamespaceSnapshot loaded;
+	CHECK(loaded.load(file));
+	CHECK_EQUAL(10, loaded.getLoadedCount());
+	CHECK(loaded.take("/file3", attr));
+	CHECK_EQUAL(3, attr.st_size);
+	CHECK(!loaded.take("/file3", attr));
+	CHECK(!loaded.take("/file4", attr));
+	CHECK(loaded.take("/other", attr));
+	CHECK_EQUAL(100, attr.st_size);
+
+	// What was taken stays taken across a save
+	loaded.record("/new", fileAttr(1));
+	CHECK(loaded.save(file));
+	CHECK_EQUAL(11, loaded.getLoadedCount());
+	CHECK(!loaded.take("/file3", attr));
+	CHECK(!loaded.take("/new", attr));
+	CHECK(loaded.take("/file5", attr));
+}
+
+void testDamaged(const std::string& file)
+{
+	NamespaceSnapshot snapshot;
+	snapshot.record("/a", fileAttr(1));
+	snapshot.record("/b", fileAttr(2));
+	snapshot.record("/c", fileAttr(3));
+	CHECK(snapshot.save(file));
+	int fd = open(file.c_str(), O_RDWR);
+	CHECK(fd >= 0);
+	off_t size = lseek(fd, 0, SEEK_END);
+
+	// The last path no longer sorts after the others
+	NamespaceSnapshot loaded;
+	CHECK(loaded.load(file));
+	CHECK(pwrite(fd, "a", 1, size - 1) == 1);
+	CHECK(!loaded.load(file));
+	CHECK_EQUAL(0, loaded.getLoadedCount());
+	CHECK(pwrite(fd, "c", 1, size - 1) == 1);
+	CHECK(loaded.load(file));
+
+	// Missing bytes, down to a partial header
+	CHECK(ftruncate(fd, size - 1) == 0);
+	CHECK(!loaded.load(file));
+	CHECK_EQUAL(0, loaded.getLoadedCount());
+	CHECK(ftruncate(fd, 4) == 0);
+	CHECK(!loaded.load(file));
+
+	// Not a snapshot
+	CHECK(ftruncate(fd, 0) == 0);
+	char garbage[256];
+	memset(garbage, 'x', sizeof(garbage));
+	CHECK(pwrite(fd, garbage, sizeof(garbage), 0) == (ssize_t)sizeof(garbage));
+	CHECK(!loaded.load(file));
+	CHECK_EQUAL(0, loaded.getLoadedCount());
+	struct stat attr;
+	CHECK(!loaded.take("/a", attr));
+	close(fd);
+}
+
+};
+
+int main(int argc, char** argv)
+{
+	char dir[] = "/tmp/fusepp-snapshot-XXXXXX";
+	CHECK(mkdtemp(dir));
+	const std::string file = std::string(dir) + "/snapshot";
+	testSave(file);
+	testDamaged(file);
+	unlink(file.c_str());
+	rmdir(dir);
+	return 0;
+}
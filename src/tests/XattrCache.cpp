@@ -0,0 +1,255 @@
+/*
+Copyright (c) 2014, University of Lausanne, Switzerland 
+All rights reserved. 
+
+Redistribution and use in source and binary forms, with or without 
+modification, are permitted provided that the following conditions are 
+met: 
+
+1. Redistributions of source code must retain the above copyright 
+notice, this list of conditions and the following disclaimer. 
+
+2. Redistributions in binary form must reproduce the above copyright 
+notice, this list of conditions and the following disclaimer in the 
+documentation and/or other materials provided with the distribution. 
+
+3. Neither the name of the copyright holder nor the names of its 
+contributors may be used to endorse or promote products derived from 
+this software without specific prior written permission. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS 
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED 
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A 
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED 
+TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+
+// What XattrCache answers without calling the file system, and what it must
+// not keep: a value read before a change of its path is dropped.
+
+#include <fusepp/XattrCache.h>
+#include "check.h"
+#include <errno.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+using namespace fusepp;
+
+namespace
+{
+
+// Attributes in a map, with the calls counted. 'during' runs inside
+// getxattr(), listxattr() and listxattrs(), once the answer is read.
+class MapFileSystem : public FS_getxattr, public FS_listxattr, public FS_setxattr, public FS_readdir
+{
+public:
+	typedef std::map<std::string, std::map<std::string, std::string> > Files;
+
+	MapFileSystem()
+		: calls(0)
+	{}
+
+	int getxattr(const std::string& path, const std::string& name, std::string& value)
+	{
+		++calls;
+		std::map<std::string, std::string>& xattrs(files[path]);
+		std::map<std::string, std::string>::const_iterator it = xattrs.find(name);
+		int res = it == xattrs.end() ? -ENODATA : 0;
+		if (res == 0)
+			value = it->second;
+		interfere();
+		return res;
+	}
+
+	int listxattr(const std::string& path, std::vector<std::string>& names)
+	{
+		++calls;
+		names.clear();
+		for (std::map<std::string, std::string>::const_iterator it = files[path].begin(); it != files[path].end(); ++it)
+			names.push_back(it->first);
+		interfere();
+		return 0;
+	}
+
+	int listxattrs(const std::string& path, XattrFiller& filler)
+	{
+		++calls;
+		std::vector<std::pair<std::string, Xattrs> > entries;
+		for (Files::const_iterator it = files.begin(); it != files.end(); ++it)
+			if (it->first != "/")
+				entries.push_back(std::make_pair(it->first.substr(1), Xattrs(it->second.begin(), it->second.end())));
+		interfere();
+		for (size_t i = 0; i < entries.size(); ++i)
+			filler.add(entries[i].first, entries[i].second);
+		return 0;
+	}
+
+	int setxattr(const std::string& path, const std::string& name, const std::string& value, int flags)
+	{
+		files[path][name] = value;
+		return 0;
+	}
+
+	int removexattr(const std::string& path, const std::string& name)
+	{
+		return files[path].erase(name) ? 0 : -ENODATA;
+	}
+
+	int readdir(const std::string& path, DirectoryFiller& filler)
+	{
+		for (Files::const_iterator it = files.begin(); it != files.end(); ++it)
+			if (it->first != "/")
+				filler.add(it->first.substr(1));
+		return 0;
+	}
+
+	Files files;
+	int calls;
+	std::function<void()> during;
+
+private:
+	void interfere()
+	{
+		std::function<void()> f;
+		f.swap(during);
+		if (f)
+			f();
+	}
+};
+
+typedef XattrCache<MapFileSystem> CachedFileSystem;
+
+class NullFiller : public FS_readdir::DirectoryFiller
+{
+public:
+	void add(const std::string& name, ino_t id) {}
+	bool add(const std::string& name, ino_t id, off_t cookie) { return true; }
+	bool add(const std::string& name, const struct stat& attr, off_t cookie, double entryTimeout, double attrTimeout) { return true; }
+};
+
+void testHits()
+{
+	CachedFileSystem fs;
+	fs.getXattrCache().configure(64, 60.0);
+	fs.files["/a"]["user.x"] = "1";
+	std::string value;
+
+	CHECK_EQUAL(0, fs.getxattr("/a", "user.x", value));
+	CHECK_EQUAL(0, fs.getxattr("/a", "user.x", value));
+	CHECK(value == "1");
+	CHECK_EQUAL(1, fs.calls);
+
+	CHECK_EQUAL(-ENODATA, fs.getxattr("/a", "user.y", value));
+	CHECK_EQUAL(-ENODATA, fs.getxattr("/a", "user.y", value));
+	CHECK_EQUAL(2, fs.calls);
+
+	// A complete list tells which names do not exist
+	std::vector<std::string> names;
+	CHECK_EQUAL(0, fs.listxattr("/a", names));
+	CHECK_EQUAL(0, fs.listxattr("/a", names));
+	CHECK_EQUAL(1, names.size());
+	CHECK_EQUAL(3, fs.calls);
+	CHECK_EQUAL(-ENODATA, fs.getxattr("/a", "user.z", value));
+	CHECK_EQUAL(3, fs.calls);
+}
+
+void testInvalidation()
+{
+	CachedFileSystem fs;
+	fs.getXattrCache().configure(64, 60.0);
+	fs.files["/a"]["user.x"] = "1";
+	std::string value;
+
+	CHECK_EQUAL(0, fs.getxattr("/a", "user.x", value));
+	CHECK_EQUAL(0, fs.setxattr("/a", "user.x", "2", 0));
+	CHECK_EQUAL(0, fs.getxattr("/a", "user.x", value));
+	CHECK(value == "2");
+	CHECK_EQUAL(2, fs.calls);
+
+	CHECK_EQUAL(0, fs.removexattr("/a", "user.x"));
+	CHECK_EQUAL(-ENODATA, fs.getxattr("/a", "user.x", value));
+	CHECK_EQUAL(3, fs.calls);
+
+	CHECK_EQUAL(-ENODATA, fs.getxattr("/a", "user.x", value));
+	fs.files["/a"]["user.x"] = "3";
+	fs.invalidateXattrs("/a");
+	CHECK_EQUAL(0, fs.getxattr("/a", "user.x", value));
+	CHECK(value == "3");
+}
+
+void testBulk()
+{
+	CachedFileSystem fs;
+	fs.getXattrCache().configure(64, 60.0);
+	fs.files["/"];
+	fs.files["/a"]["user.x"] = "1";
+	fs.files["/b"];
+	NullFiller filler;
+	CHECK_EQUAL(0, fs.readdir("/", filler));
+	CHECK_EQUAL(1, fs.calls);
+
+	std::string value;
+	std::vector<std::string> names;
+	CHECK_EQUAL(0, fs.getxattr("/a", "user.x", value));
+	CHECK(value == "1");
+	CHECK_EQUAL(-ENODATA, fs.getxattr("/a", "user.y", value));
+	CHECK_EQUAL(-ENODATA, fs.getxattr("/b", "user.x", value));
+	CHECK_EQUAL(0, fs.listxattr("/b", names));
+	CHECK(names.empty());
+	CHECK_EQUAL(1, fs.calls);
+}
+
+void testRaces()
+{
+	// A change made while the file system answers a miss
+	CachedFileSystem fs;
+	fs.getXattrCache().configure(64, 60.0);
+	fs.files["/"];
+	fs.files["/a"]["user.x"] = "1";
+	std::string value;
+
+	fs.during = [&fs]() { fs.setxattr("/a", "user.x", "2", 0); };
+	CHECK_EQUAL(0, fs.getxattr("/a", "user.x", value));
+	CHECK(value == "1");
+	CHECK_EQUAL(0, fs.getxattr("/a", "user.x", value));
+	CHECK(value == "2");
+
+	std::vector<std::string> names;
+	fs.during = [&fs]() { fs.removexattr("/a", "user.x"); };
+	CHECK_EQUAL(0, fs.listxattr("/a", names));
+	CHECK_EQUAL(1, names.size());
+	CHECK_EQUAL(0, fs.listxattr("/a", names));
+	CHECK(names.empty());
+
+	fs.during = [&fs]() { fs.setxattr("/c", "user.y", "1", 0); };
+	CHECK_EQUAL(-ENODATA, fs.getxattr("/c", "user.y", value));
+	CHECK_EQUAL(0, fs.getxattr("/c", "user.y", value));
+	CHECK(!fs.during);
+
+	// And while a directory is listed
+	fs.during = [&fs]() { fs.setxattr("/a", "user.y", "2", 0); };
+	NullFiller filler;
+	CHECK_EQUAL(0, fs.readdir("/", filler));
+	CHECK(!fs.during);
+	CHECK_EQUAL(0, fs.getxattr("/a", "user.y", value));
+	CHECK(value == "2");
+}
+
+};
+
+int main(int argc, char** argv)
+{
+	testHits();
+	testInvalidation();
+	testBulk();
+	testRaces();
+	return 0;
+}